@@ -5,21 +5,27 @@
 #undef main
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <math.h>
 #include <time.h>
+#include <chrono>
+#include <vector>
 
 
 //IF CHANGING ANY OF THESE VALUES DOESNT CHANGE WHEN RUNNING THE APPLICATION THEN CLOSE AND RE OPEN KERNEL.CU
 /// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 //Change the width of the tile here (ALSO BLOCK WIDTH)
 #define TILE_WIDTH 32 // use the largest tile width (Nsight analysis doesnt get affected by this) 
+// Largest mask width the mask arrays can hold, must be an odd value
+#define MAX_MASK_SIZE 31
 
 /// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
-//change the gaussinan blur effect here
-const int maskSize = 3; // width of the blur in pixels, must be an odd value (3, 5, 7, 9, 11, 13)
-const float stdv = 20.0; // strength of the blur (1.0, 3.0, 5.0, 10.0, 20.0)?
-// Change this to change the image file to be loaded. Note: needs to be a JPEG.
+//change the default gaussinan blur effect here (can also be set with --mask and --sigma)
+int maskSize = 3; // width of the blur in pixels, must be an odd value (3, 5, 7, 9, 11, 13 ... MAX_MASK_SIZE)
+float stdv = 20.0; // strength of the blur (1.0, 3.0, 5.0, 10.0, 20.0)?
+// Change this to change the default image file to be loaded (can also be set with --input). Note: needs to be a JPEG.
 // file sizes are relative to their name, in order from smallest to largest the name's are
 // "240p", "480p", "720p", "1080p", "1440p", "4k", "8k", "16k". 
 // to Load a custom image please put your image in the project folder where these above images are found, 
@@ -30,15 +36,119 @@ const char* IMAGE_PATH = "240p.jpg";
 // to be loaded otherwise it'll be distorted.
 const int WINDOW_WIDTH = 1280;
 const int WINDOW_HEIGHT = 720;
-// Host version of the convolution mask 2D array.
-float h_convMask[maskSize][maskSize];
+// Host version of the convolution mask 2D array (only the first maskSize x maskSize entries are used).
+float h_convMask[MAX_MASK_SIZE][MAX_MASK_SIZE];
 // 2D statically allocated array in device memory containing the convolution kernel.
-__constant__ float d_convMask[maskSize][maskSize];
-// used in the apllying of the convolution kernel, put here in order to set it once
-const int offset = (maskSize - 1) / 2; // how many x or y coordinates the convolution kernel will take you away from the central origin
+__constant__ float d_convMask[MAX_MASK_SIZE][MAX_MASK_SIZE];
+// used in the apllying of the convolution kernel, set once the mask size is known
+int offset = (maskSize - 1) / 2; // how many x or y coordinates the convolution kernel will take you away from the central origin
+
+////
+// Time spent in one pipeline stage, summed over every time it ran.
+////
+struct StageTotal {
+	const char* name;
+	int calls;
+	double totalMs;
+};
+// Pipeline stages in the order they first ran, filled in by StageTimer.
+std::vector<StageTotal> stageTotals;
+// Device memory allocated by the last convolveImageCuda call in bytes, for --timings.
+size_t deviceBytes = 0;
+// Name of this build's GPU backend in --timings files.
+const char* TIMINGS_BACKEND = "cuda-shared";
 
 /// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
+////
+// Add one run of a pipeline stage to its total.
+// name should be a string literal, stages are told apart by it.
+////
+void addStageTime(const char* name, double ms)
+{
+	for (size_t i = 0; i < stageTotals.size(); i++) {
+		if (strcmp(stageTotals[i].name, name) == 0) {
+			stageTotals[i].calls++;
+			stageTotals[i].totalMs += ms;
+			return;
+		}
+	}
+	StageTotal total = { name, 1, ms };
+	stageTotals.push_back(total);
+}
+
+////
+// Times the scope it is declared in (wall clock) and adds it to the named stage when the scope ends.
+////
+class StageTimer {
+public:
+	explicit StageTimer(const char* name) : name(name), start(std::chrono::steady_clock::now()) {}
+	~StageTimer() { addStageTime(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()); }
+
+private:
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
+
+////
+// Print every stage with its total and mean time and its share of the time spent in all stages.
+////
+void printStageBreakdown()
+{
+	double sumMs = 0.0;
+	for (size_t i = 0; i < stageTotals.size(); i++)
+		sumMs += stageTotals[i].totalMs;
+
+	printf("%-16s %6s %12s %12s %7s\n", "stage", "calls", "total", "mean", "share");
+	for (size_t i = 0; i < stageTotals.size(); i++) {
+		const StageTotal& stage = stageTotals[i];
+		printf("%-16s %6d %10.3fms %10.3fms %6.1f%%\n", stage.name, stage.calls, stage.totalMs,
+			stage.totalMs / stage.calls, sumMs > 0.0 ? 100.0 * stage.totalMs / sumMs : 0.0);
+	}
+	printf("%-16s %6s %10.3fms\n\n", "all stages", "", sumMs);
+}
+
+////
+// Total time spent in a stage so far, 0 if it hasn't run.
+////
+double stageTotalMs(const char* name)
+{
+	for (size_t i = 0; i < stageTotals.size(); i++) {
+		if (strcmp(stageTotals[i].name, name) == 0)
+			return stageTotals[i].totalMs;
+	}
+	return 0.0;
+}
+
+////
+// Append one GPU run to a CSV file (with a header line if the file is new), so the serial
+// program's --shootout can rank it alongside the CPU backends.
+// Parameters:
+// ms: host-side time of the whole convolveImageCuda call (allocation, copies, kernel and free).
+// maxError: largest CPU vs GPU difference per channel, -1 if the CPU version didn't run.
+// Returns false (after printing why) if the file could not be written.
+////
+bool appendTimings(const char* path, const char* imagePath, int imageW, int imageH, double ms, int maxError)
+{
+	FILE* file = fopen(path, "a");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0)
+		fprintf(file, "backend,image,width,height,mask,sigma,ms,kernel_ms,device_bytes,max_error\n");
+	fprintf(file, "%s,%s,%d,%d,%d,%g,%.4f,%.4f,%llu,", TIMINGS_BACKEND, imagePath, imageW, imageH, maskSize, stdv,
+		ms, stageTotalMs("kernel"), (unsigned long long)deviceBytes);
+	if (maxError >= 0)
+		fprintf(file, "%d\n", maxError);
+	else
+		fprintf(file, "\n");
+	fclose(file);
+	printf("Appended GPU timings to %s.\n", path);
+	return true;
+}
+
 /// Generate the guassian convolution kernel
 // CPU runnable
 // based on: https://www.codewithc.com/gaussian-filter-generation-in-c/
@@ -101,10 +211,13 @@ __host__ __device__ int get1dIndex(int width, int height, int x, int y)
 // stored in d_convMask.
 // Parameters:
 // inPixels: device array holding the original image data.
-// outPixels: device array where the modified image should be written.
+// outPixels: pitched device array of 8-bit RGBA where the modified image should be written.
+// outPitch: length of one outPixels row in bytes.
 // imageW, imageH: width & height of the image.
+// maskSize: width of the mask stored in d_convMask.
 ////
-__global__ void convolveKernel(float* inPixels, float* outPixels, int imageW, int imageH) {
+__global__ void convolveKernel(float* inPixels, unsigned char* outPixels, size_t outPitch, int imageW, int imageH, int maskSize) {
+	int offset = (maskSize - 1) / 2;
 	int globalIdX = blockIdx.x * blockDim.x + threadIdx.x;
 	int globalIdY = blockIdx.y * blockDim.y + threadIdx.y;
 	int globalIdZ = blockIdx.z * blockDim.z + threadIdx.z;
@@ -123,9 +236,8 @@ __global__ void convolveKernel(float* inPixels, float* outPixels, int imageW, in
 		int j = globalIdY;
 		
 
-		// Extract the red, green and blue components.
-		//give the position of the r,g,b pixel in the array
-		int r = get1dIndex(imageW, imageH, i, j) + globalIdZ;
+		//give the position of the r,g or b byte in the pitched output
+		unsigned char* outPixel = outPixels + j * outPitch + i * 4;
 
 		//declare the sum of each pixel colour value, the sum of the pixels around multiplied by the convolution kernels related value
 		float rsum = 0.0f;
@@ -142,31 +254,44 @@ __global__ void convolveKernel(float* inPixels, float* outPixels, int imageW, in
 		}
 
 		//pixels that are now newly calculated now guassian smoothing has been applied
-		outPixels[r] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+		outPixel[globalIdZ] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+		if (globalIdZ == 0)
+			outPixel[3] = 255; // only one layer needs to fill in the alpha
 	}
 }
 
 ////
 // GPU version of the convolution code.
+// The 8-bit RGBA result is copied back straight into the destination, so a locked
+// texture (or any other pitched buffer) can be passed in without a staging copy.
 // Parameters:
-// inPixels: array of bytes containing the original image pixels.
-// outPixels: array of bytes where the modified image should be written.
+// inPixels: array of floats containing the original image pixels.
+// outPixels: 8-bit RGBA host destination where the modified image should be written.
+// outPitch: length of one destination row in bytes (can be more than imageW * 4).
 // imageW, imageH: width & height of the image.
 ////
-void convolveImageCuda(float* inPixels, float* outPixels, int imageW, int imageH)
+void convolveImageCuda(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH)
 {
 	float* d_inPixels; //device copy of inPixels.
-	float* d_outPixels; //device copy of outPixels.
+	unsigned char* d_outPixels; //device copy of outPixels.
+	size_t d_outPitch; //row length of d_outPixels in bytes, chosen by the driver
 
 	//Allocate device arrays.
-	cudaMalloc(&d_inPixels, 4 * imageW * imageH * sizeof(float));
-	cudaMalloc(&d_outPixels, 4 * imageW * imageH * sizeof(float));
+	{
+		StageTimer timer("device alloc");
+		cudaMalloc(&d_inPixels, 4 * imageW * imageH * sizeof(float));
+		cudaMallocPitch(&d_outPixels, &d_outPitch, 4 * imageW * sizeof(unsigned char), imageH);
+		deviceBytes = 4 * imageW * imageH * sizeof(float) + d_outPitch * imageH;
+	}
 
-	//Copy input pixels to device.
-	cudaMemcpy(d_inPixels, inPixels, 4 * sizeof(float) * imageH * imageW, cudaMemcpyHostToDevice);
+	{
+		StageTimer timer("upload");
+		//Copy input pixels to device.
+		cudaMemcpy(d_inPixels, inPixels, 4 * sizeof(float) * imageH * imageW, cudaMemcpyHostToDevice);
 
-	//Copy convolution mask to device.
-	cudaMemcpyToSymbol(d_convMask, h_convMask, sizeof(float) * maskSize * maskSize);
+		//Copy convolution mask to device.
+		cudaMemcpyToSymbol(d_convMask, h_convMask, sizeof(h_convMask));
+	}
 
 	//Setup the size of blocks and grids kernel.
 	int x = ceil((double)imageW / TILE_WIDTH); // Work out how many blocks will be needed in order to cover the whole image
@@ -174,13 +299,21 @@ void convolveImageCuda(float* inPixels, float* outPixels, int imageW, int imageH
 	dim3 dimBlock(TILE_WIDTH, TILE_WIDTH, 1); // Create a block size based on tile size
 	dim3 dimGrid(x, y, 3); // Create a grid of how many blocks are needed in order to cover the whole image (3 layers (z axis to cover the RGB values))
 
-	// Run the kernel
-	convolveKernel << < dimGrid, dimBlock >> > (d_inPixels, d_outPixels, imageW, imageH);
+	// Run the kernel, waiting for it so its time isn't counted as part of the download
+	{
+		StageTimer timer("kernel");
+		convolveKernel << < dimGrid, dimBlock >> > (d_inPixels, d_outPixels, d_outPitch, imageW, imageH, maskSize);
+		cudaDeviceSynchronize();
+	}
 
-	// Copy results back to outPixels.
-	cudaMemcpy(outPixels, d_outPixels, 4 * sizeof(float) * imageH * imageW, cudaMemcpyDeviceToHost);
+	// Copy results back to outPixels, row by row so both pitches are respected.
+	{
+		StageTimer timer("download");
+		cudaMemcpy2D(outPixels, outPitch, d_outPixels, d_outPitch, 4 * imageW * sizeof(unsigned char), imageH, cudaMemcpyDeviceToHost);
+	}
 
 	//free up memory now not needed
+	StageTimer timer("device free");
 	cudaFree(d_inPixels);
 	cudaFree(d_outPixels);
 }
@@ -189,11 +322,12 @@ void convolveImageCuda(float* inPixels, float* outPixels, int imageW, int imageH
 // CPU version of the convolution code.
 // Applies the convolution kernel to each pixel (including RGBA values)
 // Parameters:
-// inPixels: array of bytes containing the original image pixels.
-// outPixels: array of bytes where the modified image should be written.
+// inPixels: array of floats containing the original image pixels.
+// outPixels: 8-bit RGBA destination where the modified image should be written.
+// outPitch: length of one destination row in bytes (can be more than imageW * 4).
 // imageW, imageH: width & height of the image.
 ////
-void convolveImageCPU(float* inPixels, float* outPixels, int imageW, int imageH)
+void convolveImageCPU(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH)
 {
 	for (int imageX = 0; imageX < imageW; imageX++) {
 		for (int imageY = 0; imageY < imageH; imageY++) {
@@ -201,11 +335,8 @@ void convolveImageCPU(float* inPixels, float* outPixels, int imageW, int imageH)
 				int i = imageX;
 				int j = imageY;
 
-				// Extract the red, green and blue components.
-				//give the position of the r,g,b pixel in the array
-				int r = get1dIndex(imageW, imageH, i, j) + 0;
-				int g = get1dIndex(imageW, imageH, i, j) + 1;
-				int b = get1dIndex(imageW, imageH, i, j) + 2;
+				//give the position of the output pixel in the (pitched) destination
+				unsigned char* outPixel = outPixels + j * outPitch + i * 4;
 
 				//declare the sum of each pixel colour value, the sum of the pixels around multiplied by the convolution kernels related value
 				float rsum = 0.0f;
@@ -226,39 +357,185 @@ void convolveImageCPU(float* inPixels, float* outPixels, int imageW, int imageH)
 					}
 				}
 				//pixels that are now newly calculated now guassian smoothing has been applied
-				outPixels[r] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
-				outPixels[g] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
-				outPixels[b] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+				outPixel[0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+				outPixel[1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+				outPixel[2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+				outPixel[3] = 255;
 			}
 		}
 	}
 }
 
+////
+// Settings for one run of the program, filled in from the command line.
+////
+struct Options {
+	const char* inputPath; // image to blur
+	const char* outputPath; // where to save the result (.png, .jpg or .bmp), NULL to not save
+	const char* backend; // "cpu", "cuda" or "both" (runs both and compares them)
+	bool view; // show the result in an SDL window instead of exiting when done
+	bool stages; // print how long every pipeline stage took
+	int tolerance; // largest difference per channel between the CPU and GPU result that still counts as matching
+	const char* timingsPath; // append the GPU timing to this CSV file, NULL to not
+};
+
+////
+// Print the command line help.
+////
+void printUsage(const char* program)
+{
+	printf("Usage: %s [options]\n", program);
+	printf("  --input <file>     image to blur (default %s)\n", IMAGE_PATH);
+	printf("  --output <file>    save the blurred image, format picked by extension (.png, .jpg, .bmp)\n");
+	printf("  --mask <n>         mask width, odd value from 1 to %d (default %d)\n", MAX_MASK_SIZE, maskSize);
+	printf("  --sigma <f>        strength of the blur (default %.1f)\n", stdv);
+	printf("  --backend <name>   cpu, cuda or both (runs both and compares them, default cuda)\n");
+	printf("  --view             show the result in a window until it is closed\n");
+	printf("  --stages           print a breakdown of the time spent in every pipeline stage\n");
+	printf("  --tolerance <n>    largest CPU vs GPU difference per channel (0-255) that still matches (default 1),\n");
+	printf("                     the exit code is 2 if any pixel is further apart\n");
+	printf("  --timings <file>   append the GPU time, kernel time, device memory and max error to a CSV file\n");
+	printf("                     (for the serial program's --shootout --cuda <file>)\n");
+	printf("Running with no options opens the viewer on the default image.\n");
+}
+
+////
+// Read the command line into options, the mask settings go straight into maskSize and stdv.
+// Returns false (after printing why) if the command line is not valid.
+////
+bool parseOptions(int argc, char** argv, Options* options)
+{
+	options->inputPath = IMAGE_PATH;
+	options->outputPath = NULL;
+	options->backend = "cuda";
+	options->view = (argc == 1); // keep the old behaviour when started without arguments
+	options->stages = false;
+	options->tolerance = 1;
+	options->timingsPath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--view") == 0) {
+			options->view = true;
+			continue;
+		}
+		if (strcmp(arg, "--stages") == 0) {
+			options->stages = true;
+			continue;
+		}
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0) {
+			options->inputPath = value;
+		}
+		else if (strcmp(arg, "--output") == 0) {
+			options->outputPath = value;
+		}
+		else if (strcmp(arg, "--mask") == 0) {
+			maskSize = atoi(value);
+			if (maskSize < 1 || maskSize > MAX_MASK_SIZE || maskSize % 2 == 0) {
+				fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+				return false;
+			}
+			offset = (maskSize - 1) / 2;
+		}
+		else if (strcmp(arg, "--sigma") == 0) {
+			stdv = (float)atof(value);
+			if (stdv <= 0.0f) {
+				fprintf(stderr, "Sigma must be greater than 0\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--tolerance") == 0) {
+			options->tolerance = atoi(value);
+			if (options->tolerance < 0) {
+				fprintf(stderr, "Tolerance must be at least 0\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--timings") == 0) {
+			options->timingsPath = value;
+		}
+		else if (strcmp(arg, "--backend") == 0) {
+			if (strcmp(value, "cpu") != 0 && strcmp(value, "cuda") != 0 && strcmp(value, "both") != 0) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+			options->backend = value;
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+	return true;
+}
+
+////
+// Save a surface, the format is picked from the file extension (.png, .jpg/.jpeg or .bmp).
+// Returns false (after printing why) if the image could not be saved.
+////
+bool saveImage(SDL_Surface* surface, const char* path)
+{
+	const char* extension = strrchr(path, '.');
+	int result;
+	if (extension != NULL && (SDL_strcasecmp(extension, ".jpg") == 0 || SDL_strcasecmp(extension, ".jpeg") == 0))
+		result = IMG_SaveJPG(surface, path, 95);
+	else if (extension != NULL && SDL_strcasecmp(extension, ".bmp") == 0)
+		result = SDL_SaveBMP(surface, path);
+	else
+		result = IMG_SavePNG(surface, path);
+
+	if (result != 0) {
+		fprintf(stderr, "Could not save %s: %s\n", path, SDL_GetError());
+		return false;
+	}
+	printf("Saved %s.\n", path);
+	return true;
+}
+
 ////
 // Program entry point.
+// Without --view nothing but the image loading/saving parts of SDL are used, so no window is created.
 ////
-int main(int argc, int** argv)
+int main(int argc, char** argv)
 {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	bool runCPU = strcmp(options.backend, "cuda") != 0;
+	bool runGPU = strcmp(options.backend, "cpu") != 0;
+
 	generateGuassianKernel(maskSize, maskSize);
-	// Initialize SDL and create window.
-	SDL_Init(SDL_INIT_VIDEO);
-	SDL_Window* window = SDL_CreateWindow(
-		"Guassian Blur Applicator, CPU vs GPU",
-		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-		WINDOW_WIDTH, WINDOW_HEIGHT, 0);
-	SDL_Renderer* renderer = SDL_CreateRenderer(
-		window,
-		-1,
-		SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-
-	// Load a photo based on image path set at the top.
-	SDL_Surface* image = IMG_Load(IMAGE_PATH);
+
+	// Load a photo based on the image path given (or the default set at the top).
+	SDL_Surface* image;
+	{
+		StageTimer timer("load");
+		image = IMG_Load(options.inputPath);
+	}
+	if (image == NULL) {
+		fprintf(stderr, "Could not load %s: %s\n", options.inputPath, IMG_GetError());
+		return 1;
+	}
 	printf("Loaded %dx%d image.\n", image->w, image->h);
 	// Copy to a new surface so that we know the format (32 bit RGBA).
+	std::chrono::steady_clock::time_point convertStart = std::chrono::steady_clock::now();
 	SDL_Surface* surface = SDL_CreateRGBSurface(0, image->w, image->h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
 	SDL_BlitSurface(image, NULL, surface, NULL);
 	SDL_FreeSurface(image);
 	image = NULL;
+	addStageTime("convert", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - convertStart).count());
 	//retreve the image size from the surface of the SDL panel
 	int imageSize = surface->w * surface->h;
 
@@ -267,108 +544,182 @@ int main(int argc, int** argv)
 	// Note: stored in row major order
 	float* floatPixels;
 	cudaMallocHost(&floatPixels, 4 * imageSize * sizeof(float));
-	float* floatPixelsOut;
-	cudaMallocHost(&floatPixelsOut, 4 * imageSize * sizeof(float));
-	float* floatPixelsStore;
-	cudaMallocHost(&floatPixelsStore, 4 * imageSize * sizeof(float));
+	// CPU result kept in plain RGBA bytes (pitch = width * 4) ready to compare to the GPU result
+	unsigned char* cpuPixelsOut = NULL;
+	if (runCPU && runGPU)
+		cudaMallocHost(&cpuPixelsOut, 4 * imageSize * sizeof(unsigned char));
 
 	// Copy surface data (image)
+	std::chrono::steady_clock::time_point floatStart = std::chrono::steady_clock::now();
 	unsigned char* surfacePixels = (unsigned char*)surface->pixels;
 	for (int i = 0; i < imageSize; i++) {
 		floatPixels[i * 4 + 0] = ((float)surfacePixels[i * 4 + 0]);
 		floatPixels[i * 4 + 1] = ((float)surfacePixels[i * 4 + 1]);
 		floatPixels[i * 4 + 2] = ((float)surfacePixels[i * 4 + 2]);
 	}
+	addStageTime("to float", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - floatStart).count());
 
-	////CPU run and time
-	//clock_t CPUStart = clock();
-	//convolveImageCPU(floatPixels, floatPixelsOut, surface->w, surface->h);
-	//clock_t CPUEnd = clock();
-	//float CPUms = 1000.0f * (CPUEnd - CPUStart) / CLOCKS_PER_SEC;
-	//printf("CPU Convolution took %fms.\n\n", CPUms);
-
-	////Store a copy of CPU out pixel ready to compare to GPU pixels
-	//for (int i = 0; i < imageSize; i++) {
-	//	floatPixelsStore[i * 4 + 0] = ((float)floatPixelsOut[i * 4 + 0]);
-	//	floatPixelsStore[i * 4 + 1] = ((float)floatPixelsOut[i * 4 + 1]);
-	//	floatPixelsStore[i * 4 + 2] = ((float)floatPixelsOut[i * 4 + 2]);
-	//}
-
-	//GPU run and time
-	clock_t GPUStart = clock();
-	convolveImageCuda(floatPixels, floatPixelsOut, surface->w, surface->h);
-	clock_t GPUEnd = clock();
-	float GPUms = 1000.0f * (GPUEnd - GPUStart) / CLOCKS_PER_SEC;
-	printf("GPU Convolution took %fms.\n\n", GPUms);
-
-	//int correctPixels = 0;
-	////Compare Results
-	//for (int i = 0; i < imageSize; i++) {
-	//	if (floatPixelsStore[i * 4 + 0] == ((float)floatPixelsOut[i * 4 + 0])) {
-	//		if (floatPixelsStore[i * 4 + 1] == ((float)floatPixelsOut[i * 4 + 1])) {
-	//			if (floatPixelsStore[i * 4 + 2] == ((float)floatPixelsOut[i * 4 + 2])) {
-	//				correctPixels++;
-	//			}
-	//		}
-	//	}
-	//}
-
-	//float difference = ((imageSize / correctPixels) * 100);
-	//printf("CPU vs GPU Convolution Simularity %f Percent \n\n", difference);
-
-	// Allocate a texture that will be the actual image drawn to the screen.
-	SDL_Texture* texture = SDL_CreateTexture(
-		renderer,
-		SDL_PIXELFORMAT_ABGR8888,
-		SDL_TEXTUREACCESS_STREAMING,
-		surface->w, surface->h);
-
+	SDL_Window* window = NULL;
+	SDL_Renderer* renderer = NULL;
+	SDL_Texture* texture = NULL;
+	SDL_Surface* result = NULL;
+	// where the final result gets written, either a locked texture or the surface to save
 	unsigned char* pixelsTmp;
 	int pitch;
 
-	SDL_LockTexture(texture, NULL, (void**)(&pixelsTmp), &pitch);
+	if (options.view) {
+		StageTimer timer("create window");
+		// Initialize SDL and create window.
+		SDL_Init(SDL_INIT_VIDEO);
+		window = SDL_CreateWindow(
+			"Guassian Blur Applicator, CPU vs GPU",
+			SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+			WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+		renderer = SDL_CreateRenderer(
+			window,
+			-1,
+			SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+		// Allocate a texture that will be the actual image drawn to the screen.
+		texture = SDL_CreateTexture(
+			renderer,
+			SDL_PIXELFORMAT_ABGR8888,
+			SDL_TEXTUREACCESS_STREAMING,
+			surface->w, surface->h);
+
+		// the result is written straight into the locked texture,
+		// respecting the pitch SDL hands back (rows may be padded)
+		SDL_LockTexture(texture, NULL, (void**)(&pixelsTmp), &pitch);
+	}
+	else {
+		result = SDL_CreateRGBSurface(0, surface->w, surface->h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+		pixelsTmp = (unsigned char*)result->pixels;
+		pitch = result->pitch;
+	}
 
-	// put the pixels from the calulations of the convolve kernel in pixelstmp ready
-	// to render the image
-	for (int i = 0; i < imageSize; i++) {
-		pixelsTmp[i * 4 + 0] = (unsigned char)(floatPixelsOut[i * 4]);
-		pixelsTmp[i * 4 + 1] = (unsigned char)(floatPixelsOut[i * 4 + 1]);
-		pixelsTmp[i * 4 + 2] = (unsigned char)(floatPixelsOut[i * 4 + 2]);
+	if (runCPU) {
+		//CPU run and time
+		std::chrono::steady_clock::time_point CPUStart = std::chrono::steady_clock::now();
+		if (runGPU)
+			convolveImageCPU(floatPixels, cpuPixelsOut, 4 * surface->w, surface->w, surface->h);
+		else
+			convolveImageCPU(floatPixels, pixelsTmp, pitch, surface->w, surface->h);
+		std::chrono::steady_clock::time_point CPUEnd = std::chrono::steady_clock::now();
+		float CPUms = std::chrono::duration<float, std::milli>(CPUEnd - CPUStart).count();
+		addStageTime("cpu convolve", CPUms);
+		printf("CPU Convolution took %fms.\n\n", CPUms);
 	}
 
-	SDL_UnlockTexture(texture);
+	float GPUms = 0.0f;
+	if (runGPU) {
+		//GPU run and time
+		std::chrono::steady_clock::time_point GPUStart = std::chrono::steady_clock::now();
+		convolveImageCuda(floatPixels, pixelsTmp, pitch, surface->w, surface->h);
+		std::chrono::steady_clock::time_point GPUEnd = std::chrono::steady_clock::now();
+		GPUms = std::chrono::duration<float, std::milli>(GPUEnd - GPUStart).count();
+		printf("GPU Convolution took %fms.\n\n", GPUms);
+	}
 
-	// Draw the image.
-	SDL_RenderCopy(renderer, texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+	bool resultsMatch = true;
+	int maxError = -1; // stays -1 unless the CPU and GPU results are compared
+	if (runCPU && runGPU) {
+		StageTimer timer("compare");
+		//Compare Results, the GPU may contract multiply-adds differently so allow a small difference per channel
+		maxError = 0;
+		double squaredError = 0.0;
+		int matchingPixels = 0;
+		for (int y = 0; y < surface->h; y++) {
+			unsigned char* cpuRow = cpuPixelsOut + y * surface->w * 4;
+			unsigned char* gpuRow = pixelsTmp + y * pitch;
+			for (int x = 0; x < surface->w; x++) {
+				bool matches = true;
+				for (int c = 0; c < 3; c++) {
+					int error = abs((int)cpuRow[x * 4 + c] - (int)gpuRow[x * 4 + c]);
+					if (error > maxError)
+						maxError = error;
+					squaredError += (double)error * error;
+					if (error > options.tolerance)
+						matches = false;
+				}
+				if (matches)
+					matchingPixels++;
+			}
+		}
+
+		float similarity = 100.0f * matchingPixels / imageSize;
+		printf("CPU vs GPU Convolution Simularity %f Percent (tolerance %d)\n", similarity, options.tolerance);
+		double mse = squaredError / (3.0 * imageSize);
+		if (mse > 0.0)
+			printf("Max error %d, PSNR %.2fdB\n\n", maxError, 10.0 * log10(255.0 * 255.0 / mse));
+		else
+			printf("Max error 0, PSNR inf (identical)\n\n");
+		resultsMatch = (matchingPixels == imageSize);
+	}
 
+	int exitCode = resultsMatch ? 0 : 2;
+	if (runGPU && options.timingsPath != NULL && !appendTimings(options.timingsPath, options.inputPath, surface->w, surface->h, GPUms, maxError))
+		exitCode = 1;
+	if (options.view) {
+		SDL_UnlockTexture(texture);
 
-	// Main loop - runs continually until quit.
-	bool running = true;
-	while (running) {
-		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
+		// Draw the image.
+		{
+			StageTimer timer("render copy");
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+		}
+		{
+			StageTimer timer("present");
+			SDL_RenderPresent(renderer);
+		}
+		// everything after this is waiting on the user
+		if (options.stages)
+			printStageBreakdown();
+
+		// Main loop - waits for events until quit, so no CPU is used while the image is on screen.
+		bool running = true;
+		while (running) {
+			SDL_Event event;
+			if (SDL_WaitEvent(&event) == 0)
+				break;
 			if (event.type == SDL_QUIT) {
 				// User pressed the "X", Alt-4F, etc...
 				running = false;
 			}
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+				SDL_RenderCopy(renderer, texture, NULL, NULL);
+				SDL_RenderPresent(renderer);
+			}
+		}
+	}
+	else {
+		if (options.outputPath != NULL) {
+			StageTimer timer("save");
+			if (!saveImage(result, options.outputPath))
+				exitCode = 1;
 		}
+		if (options.stages)
+			printStageBreakdown();
 	}
 
-	// Main loop finished - quit.
+	// Finished - quit.
 	cudaDeviceSynchronize();
-	SDL_DestroyTexture(texture);
+	if (options.view) {
+		SDL_DestroyTexture(texture);
+		SDL_DestroyRenderer(renderer);
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+	}
+	else {
+		SDL_FreeSurface(result);
+	}
 	SDL_FreeSurface(surface);
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
-	SDL_Quit();
 
 	// Free Up Memory (D_pixels deallocated in convolveImageCuda)
 	cudaFreeHost(floatPixels);
-	cudaFreeHost(floatPixelsOut);
-	cudaFreeHost(floatPixelsStore);
+	if (cpuPixelsOut != NULL)
+		cudaFreeHost(cpuPixelsOut);
 	cudaFree(d_convMask);
 
 
-	return 0;
+	return exitCode;
 }
@@ -0,0 +1,387 @@
+#include "async.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_BLUR_COROUTINES
+#include "bench.h"
+#include "image.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for the async mode, filled in from the command line.
+////
+struct AsyncOptions {
+	const char* inputPath;
+	const char* outputDir; // NULL to not save the results
+	int requests; // started at once, all in flight together
+	int workers; // pool threads
+	BlurParams params;
+	bool verify;
+};
+
+////
+// What the async mode's requests saw, shared by all of them.
+////
+struct AsyncStats {
+	std::vector<double> latencies; // one slot per request, so the requests never write the same element
+	std::atomic<int> inFlight;
+	std::atomic<int> peakInFlight;
+	std::atomic<int> mismatches;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Start the pool threads.
+// Parameters:
+// threads: coroutines run at the same time, values below 1 are treated as 1.
+////
+BlurThreadPool::BlurThreadPool(int threads)
+	: stopping(false)
+{
+	if (threads < 1)
+		threads = 1;
+	for (int t = 0; t < threads; t++)
+		this->threads.push_back(std::thread(&BlurThreadPool::workLoop, this));
+}
+
+////
+// Run everything still queued and stop the threads. Coroutines still suspended elsewhere are not waited for,
+// wait for them (BlurRequestGroup::wait, syncWait) before the pool goes.
+////
+BlurThreadPool::~BlurThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	notEmpty.notify_all();
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+////
+// Queue a suspended coroutine to be resumed on one of the pool's threads, in the order they were posted.
+////
+void BlurThreadPool::post(std::coroutine_handle<> work)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(work);
+	}
+	notEmpty.notify_one();
+}
+
+// Body of every pool thread, runs until the pool is destroyed and the queue drained.
+void BlurThreadPool::workLoop()
+{
+	for (;;) {
+		std::coroutine_handle<> work;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [this] { return !queue.empty() || stopping; });
+			if (queue.empty())
+				return;
+			work = queue.front();
+			queue.pop_front();
+		}
+		work.resume();
+	}
+}
+
+////
+// Start a request, it runs on whichever thread it awaits on (normally the pool's). Returns straight away.
+////
+void BlurRequestGroup::spawn(BlurTask<bool> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running++;
+	}
+	run(this, std::move(task));
+}
+
+////
+// Wait for every request spawned so far to finish.
+// Returns how many of them failed (returned false).
+////
+int BlurRequestGroup::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return running == 0; });
+	return failures;
+}
+
+DetachedTask BlurRequestGroup::run(BlurRequestGroup* group, BlurTask<bool> task)
+{
+	bool succeeded = co_await task;
+	// notified under the lock, so wait() can't return (and the group go away) until we let go of it
+	std::lock_guard<std::mutex> lock(group->mutex);
+	if (!succeeded)
+		group->failures++;
+	if (--group->running == 0)
+		group->done.notify_all();
+}
+
+////
+// Load an image (see loadImage) on the pool.
+// Returns a 32 bit RGBA surface the caller frees, NULL (after printing why) if it can't be loaded.
+////
+BlurTask<SDL_Surface*> loadImageAsync(BlurThreadPool* pool, std::string path)
+{
+	co_await pool->schedule();
+	co_return loadImage(path.c_str());
+}
+
+////
+// Blur a 32 bit RGBA surface with a backend on the pool, the image is only read so any number of
+// requests may blur the same one at the same time.
+// Returns a new surface with the result that the caller frees, NULL (after printing why) if params are not valid
+// or there isn't enough memory.
+////
+BlurTask<SDL_Surface*> blurAsync(BlurThreadPool* pool, SDL_Surface* image, BlurParams params)
+{
+	co_await pool->schedule();
+	if (params.backend == NULL || params.maskSize < 1 || params.maskSize > MAX_MASK_SIZE || params.maskSize % 2 == 0 ||
+		!(params.stdv > 0.0f) || params.threads < 1) {
+		fprintf(stderr, "A blur needs a backend, an odd mask width up to %d, a positive sigma and at least 1 thread\n", MAX_MASK_SIZE);
+		co_return NULL;
+	}
+	ConvMask mask;
+	generateGuassianKernel(&mask, params.maskSize, params.stdv);
+	float* floatPixels = surfaceToFloatPixels(image);
+	SDL_Surface* result = floatPixels != NULL ? createResultSurface(image->w, image->h) : NULL;
+	if (result == NULL) {
+		if (floatPixels != NULL)
+			fprintf(stderr, "Not enough memory for the result of a %dx%d blur\n", image->w, image->h);
+		free(floatPixels);
+		co_return NULL;
+	}
+	params.backend->convolve(floatPixels, (unsigned char*)result->pixels, result->pitch, image->w, image->h, &mask, params.threads);
+	free(floatPixels);
+	co_return result;
+}
+
+////
+// Save a surface (see saveImage) on the pool, the surface stays the caller's.
+// Returns false (after printing why) if it couldn't be saved.
+////
+BlurTask<bool> saveImageAsync(BlurThreadPool* pool, SDL_Surface* surface, std::string path)
+{
+	co_await pool->schedule();
+	co_return saveImage(surface, path.c_str());
+}
+
+// One request of the async mode: blur, check against the expected result, save.
+static BlurTask<bool> processRequest(BlurThreadPool* pool, SDL_Surface* image, BlurParams params, const unsigned char* expected,
+	std::string outputPath, int index, AsyncStats* stats)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int inFlight = ++stats->inFlight;
+	int peak = stats->peakInFlight;
+	while (inFlight > peak && !stats->peakInFlight.compare_exchange_weak(peak, inFlight)) {
+	}
+
+	SDL_Surface* result = co_await blurAsync(pool, image, params);
+	bool succeeded = result != NULL;
+	if (succeeded && expected != NULL) {
+		for (int y = 0; y < result->h; y++) {
+			if (memcmp((unsigned char*)result->pixels + y * result->pitch, expected + (size_t)y * result->w * 4, result->w * 4) != 0) {
+				stats->mismatches++;
+				break;
+			}
+		}
+	}
+	// save on the pool thread the blur finished on: saveImageAsync would queue behind every pending blur and
+	// keep all the results alive until the last one is done
+	if (succeeded && !outputPath.empty())
+		succeeded = saveImage(result, outputPath.c_str());
+	if (result != NULL)
+		SDL_FreeSurface(result);
+
+	stats->latencies[index] = millisecondsSince(start);
+	stats->inFlight--;
+	co_return succeeded;
+}
+
+static void printAsyncUsage(const char* program)
+{
+	printf("Usage: %s --async --input <image> [options]\n", program);
+	printf("  --input <image>     image every request blurs\n");
+	printf("  --output-dir <dir>  save each result as async_<n>.ppm in this (existing) directory, without it nothing is saved\n");
+	printf("  --requests <n>      requests started at once and kept in flight together (default 200)\n");
+	printf("  --workers <n>       pool threads shared by all requests (default %d)\n", defaultThreadCount());
+	printf("  --mask <n>          mask width (default 5)\n");
+	printf("  --sigma <f>         strength of the blur (default 5)\n");
+	printf("  --backend <name>    backend (default cpu)\n");
+	printf("  --threads <n>       threads per request, for multithreaded backends (default 1)\n");
+	printf("  --no-verify         don't check every result against the reference blur\n");
+	printf("Exits with code 2 if a result doesn't match the reference blur.\n");
+}
+
+////
+// Read the async command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseAsyncOptions(int argc, char** argv, AsyncOptions* options)
+{
+	options->inputPath = NULL;
+	options->outputDir = NULL;
+	options->requests = 200;
+	options->workers = defaultThreadCount();
+	options->params.backend = &backends[0];
+	options->params.maskSize = 5;
+	options->params.stdv = 5.0f;
+	options->params.threads = 1;
+	options->verify = true;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (strcmp(arg, "--no-verify") == 0) {
+			options->verify = false;
+			continue;
+		}
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->inputPath = value;
+		else if (strcmp(arg, "--output-dir") == 0)
+			options->outputDir = value;
+		else if (strcmp(arg, "--requests") == 0)
+			options->requests = atoi(value);
+		else if (strcmp(arg, "--workers") == 0)
+			options->workers = atoi(value);
+		else if (strcmp(arg, "--mask") == 0)
+			options->params.maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->params.stdv = (float)atof(value);
+		else if (strcmp(arg, "--threads") == 0)
+			options->params.threads = atoi(value);
+		else if (strcmp(arg, "--backend") == 0) {
+			options->params.backend = findBackend(value);
+			if (options->params.backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->inputPath == NULL) {
+		fprintf(stderr, "An input image is required\n");
+		return false;
+	}
+	if (options->params.maskSize < 1 || options->params.maskSize > MAX_MASK_SIZE || options->params.maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd number between 1 and %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (!(options->params.stdv > 0.0f)) {
+		fprintf(stderr, "Sigma must be positive\n");
+		return false;
+	}
+	if (options->requests < 1 || options->workers < 1 || options->params.threads < 1) {
+		fprintf(stderr, "Requests, workers and threads must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Async mode entry point, argv[0] is "--async".
+// Starts every request at once through the coroutine API, so they are all in flight together on the
+// pool's threads, then reports the latency spread and checks the results against the reference blur.
+// Returns 0 on success, 2 if a result doesn't match, 1 on other failures.
+////
+int runAsync(int argc, char** argv)
+{
+	AsyncOptions options;
+	if (!parseAsyncOptions(argc, argv, &options)) {
+		printAsyncUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	BlurThreadPool pool(options.workers);
+	SDL_Surface* image = syncWait(loadImageAsync(&pool, options.inputPath));
+	if (image == NULL)
+		return 1;
+	std::vector<unsigned char> expected;
+	if (options.verify && options.params.backend->exact) {
+		ConvMask mask;
+		generateGuassianKernel(&mask, options.params.maskSize, options.params.stdv);
+		float* floatPixels = surfaceToFloatPixels(image);
+		if (floatPixels == NULL) {
+			SDL_FreeSurface(image);
+			return 1;
+		}
+		expected.resize((size_t)image->w * image->h * 4);
+		convolveImageCPU(floatPixels, &expected[0], image->w * 4, image->w, image->h, &mask);
+		free(floatPixels);
+	}
+
+	printf("%d requests on %d pool threads, %s backend, mask %dx%d sigma %g.\n", options.requests, pool.threadCount(),
+		options.params.backend->name, options.params.maskSize, options.params.maskSize, options.params.stdv);
+	AsyncStats stats;
+	stats.latencies.assign(options.requests, 0.0);
+	stats.inFlight = 0;
+	stats.peakInFlight = 0;
+	stats.mismatches = 0;
+	BlurRequestGroup group;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int r = 0; r < options.requests; r++) {
+		std::string outputPath;
+		if (options.outputDir != NULL) {
+			char name[32];
+			snprintf(name, sizeof(name), "/async_%03d.ppm", r);
+			outputPath = std::string(options.outputDir) + name;
+		}
+		group.spawn(processRequest(&pool, image, options.params, expected.empty() ? NULL : &expected[0], outputPath, r, &stats));
+	}
+	int failures = group.wait();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::sort(stats.latencies.begin(), stats.latencies.end());
+	printf("\n%d requests in %.2fs: %.1f requests/s, %.1f megapixels/s, up to %d in flight", options.requests, seconds,
+		options.requests / seconds, (double)options.requests * image->w * image->h / 1e6 / seconds, (int)stats.peakInFlight);
+	if (failures > 0)
+		printf(", %d failed", failures);
+	printf("\n");
+	printf("%-8s %9s %9s %9s %9s\n", "", "p50", "p95", "p99", "max");
+	printf("%-8s %7.2fms %7.2fms %7.2fms %7.2fms\n", "latency", percentile(stats.latencies, 0.5), percentile(stats.latencies, 0.95),
+		percentile(stats.latencies, 0.99), stats.latencies.back());
+	SDL_FreeSurface(image);
+
+	if (stats.mismatches > 0) {
+		printf("FAILED: %d results differ from the reference blur.\n", (int)stats.mismatches);
+		return 2;
+	}
+	if (!expected.empty())
+		printf("Every result matches the reference blur.\n");
+	return failures == 0 ? 0 : 1;
+}
+
+#else
+
+int runAsync(int argc, char** argv)
+{
+	fprintf(stderr, "--async needs a build with C++20 coroutines\n");
+	return 1;
+}
+
+#endif
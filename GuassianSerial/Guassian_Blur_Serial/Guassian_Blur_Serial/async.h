@@ -0,0 +1,188 @@
+#pragma once
+
+// The coroutine API needs C++20, everything else in the program builds without it.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define HAVE_BLUR_COROUTINES 1
+#endif
+
+#ifdef HAVE_BLUR_COROUTINES
+#include "blur.h"
+#include "SDL.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Fixed set of threads that runs suspended coroutines. A request only holds a thread while it is loading,
+// blurring or saving, so hundreds of requests can be in flight on a handful of threads.
+////
+class BlurThreadPool {
+public:
+	explicit BlurThreadPool(int threads);
+	~BlurThreadPool();
+
+	////
+	// co_await pool->schedule() moves the rest of the coroutine onto one of the pool's threads.
+	////
+	struct ScheduleAwaiter {
+		BlurThreadPool* pool;
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> waiting) { pool->post(waiting); }
+		void await_resume() const noexcept {}
+	};
+	ScheduleAwaiter schedule() { return ScheduleAwaiter{ this }; }
+
+	void post(std::coroutine_handle<> work);
+	int threadCount() const { return (int)threads.size(); }
+
+private:
+	void workLoop();
+
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	// not a BoundedQueue: pool threads post to it too, and blocking them on a full queue could deadlock
+	std::deque<std::coroutine_handle<> > queue;
+	std::vector<std::thread> threads;
+	bool stopping;
+};
+
+////
+// Result of an asynchronous operation, produced by a coroutine that only starts when it's awaited.
+// When it finishes, the awaiting coroutine resumes straight away on the same thread.
+////
+template <typename T>
+class BlurTask {
+public:
+	struct promise_type {
+		T value;
+		std::coroutine_handle<> continuation;
+
+		BlurTask get_return_object() { return BlurTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		struct FinalAwaiter {
+			bool await_ready() const noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> finished) noexcept
+			{
+				std::coroutine_handle<> continuation = finished.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() const noexcept {}
+		};
+		FinalAwaiter final_suspend() noexcept { return {}; }
+		void return_value(T result) { value = std::move(result); }
+		// errors are returned as values (NULL, false) like everywhere else, nothing here throws
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	BlurTask(BlurTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+	BlurTask(const BlurTask&) = delete;
+	BlurTask& operator=(const BlurTask&) = delete;
+	~BlurTask()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiting) noexcept
+	{
+		handle.promise().continuation = waiting;
+		return handle;
+	}
+	T await_resume() { return std::move(handle.promise().value); }
+
+private:
+	explicit BlurTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+////
+// Coroutine that starts straight away and frees itself when it's done, used to start tasks from code that
+// isn't a coroutine.
+////
+struct DetachedTask {
+	struct promise_type {
+		DetachedTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+////
+// Requests started from ordinary code, wait() blocks until all of them are done.
+////
+class BlurRequestGroup {
+public:
+	BlurRequestGroup() : running(0), failures(0) {}
+
+	void spawn(BlurTask<bool> task);
+	int wait();
+
+private:
+	static DetachedTask run(BlurRequestGroup* group, BlurTask<bool> task);
+
+	std::mutex mutex;
+	std::condition_variable done;
+	int running;
+	int failures;
+};
+
+////
+// How blurAsync blurs.
+////
+struct BlurParams {
+	const Backend* backend;
+	int maskSize;
+	float stdv;
+	int threads; // threads per request for multithreaded backends, 1 lets the pool do the parallelism
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Each runs on one of the pool's threads and resumes the awaiting coroutine there when it's done.
+// Arguments are taken by value so they live in the coroutine, not in the caller.
+
+BlurTask<SDL_Surface*> loadImageAsync(BlurThreadPool* pool, std::string path);
+BlurTask<SDL_Surface*> blurAsync(BlurThreadPool* pool, SDL_Surface* image, BlurParams params);
+BlurTask<bool> saveImageAsync(BlurThreadPool* pool, SDL_Surface* surface, std::string path);
+
+////
+// Block the calling thread (which must not be one of the pool's) until task is done, and return its result.
+////
+template <typename T>
+T syncWait(BlurTask<T> task)
+{
+	std::mutex mutex;
+	std::condition_variable done;
+	bool finished = false;
+	T result{};
+	struct Runner {
+		static DetachedTask run(BlurTask<T> task, T* result, std::mutex* mutex, std::condition_variable* done, bool* finished)
+		{
+			T value = co_await task;
+			std::lock_guard<std::mutex> lock(*mutex);
+			*result = std::move(value);
+			*finished = true;
+			done->notify_all();
+		}
+	};
+	Runner::run(std::move(task), &result, &mutex, &done, &finished);
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&finished] { return finished; });
+	return result;
+}
+
+#endif
+
+int runAsync(int argc, char** argv);
@@ -0,0 +1,233 @@
+#include "baseline.h"
+#include "json.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// File a named baseline is kept in, "<name>.baseline.json" in the working directory.
+// A name that already ends in .json is used as the path as is.
+////
+std::string baselinePath(const char* name)
+{
+	size_t length = strlen(name);
+	if (length >= 5 && strcmp(name + length - 5, ".json") == 0)
+		return name;
+	return std::string(name) + ".baseline.json";
+}
+
+////
+// Save results as a named baseline, the same JSON the benchmark writes with --json (it has every sample).
+////
+bool saveBaseline(const std::vector<BenchResult>& results, const char* name)
+{
+	return writeResultsJSON(results, NULL, baselinePath(name).c_str());
+}
+
+// Sigma a backend's cells are keyed by: 0 for exact backends, the sigma itself for approximate (or unknown) ones.
+static float cellSigma(const char* backend, float stdv)
+{
+	const Backend* found = findBackend(backend);
+	return (found != NULL && found->exact) ? 0.0f : stdv;
+}
+
+// Index of the cell for this combination, or -1.
+static int findCell(const std::vector<BaselineCell>& cells, const char* backend, int threads, int imageW, int imageH, int maskSize, float stdv)
+{
+	for (size_t i = 0; i < cells.size(); i++) {
+		const BaselineCell& cell = cells[i];
+		// baselines store sigma with %g, so compare to its 6 significant digits
+		if (cell.backend == backend && cell.threads == threads && cell.imageW == imageW && cell.imageH == imageH && cell.maskSize == maskSize
+			&& fabs(cell.stdv - stdv) <= 1e-5f * stdv)
+			return (int)i;
+	}
+	return -1;
+}
+
+// Add samples to the cell for a combination, creating it if needed.
+static void addToCell(std::vector<BaselineCell>* cells, const char* backend, int threads, int imageW, int imageH, int maskSize, float stdv, const std::vector<double>& samples)
+{
+	stdv = cellSigma(backend, stdv);
+	int index = findCell(*cells, backend, threads, imageW, imageH, maskSize, stdv);
+	if (index < 0) {
+		BaselineCell cell;
+		cell.backend = backend;
+		cell.threads = threads;
+		cell.imageW = imageW;
+		cell.imageH = imageH;
+		cell.maskSize = maskSize;
+		cell.stdv = stdv;
+		cells->push_back(cell);
+		index = (int)cells->size() - 1;
+	}
+	std::vector<double>& pooled = (*cells)[index].samples;
+	pooled.insert(pooled.end(), samples.begin(), samples.end());
+}
+
+////
+// Read a named baseline back into cells.
+// Returns false (after printing why) if it can't be read or has no results in it.
+////
+bool loadBaseline(const char* name, std::vector<BaselineCell>* cells)
+{
+	std::string path = baselinePath(name);
+	JsonValue document;
+	if (!readJSONFile(path.c_str(), &document))
+		return false;
+
+	const JsonValue* results = findMember(&document, "results");
+	if (results == NULL || results->type != JSON_ARRAY) {
+		fprintf(stderr, "%s has no benchmark results\n", path.c_str());
+		return false;
+	}
+	for (size_t i = 0; i < results->items.size(); i++) {
+		const JsonValue* result = &results->items[i];
+		const JsonValue* backend = findMember(result, "backend");
+		const JsonValue* samples = findMember(result, "samples_ms");
+		if (backend == NULL || backend->type != JSON_STRING || samples == NULL || samples->type != JSON_ARRAY)
+			continue;
+
+		std::vector<double> values;
+		for (size_t s = 0; s < samples->items.size(); s++) {
+			if (samples->items[s].type == JSON_NUMBER)
+				values.push_back(samples->items[s].number);
+		}
+		addToCell(cells, backend->text.c_str(), (int)memberNumber(result, "threads", 1),
+			(int)memberNumber(result, "width", 0), (int)memberNumber(result, "height", 0),
+			(int)memberNumber(result, "mask", 0), (float)memberNumber(result, "sigma", 0), values);
+	}
+	if (cells->empty()) {
+		fprintf(stderr, "%s has no benchmark results\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+////
+// Pool the samples of a benchmark run into cells.
+////
+std::vector<BaselineCell> collectCells(const std::vector<BenchResult>& results)
+{
+	std::vector<BaselineCell> cells;
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		addToCell(&cells, r.backend->name, r.threads, r.imageW, r.imageH, r.maskSize, r.stdv, r.samples);
+	}
+	return cells;
+}
+
+////
+// One sided Mann-Whitney U test: the p-value for "values in a tend to be larger than values in b".
+// Uses the normal approximation with tie and continuity correction, which is close enough to the exact
+// distribution from about 5 samples a side. Makes no assumption about the shape of the timing distribution.
+////
+double mannWhitneyGreater(const std::vector<double>& a, const std::vector<double>& b)
+{
+	if (a.empty() || b.empty())
+		return 1.0;
+
+	// rank both samples together, ties get the average of the ranks they span
+	std::vector<std::pair<double, int> > all;
+	for (size_t i = 0; i < a.size(); i++)
+		all.push_back(std::make_pair(a[i], 0));
+	for (size_t i = 0; i < b.size(); i++)
+		all.push_back(std::make_pair(b[i], 1));
+	std::sort(all.begin(), all.end());
+
+	double rankSumA = 0.0;
+	double tieTerm = 0.0; // sum of t^3 - t over every group of t tied values
+	size_t i = 0;
+	while (i < all.size()) {
+		size_t j = i;
+		while (j + 1 < all.size() && all[j + 1].first == all[i].first)
+			j++;
+		double rank = (i + j) / 2.0 + 1.0;
+		for (size_t k = i; k <= j; k++) {
+			if (all[k].second == 0)
+				rankSumA += rank;
+		}
+		double t = (double)(j - i + 1);
+		tieTerm += t * t * t - t;
+		i = j + 1;
+	}
+
+	double n1 = (double)a.size();
+	double n2 = (double)b.size();
+	double n = n1 + n2;
+	double u = rankSumA - n1 * (n1 + 1.0) / 2.0;
+	double mean = n1 * n2 / 2.0;
+	double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+	if (variance <= 0.0)
+		return 1.0; // every value is the same
+	double z = (u - mean - 0.5) / sqrt(variance);
+	return 0.5 * erfc(z / sqrt(2.0));
+}
+
+////
+// Compare a benchmark run against a named baseline and print a line per cell.
+// A cell regressed if its median got slower by more than threshold (0.1 = 10%) and the
+// Mann-Whitney test says the slowdown is significant at alpha.
+// Returns the number of regressed cells, or -1 if the baseline couldn't be loaded.
+////
+int compareWithBaseline(const std::vector<BenchResult>& results, const char* name, double threshold, double alpha)
+{
+	std::vector<BaselineCell> baseline;
+	if (!loadBaseline(name, &baseline))
+		return -1;
+	std::vector<BaselineCell> current = collectCells(results);
+
+	printf("\nCompared with baseline %s (threshold %.1f%%, alpha %g):\n", baselinePath(name).c_str(), threshold * 100.0, alpha);
+	printf("%-10s %7s %11s %5s %6s %12s %12s %8s %8s  %s\n", "backend", "threads", "resolution", "mask", "sigma", "base median", "median", "change", "p", "");
+
+	int regressions = 0;
+	for (size_t i = 0; i < current.size(); i++) {
+		const BaselineCell& cell = current[i];
+		char resolution[32];
+		sprintf(resolution, "%dx%d", cell.imageW, cell.imageH);
+		char sigma[32];
+		if (cell.stdv > 0.0f)
+			sprintf(sigma, "%g", cell.stdv);
+		else
+			strcpy(sigma, "any");
+
+		int index = findCell(baseline, cell.backend.c_str(), cell.threads, cell.imageW, cell.imageH, cell.maskSize, cell.stdv);
+		if (index < 0) {
+			printf("%-10s %7d %11s %5d %6s %12s\n", cell.backend.c_str(), cell.threads, resolution, cell.maskSize, sigma, "not in baseline");
+			continue;
+		}
+
+		std::vector<double> before = baseline[index].samples;
+		std::vector<double> after = cell.samples;
+		std::sort(before.begin(), before.end());
+		std::sort(after.begin(), after.end());
+		double beforeMedian = percentile(before, 0.5);
+		double afterMedian = percentile(after, 0.5);
+		double change = beforeMedian > 0.0 ? afterMedian / beforeMedian - 1.0 : 0.0;
+
+		const char* verdict = "";
+		double p;
+		if (change >= 0.0) {
+			p = mannWhitneyGreater(after, before);
+			if (change > threshold && p < alpha) {
+				verdict = "REGRESSION";
+				regressions++;
+			}
+		}
+		else {
+			p = mannWhitneyGreater(before, after);
+			if (-change > threshold && p < alpha)
+				verdict = "faster";
+		}
+		printf("%-10s %7d %11s %5d %6s %10.3fms %10.3fms %+7.1f%% %8.4f  %s\n", cell.backend.c_str(), cell.threads, resolution,
+			cell.maskSize, sigma, beforeMedian, afterMedian, change * 100.0, p, verdict);
+	}
+
+	if (regressions > 0)
+		printf("%d regression%s found.\n", regressions, regressions == 1 ? "" : "s");
+	else
+		printf("No regressions.\n");
+	return regressions;
+}
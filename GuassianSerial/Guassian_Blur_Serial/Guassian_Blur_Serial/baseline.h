@@ -0,0 +1,32 @@
+#pragma once
+
+#include "bench.h"
+
+#include <string>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Every timing sample of one (backend, threads, resolution, mask) combination.
+// The image content doesn't change the amount of work, so its samples are pooled. Neither does sigma for
+// exact backends, but approximate ones (pyramid) pick their algorithm from it, so for those it's part of
+// the combination too.
+////
+struct BaselineCell {
+	std::string backend;
+	int threads;
+	int imageW, imageH;
+	int maskSize;
+	float stdv; // 0 for exact backends, whose samples are pooled across sigmas
+	std::vector<double> samples;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+std::string baselinePath(const char* name);
+bool saveBaseline(const std::vector<BenchResult>& results, const char* name);
+bool loadBaseline(const char* name, std::vector<BaselineCell>* cells);
+std::vector<BaselineCell> collectCells(const std::vector<BenchResult>& results);
+double mannWhitneyGreater(const std::vector<double>& a, const std::vector<double>& b);
+int compareWithBaseline(const std::vector<BenchResult>& results, const char* name, double threshold, double alpha);
@@ -0,0 +1,434 @@
+#include "batch.h"
+#include "bench.h"
+#include "blur.h"
+#include "boundedqueue.h"
+#include "image.h"
+#include "writer.h"
+#include "SDL_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+#define STAGE_DECODE 0
+#define STAGE_BLUR 1
+#define STAGE_ENCODE 2
+#define STAGE_COUNT 3
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* stageNames[STAGE_COUNT] = { "decode", "blur", "encode" };
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a batch run, filled in from the command line.
+////
+struct BatchOptions {
+	const char* inputDir;
+	const char* outputDir; // NULL to blur without saving (throughput of decode and blur only)
+	const char* format; // extension of the output files without the dot, NULL to keep the input's
+	int maskSize;
+	float stdv;
+	const Backend* backend;
+	int threads; // threads per blur call, for multithreaded backends
+	int workers[STAGE_COUNT]; // threads of each stage
+	int queueDepth; // images each queue between two stages can hold (the writer's queue included)
+};
+
+////
+// One image on its way through the pipeline, owned by whichever stage holds it.
+////
+struct BatchItem {
+	std::string name; // file name within the input directory
+	int imageW, imageH;
+	float* pixels; // decoded input, freed by the blur stage
+};
+
+////
+// Where the time of one worker thread went.
+////
+struct WorkerStats {
+	int items;
+	double busyMs; // decoding, blurring or encoding
+	double starvedMs; // waiting for an image from the previous stage
+	double blockedMs; // waiting for room in the queue to the next stage
+	int failures;
+};
+
+////
+// Everything the stages share.
+////
+struct BatchPipeline {
+	const BatchOptions* options;
+	const ConvMask* mask;
+	std::vector<std::string> files;
+	std::atomic<size_t> nextFile; // decode workers take files in order from here
+	BoundedQueue<BatchItem>* decoded;
+	AsyncWriter* writer; // the encode stage, NULL without an output directory
+	std::atomic<int> activeDecoders; // the last decoder closes the decoded queue
+	std::atomic<long long> pixels; // pixels blurred, for the megapixel rate
+	std::vector<WorkerStats> stats[STAGE_COUNT];
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Whether a file name has an extension SDL_image is built to read here.
+static bool isImageFile(const char* name)
+{
+	const char* extension = strrchr(name, '.');
+	return extension != NULL && (SDL_strcasecmp(extension, ".jpg") == 0 || SDL_strcasecmp(extension, ".jpeg") == 0 ||
+		SDL_strcasecmp(extension, ".png") == 0 || SDL_strcasecmp(extension, ".bmp") == 0);
+}
+
+////
+// List the JPEG, PNG and BMP files in a directory (not its subdirectories), sorted by name.
+// Returns false (after printing why) if the directory can't be read.
+////
+bool listImageFiles(const char* directory, std::vector<std::string>* names)
+{
+#ifdef _WIN32
+	std::string pattern = std::string(directory) + "\\*";
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA(pattern.c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Could not read directory %s\n", directory);
+		return false;
+	}
+	do {
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isImageFile(found.cFileName))
+			names->push_back(found.cFileName);
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+#else
+	DIR* dir = opendir(directory);
+	if (dir == NULL) {
+		fprintf(stderr, "Could not read directory %s: %s\n", directory, strerror(errno));
+		return false;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		std::string path = std::string(directory) + "/" + entry->d_name;
+		struct stat info;
+		if (isImageFile(entry->d_name) && stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+			names->push_back(entry->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(names->begin(), names->end());
+	return true;
+}
+
+////
+// Create a directory if it doesn't exist yet (its parent has to).
+// Returns false (after printing why) if it can't be created.
+////
+bool makeDirectory(const char* path)
+{
+#ifdef _WIN32
+	if (_mkdir(path) == 0 || errno == EEXIST)
+		return true;
+#else
+	if (mkdir(path, 0755) == 0 || errno == EEXIST)
+		return true;
+#endif
+	fprintf(stderr, "Could not create directory %s: %s\n", path, strerror(errno));
+	return false;
+}
+
+// Output path of an input file name.
+static std::string outputPath(const BatchOptions* options, const std::string& name)
+{
+	std::string path = std::string(options->outputDir) + "/";
+	if (options->format == NULL)
+		return path + name;
+	size_t dot = name.find_last_of('.');
+	return path + name.substr(0, dot) + "." + options->format;
+}
+
+////
+// Decode stage: load the next file in the list and convert it to floats, until the list runs out.
+////
+static void decodeWorker(BatchPipeline* pipeline, WorkerStats* stats)
+{
+	for (;;) {
+		size_t index = pipeline->nextFile++;
+		if (index >= pipeline->files.size())
+			break;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		BatchItem item;
+		item.name = pipeline->files[index];
+		item.pixels = loadFloatImage((std::string(pipeline->options->inputDir) + "/" + item.name).c_str(), &item.imageW, &item.imageH);
+		stats->busyMs += millisecondsSince(start);
+		if (item.pixels == NULL) {
+			stats->failures++;
+			continue;
+		}
+		stats->items++;
+
+		start = std::chrono::steady_clock::now();
+		bool pushed = pipeline->decoded->push(item);
+		stats->blockedMs += millisecondsSince(start);
+		if (!pushed)
+			free(item.pixels);
+	}
+	if (--pipeline->activeDecoders == 0)
+		pipeline->decoded->close();
+}
+
+////
+// Blur stage: convolve decoded images straight into a surface and hand it to the writer.
+////
+static void blurWorker(BatchPipeline* pipeline, WorkerStats* stats)
+{
+	const BatchOptions* options = pipeline->options;
+	for (;;) {
+		BatchItem item;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool popped = pipeline->decoded->pop(&item);
+		stats->starvedMs += millisecondsSince(start);
+		if (!popped)
+			break;
+
+		start = std::chrono::steady_clock::now();
+		SDL_Surface* result = createResultSurface(item.imageW, item.imageH);
+		if (result == NULL) {
+			fprintf(stderr, "Could not create the result for %s: %s\n", item.name.c_str(), SDL_GetError());
+			free(item.pixels);
+			stats->busyMs += millisecondsSince(start);
+			stats->failures++;
+			continue;
+		}
+		options->backend->convolve(item.pixels, (unsigned char*)result->pixels, result->pitch,
+			item.imageW, item.imageH, pipeline->mask, options->threads);
+		free(item.pixels);
+		item.pixels = NULL;
+		pipeline->pixels += (long long)item.imageW * item.imageH;
+		stats->busyMs += millisecondsSince(start);
+		stats->items++;
+
+		if (pipeline->writer == NULL) {
+			SDL_FreeSurface(result);
+			continue;
+		}
+		start = std::chrono::steady_clock::now();
+		pipeline->writer->submit(result, outputPath(options, item.name));
+		stats->blockedMs += millisecondsSince(start);
+	}
+}
+
+static void printBatchUsage(const char* program)
+{
+	printf("Usage: %s --batch --input-dir <dir> [options]\n", program);
+	printf("  --input-dir <dir>   blur every .jpg, .jpeg, .png and .bmp file in this directory\n");
+	printf("  --output-dir <dir>  save the results here (created if missing), without it nothing is saved\n");
+	printf("  --format <ext>      output format: png, jpg, bmp, ppm or raw (default the input's)\n");
+	printf("  --mask <n>          mask width (default 5)\n");
+	printf("  --sigma <f>         strength of the blur (default 5)\n");
+	printf("  --backend <name>    backend for the blur stage (default threads)\n");
+	printf("  --threads <n>       threads per blur, for multithreaded backends (default 1)\n");
+	printf("  --decoders <n>      decode stage threads (default 2)\n");
+	printf("  --blurrers <n>      blur stage threads (default %d)\n", defaultThreadCount());
+	printf("  --encoders <n>      encode stage (background writer) threads (default 2)\n");
+	printf("  --queue <n>         images each queue between two stages holds (default 4)\n");
+}
+
+////
+// Read the batch command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseBatchOptions(int argc, char** argv, BatchOptions* options)
+{
+	options->inputDir = NULL;
+	options->outputDir = NULL;
+	options->format = NULL;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->backend = findBackend("threads");
+	options->threads = 1;
+	options->workers[STAGE_DECODE] = 2;
+	options->workers[STAGE_BLUR] = defaultThreadCount();
+	options->workers[STAGE_ENCODE] = 2;
+	options->queueDepth = 4;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input-dir") == 0)
+			options->inputDir = value;
+		else if (strcmp(arg, "--output-dir") == 0)
+			options->outputDir = value;
+		else if (strcmp(arg, "--format") == 0) {
+			if (strcmp(value, "png") != 0 && strcmp(value, "jpg") != 0 && strcmp(value, "bmp") != 0 &&
+				strcmp(value, "ppm") != 0 && strcmp(value, "raw") != 0) {
+				fprintf(stderr, "Unknown format %s\n", value);
+				return false;
+			}
+			options->format = value;
+		}
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--backend") == 0) {
+			options->backend = findBackend(value);
+			if (options->backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--decoders") == 0)
+			options->workers[STAGE_DECODE] = atoi(value);
+		else if (strcmp(arg, "--blurrers") == 0)
+			options->workers[STAGE_BLUR] = atoi(value);
+		else if (strcmp(arg, "--encoders") == 0)
+			options->workers[STAGE_ENCODE] = atoi(value);
+		else if (strcmp(arg, "--queue") == 0)
+			options->queueDepth = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->inputDir == NULL) {
+		fprintf(stderr, "An input directory is required\n");
+		return false;
+	}
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->threads < 1 || options->workers[STAGE_DECODE] < 1 || options->workers[STAGE_BLUR] < 1 ||
+		options->workers[STAGE_ENCODE] < 1 || options->queueDepth < 1) {
+		fprintf(stderr, "Threads, stage threads and queue depth must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Batch mode entry point, argv[0] is "--batch".
+// Blurs every image of a directory in one process: decode, blur and encode run as overlapping stages with
+// their own threads, connected by bounded queues (the encode stage is an AsyncWriter). Prints the throughput and how busy each stage was.
+// Returns 0 if every image was blurred (and saved), 1 otherwise.
+////
+int runBatch(int argc, char** argv)
+{
+	BatchOptions options;
+	if (!parseBatchOptions(argc, argv, &options)) {
+		printBatchUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	BatchPipeline pipeline;
+	pipeline.options = &options;
+	if (!listImageFiles(options.inputDir, &pipeline.files))
+		return 1;
+	if (pipeline.files.empty()) {
+		fprintf(stderr, "No images in %s\n", options.inputDir);
+		return 1;
+	}
+	if (options.outputDir != NULL && !makeDirectory(options.outputDir))
+		return 1;
+
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+	pipeline.mask = &mask;
+	// the decoders would otherwise race to initialize the loaders on their first image
+	IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+	BoundedQueue<BatchItem> decoded(options.queueDepth);
+	pipeline.decoded = &decoded;
+	pipeline.writer = NULL;
+	if (options.outputDir != NULL)
+		pipeline.writer = new AsyncWriter(options.workers[STAGE_ENCODE], options.queueDepth);
+	pipeline.nextFile = 0;
+	pipeline.pixels = 0;
+	pipeline.activeDecoders = options.workers[STAGE_DECODE];
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		WorkerStats empty = { 0, 0.0, 0.0, 0.0, 0 };
+		pipeline.stats[s].assign(s == STAGE_ENCODE ? 1 : options.workers[s], empty);
+	}
+
+	printf("Blurring %d images from %s, mask %dx%d sigma %g, %s backend, %d decoders, %d blurrers, %d encoders.\n",
+		(int)pipeline.files.size(), options.inputDir, mask.size, mask.size, mask.stdv, options.backend->name,
+		options.workers[STAGE_DECODE], options.workers[STAGE_BLUR], pipeline.writer != NULL ? options.workers[STAGE_ENCODE] : 0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int w = 0; w < options.workers[STAGE_DECODE]; w++)
+		threads.push_back(std::thread(decodeWorker, &pipeline, &pipeline.stats[STAGE_DECODE][w]));
+	for (int w = 0; w < options.workers[STAGE_BLUR]; w++)
+		threads.push_back(std::thread(blurWorker, &pipeline, &pipeline.stats[STAGE_BLUR][w]));
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	if (pipeline.writer != NULL) {
+		WriterStats written = pipeline.writer->finish();
+		WorkerStats& encode = pipeline.stats[STAGE_ENCODE][0];
+		encode.items = written.written;
+		encode.busyMs = written.busyMs;
+		encode.starvedMs = written.starvedMs;
+		encode.failures = written.failures;
+		delete pipeline.writer;
+	}
+	double wallMs = millisecondsSince(start);
+	IMG_Quit();
+
+	int failures = 0;
+	int done = 0;
+	printf("\n%-8s %7s %7s %12s %11s %8s %8s\n", "stage", "threads", "images", "busy", "utilization", "starved", "blocked");
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		if (s == STAGE_ENCODE && options.outputDir == NULL)
+			continue;
+		WorkerStats total = { 0, 0.0, 0.0, 0.0, 0 };
+		for (size_t w = 0; w < pipeline.stats[s].size(); w++) {
+			const WorkerStats& stats = pipeline.stats[s][w];
+			total.items += stats.items;
+			total.busyMs += stats.busyMs;
+			total.starvedMs += stats.starvedMs;
+			total.blockedMs += stats.blockedMs;
+			total.failures += stats.failures;
+		}
+		// shares of the time all threads of the stage had between them
+		double threadMs = wallMs * options.workers[s];
+		printf("%-8s %7d %7d %10.1fms %10.1f%% %7.1f%% %7.1f%%\n", stageNames[s], options.workers[s], total.items, total.busyMs,
+			100.0 * total.busyMs / threadMs, 100.0 * total.starvedMs / threadMs, 100.0 * total.blockedMs / threadMs);
+		failures += total.failures;
+		done = total.items; // images that made it through the last stage
+	}
+
+	double seconds = wallMs / 1000.0;
+	printf("\n%d of %d images in %.2fs: %.2f images/s, %.1f megapixels/s", done, (int)pipeline.files.size(), seconds,
+		done / seconds, pipeline.pixels / 1e6 / seconds);
+	if (failures > 0)
+		printf(", %d failed", failures);
+	printf("\n");
+	return (failures == 0 && done == (int)pipeline.files.size()) ? 0 : 1;
+}
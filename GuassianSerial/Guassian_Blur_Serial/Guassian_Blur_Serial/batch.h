@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+bool listImageFiles(const char* directory, std::vector<std::string>* names);
+bool makeDirectory(const char* path);
+int runBatch(int argc, char** argv);
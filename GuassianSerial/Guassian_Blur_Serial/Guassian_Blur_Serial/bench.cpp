@@ -0,0 +1,586 @@
+#include "bench.h"
+#include "baseline.h"
+#include "environment.h"
+#include "image.h"
+#include "json.h"
+#include "roofline.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Default sweep, the bundled images from smallest to largest and every mask width the programs are used with.
+static const char* DEFAULT_IMAGES = "240p.jpg,480p.jpg,720p.jpg,1080p.jpg,1440p.jpg,4k.jpg,8k.jpg";
+static const char* DEFAULT_MASKS = "3,5,7,9,11,13";
+static const char* DEFAULT_SIGMAS = "1,5,20";
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a benchmark run, filled in from the command line.
+////
+struct BenchOptions {
+	std::vector<std::string> images;
+	std::vector<int> masks;
+	std::vector<float> sigmas;
+	std::vector<const Backend*> backends;
+	int threads;
+	int warmupRuns; // untimed runs before the timed ones, to warm caches and page in the buffers
+	int timedRuns;
+	const char* csvPath; // NULL to not write a CSV file
+	const char* jsonPath; // NULL to not write a JSON file
+	bool collectCounters; // read hardware counters around every timed run
+	bool roofline; // measure the machine peaks and report where every result sits against them
+	const char* saveBaselineName; // NULL to not save the results as a baseline
+	const char* baselineName; // baseline to compare against, NULL for none
+	double threshold; // slowdown of the median (0.1 = 10%) that counts as a regression, if significant
+	double alpha; // significance level of the regression test
+	const char* tracePath; // write a Chrome trace of every timed run here, NULL to not trace
+	double maxDrift; // change of the CPU clock during a combination (0.05 = 5%) that gets a warning
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Split a comma separated list into its items.
+////
+std::vector<std::string> splitList(const char* list)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty())
+				items.push_back(item);
+			item.clear();
+			if (*c == '\0')
+				break;
+		}
+		else {
+			item += *c;
+		}
+	}
+	return items;
+}
+
+////
+// Parse a comma separated list of mask widths.
+// Returns false (after printing why) if one isn't an odd value from 1 to MAX_MASK_SIZE.
+////
+bool parseMaskList(const char* list, std::vector<int>* masks)
+{
+	std::vector<std::string> items = splitList(list);
+	for (size_t i = 0; i < items.size(); i++) {
+		int maskSize = atoi(items[i].c_str());
+		if (maskSize < 1 || maskSize > MAX_MASK_SIZE || maskSize % 2 == 0) {
+			fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+			return false;
+		}
+		masks->push_back(maskSize);
+	}
+	return true;
+}
+
+////
+// Parse a comma separated list of blur strengths.
+// Returns false (after printing why) if one isn't greater than 0.
+////
+bool parseSigmaList(const char* list, std::vector<float>* sigmas)
+{
+	std::vector<std::string> items = splitList(list);
+	for (size_t i = 0; i < items.size(); i++) {
+		float stdv = (float)atof(items[i].c_str());
+		if (stdv <= 0.0f) {
+			fprintf(stderr, "Sigma must be greater than 0\n");
+			return false;
+		}
+		sigmas->push_back(stdv);
+	}
+	return true;
+}
+
+////
+// Parse a comma separated list of backend names.
+// Returns false (after printing why) if one of them doesn't exist.
+////
+bool parseBackendList(const char* list, std::vector<const Backend*>* backendList)
+{
+	std::vector<std::string> items = splitList(list);
+	for (size_t i = 0; i < items.size(); i++) {
+		const Backend* backend = findBackend(items[i].c_str());
+		if (backend == NULL) {
+			fprintf(stderr, "Unknown backend %s\n", items[i].c_str());
+			return false;
+		}
+		backendList->push_back(backend);
+	}
+	return true;
+}
+
+static void printBenchUsage(const char* program)
+{
+	printf("Usage: %s --bench [options]\n", program);
+	printf("  --images <list>    comma separated images to blur (default %s)\n", DEFAULT_IMAGES);
+	printf("                     synth:<gradient|noise|edges|checker>:<240p..32k|WxH>[:<seed>] generates one instead\n");
+	printf("  --masks <list>     comma separated mask widths (default %s)\n", DEFAULT_MASKS);
+	printf("  --sigmas <list>    comma separated blur strengths (default %s)\n", DEFAULT_SIGMAS);
+	printf("  --backends <list>  comma separated backends (default all)\n");
+	printf("  --threads <n>      threads for multithreaded backends (default %d)\n", defaultThreadCount());
+	printf("  --warmup <n>       untimed runs before timing each combination (default 1)\n");
+	printf("  --repeat <n>       timed runs of each combination (default 5)\n");
+	printf("  --csv <file>       write the results as CSV\n");
+	printf("  --json <file>      write the results (including every sample) as JSON\n");
+	printf("  --no-counters      don't read hardware performance counters (Linux perf_event_open)\n");
+	printf("  --roofline         measure peak bandwidth and FLOP/s first, report memory or compute bound\n");
+	printf("  --save-baseline <name>  save the results as a named baseline (<name>.baseline.json)\n");
+	printf("  --baseline <name>  compare against a saved baseline, exit code 2 if anything regressed\n");
+	printf("  --threshold <pct>  median slowdown that counts as a regression (default 10)\n");
+	printf("  --alpha <p>        significance level of the Mann-Whitney regression test (default 0.05)\n");
+	printf("  --trace <file>     write a Chrome trace of every run and worker band\n");
+	printf("  --max-drift <pct>  warn when the CPU clock changes more than this during a combination (default 5)\n");
+}
+
+////
+// Read the benchmark command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseBenchOptions(int argc, char** argv, BenchOptions* options)
+{
+	const char* images = DEFAULT_IMAGES;
+	const char* masks = DEFAULT_MASKS;
+	const char* sigmas = DEFAULT_SIGMAS;
+	const char* backendList = NULL;
+	options->threads = defaultThreadCount();
+	options->warmupRuns = 1;
+	options->timedRuns = 5;
+	options->csvPath = NULL;
+	options->jsonPath = NULL;
+	options->collectCounters = true;
+	options->roofline = false;
+	options->saveBaselineName = NULL;
+	options->baselineName = NULL;
+	options->threshold = 0.10;
+	options->alpha = 0.05;
+	options->tracePath = NULL;
+	options->maxDrift = 0.05;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (strcmp(arg, "--no-counters") == 0) {
+			options->collectCounters = false;
+			continue;
+		}
+		if (strcmp(arg, "--roofline") == 0) {
+			options->roofline = true;
+			continue;
+		}
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--images") == 0)
+			images = value;
+		else if (strcmp(arg, "--masks") == 0)
+			masks = value;
+		else if (strcmp(arg, "--sigmas") == 0)
+			sigmas = value;
+		else if (strcmp(arg, "--backends") == 0)
+			backendList = value;
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0)
+			options->warmupRuns = atoi(value);
+		else if (strcmp(arg, "--repeat") == 0)
+			options->timedRuns = atoi(value);
+		else if (strcmp(arg, "--csv") == 0)
+			options->csvPath = value;
+		else if (strcmp(arg, "--json") == 0)
+			options->jsonPath = value;
+		else if (strcmp(arg, "--save-baseline") == 0)
+			options->saveBaselineName = value;
+		else if (strcmp(arg, "--baseline") == 0)
+			options->baselineName = value;
+		else if (strcmp(arg, "--threshold") == 0)
+			options->threshold = atof(value) / 100.0;
+		else if (strcmp(arg, "--alpha") == 0)
+			options->alpha = atof(value);
+		else if (strcmp(arg, "--trace") == 0)
+			options->tracePath = value;
+		else if (strcmp(arg, "--max-drift") == 0)
+			options->maxDrift = atof(value) / 100.0;
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->threads < 1 || options->warmupRuns < 0 || options->timedRuns < 1) {
+		fprintf(stderr, "Threads and repeat must be at least 1, warmup at least 0\n");
+		return false;
+	}
+	if (options->threshold < 0.0 || options->maxDrift < 0.0 || options->alpha <= 0.0 || options->alpha >= 1.0) {
+		fprintf(stderr, "Threshold and max-drift must be at least 0 and alpha between 0 and 1\n");
+		return false;
+	}
+
+	options->images = splitList(images);
+	if (!parseMaskList(masks, &options->masks) || !parseSigmaList(sigmas, &options->sigmas))
+		return false;
+	if (backendList == NULL) {
+		for (int i = 0; i < backendCount; i++)
+			options->backends.push_back(&backends[i]);
+	}
+	else if (!parseBackendList(backendList, &options->backends)) {
+		return false;
+	}
+
+	if (options->images.empty() || options->masks.empty() || options->sigmas.empty() || options->backends.empty()) {
+		fprintf(stderr, "Nothing to benchmark\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Value below which the given fraction of the (already sorted) samples fall, nearest rank method.
+////
+double percentile(const std::vector<double>& sorted, double fraction)
+{
+	if (sorted.empty())
+		return 0.0;
+	int rank = (int)ceil(fraction * sorted.size());
+	if (rank < 1)
+		rank = 1;
+	if (rank > (int)sorted.size())
+		rank = (int)sorted.size();
+	return sorted[rank - 1];
+}
+
+////
+// Wall clock time from start until now, in ms.
+////
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+////
+// Fill in the min/median/p95/mean of a result from its samples.
+////
+void summarizeSamples(BenchResult* result)
+{
+	std::vector<double> sorted = result->samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (size_t i = 0; i < sorted.size(); i++)
+		sum += sorted[i];
+
+	result->minMs = sorted.empty() ? 0.0 : sorted[0];
+	result->medianMs = percentile(sorted, 0.5);
+	result->p95Ms = percentile(sorted, 0.95);
+	result->meanMs = sorted.empty() ? 0.0 : sum / sorted.size();
+}
+
+////
+// Run a backend warmupRuns times untimed and then timedRuns times timed with steady_clock (wall time),
+// adding every timed run to result->samples. The CPU clock is sampled just before and after the timed runs.
+// Parameters:
+// result: the image size, backend and threads to use are read from here.
+// inPixels, outPixels: input floats and an 8-bit RGBA output with pitch imageW * 4.
+// perfCounters: counters to read around each timed run (started/stopped outside the timed part), NULL for none.
+////
+void timeBackend(BenchResult* result, float* inPixels, unsigned char* outPixels, const ConvMask* mask, int warmupRuns, int timedRuns, PerfCounters* perfCounters)
+{
+	int outPitch = result->imageW * 4;
+	for (int run = 0; run < warmupRuns; run++)
+		result->backend->convolve(inPixels, outPixels, outPitch, result->imageW, result->imageH, mask, result->threads);
+
+	clearCounterValues(&result->counters);
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		result->counters.valid[i] = (perfCounters != NULL);
+	result->mhzBefore = sampleCpuMHz();
+
+	for (int run = 0; run < timedRuns; run++) {
+		if (perfCounters != NULL)
+			startPerfCounters(perfCounters);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		result->backend->convolve(inPixels, outPixels, outPitch, result->imageW, result->imageH, mask, result->threads);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		if (traceEnabled)
+			addTraceEvent(result->backend->name, start, end, -1, -1);
+		if (perfCounters != NULL) {
+			CounterValues values;
+			stopPerfCounters(perfCounters, &values);
+			addCounterValues(&result->counters, &values);
+		}
+		result->samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	result->mhzAfter = sampleCpuMHz();
+	scaleCounterValues(&result->counters, 1.0 / timedRuns);
+	summarizeSamples(result);
+}
+
+////
+// Write one line per result, with a header line, after "# key: value" lines describing the machine.
+// peaks: machine peaks for the roof and bound columns, NULL leaves them empty.
+// Returns false (after printing why) if the file could not be written.
+////
+bool writeResultsCSV(const std::vector<BenchResult>& results, const MachinePeaks* peaks, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	Environment environment;
+	captureEnvironment(&environment);
+	writeEnvironmentCSV(file, &environment);
+	fprintf(file, "image,width,height,backend,threads,mask,sigma,runs,min_ms,median_ms,p95_ms,mean_ms,mhz_before,mhz_after");
+	for (int c = 0; c < COUNTER_COUNT; c++)
+		fprintf(file, ",%s", counterNames[c]);
+	fprintf(file, ",ipc,flop_per_byte,traffic,gflops,gbs,roof_gflops,bound\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(file, "%s,%d,%d,%s,%d,%d,%g,%d,%.4f,%.4f,%.4f,%.4f",
+			r.image.c_str(), r.imageW, r.imageH, r.backend->name, r.threads, r.maskSize, r.stdv,
+			(int)r.samples.size(), r.minMs, r.medianMs, r.p95Ms, r.meanMs);
+		if (r.mhzBefore > 0.0 && r.mhzAfter > 0.0)
+			fprintf(file, ",%.0f,%.0f", r.mhzBefore, r.mhzAfter);
+		else
+			fprintf(file, ",,");
+		// counters are per run, left empty when they weren't available
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			if (r.counters.valid[c])
+				fprintf(file, ",%.0f", r.counters.values[c]);
+			else
+				fprintf(file, ",");
+		}
+		if (instructionsPerCycle(&r.counters) > 0.0)
+			fprintf(file, ",%.3f", instructionsPerCycle(&r.counters));
+		else
+			fprintf(file, ",");
+		// approximate backends don't do the work blurFlops counts, so they have no place on the roofline
+		RooflinePoint point = rooflinePoint(&r, peaks);
+		if (!r.backend->exact)
+			fprintf(file, ",,,,,,\n");
+		else if (peaks == NULL)
+			fprintf(file, ",%.3f,%s,%.3f,%.3f,,\n", point.intensity, point.measuredTraffic ? "measured" : "minimum", point.achievedGflops, point.achievedGBs);
+		else
+			fprintf(file, ",%.3f,%s,%.3f,%.3f,%.3f,%s\n", point.intensity, point.measuredTraffic ? "measured" : "minimum", point.achievedGflops,
+				point.achievedGBs, point.attainableGflops, point.memoryBound ? "memory" : "compute");
+	}
+	fclose(file);
+	printf("Wrote %s.\n", path);
+	return true;
+}
+
+////
+// Write the results (including the raw samples) as a JSON document, with the machine they ran on.
+// peaks: machine peaks for the roofline fields, NULL writes them as null.
+// Returns false (after printing why) if the file could not be written.
+////
+bool writeResultsJSON(const std::vector<BenchResult>& results, const MachinePeaks* peaks, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	fprintf(file, "{\n  \"machine\": ");
+	if (peaks != NULL)
+		fprintf(file, "{\"threads\": %d, \"bandwidth_gbs\": %.3f, \"gflops\": %.3f},\n", peaks->threads, peaks->bandwidthGBs, peaks->gflops);
+	else
+		fprintf(file, "null,\n");
+	Environment environment;
+	captureEnvironment(&environment);
+	fprintf(file, "  \"environment\": ");
+	writeEnvironmentJSON(file, &environment);
+	fprintf(file, ",\n  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(file, "    {\"image\": ");
+		writeJSONString(file, r.image.c_str());
+		fprintf(file, ", \"width\": %d, \"height\": %d, \"backend\": ", r.imageW, r.imageH);
+		writeJSONString(file, r.backend->name);
+		fprintf(file, ", \"threads\": %d, \"mask\": %d, \"sigma\": %g", r.threads, r.maskSize, r.stdv);
+		fprintf(file, ", \"min_ms\": %.4f, \"median_ms\": %.4f, \"p95_ms\": %.4f, \"mean_ms\": %.4f", r.minMs, r.medianMs, r.p95Ms, r.meanMs);
+		if (r.mhzBefore > 0.0 && r.mhzAfter > 0.0)
+			fprintf(file, ", \"mhz_before\": %.0f, \"mhz_after\": %.0f", r.mhzBefore, r.mhzAfter);
+		else
+			fprintf(file, ", \"mhz_before\": null, \"mhz_after\": null");
+		fprintf(file, ", \"counters\": {");
+		for (int c = 0; c < COUNTER_COUNT; c++) {
+			fprintf(file, "%s\"%s\": ", c == 0 ? "" : ", ", counterNames[c]);
+			if (r.counters.valid[c])
+				fprintf(file, "%.0f", r.counters.values[c]);
+			else
+				fprintf(file, "null");
+		}
+		if (instructionsPerCycle(&r.counters) > 0.0)
+			fprintf(file, ", \"ipc\": %.3f}", instructionsPerCycle(&r.counters));
+		else
+			fprintf(file, ", \"ipc\": null}");
+		RooflinePoint point = rooflinePoint(&r, peaks);
+		if (!r.backend->exact)
+			fprintf(file, ", \"roofline\": null");
+		else {
+			fprintf(file, ", \"roofline\": {\"flop_per_byte\": %.3f, \"traffic\": \"%s\", \"gflops\": %.3f, \"gbs\": %.3f", point.intensity,
+				point.measuredTraffic ? "measured" : "minimum", point.achievedGflops, point.achievedGBs);
+			if (peaks != NULL)
+				fprintf(file, ", \"roof_gflops\": %.3f, \"bound\": \"%s\"}", point.attainableGflops, point.memoryBound ? "memory" : "compute");
+			else
+				fprintf(file, ", \"roof_gflops\": null, \"bound\": null}");
+		}
+		fprintf(file, ", \"samples_ms\": [");
+		for (size_t s = 0; s < r.samples.size(); s++)
+			fprintf(file, "%s%.4f", s == 0 ? "" : ", ", r.samples[s]);
+		fprintf(file, "]}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	printf("Wrote %s.\n", path);
+	return true;
+}
+
+////
+// Relative change of the CPU clock between the start and the end of a result's timed runs, 0 if unknown.
+////
+static double clockDrift(const BenchResult* result)
+{
+	if (result->mhzBefore <= 0.0 || result->mhzAfter <= 0.0)
+		return 0.0;
+	return fabs(result->mhzAfter - result->mhzBefore) / result->mhzBefore;
+}
+
+////
+// Benchmark mode entry point, argv[0] is "--bench".
+// Sweeps every image, mask width, sigma and backend given, timing each combination.
+// Returns 0 on success, 2 if a baseline was given and a cell regressed against it, 1 for any other failure.
+////
+int runBenchmark(int argc, char** argv)
+{
+	BenchOptions options;
+	if (!parseBenchOptions(argc, argv, &options)) {
+		printBenchUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	Environment environment;
+	captureEnvironment(&environment);
+	printEnvironment(&environment);
+
+	PerfCounters perfCounters;
+	PerfCounters* counters = NULL;
+	if (options.collectCounters) {
+		if (openPerfCounters(&perfCounters))
+			counters = &perfCounters;
+		else
+			printf("Hardware counters are not available (not Linux, no permission or not supported), timing only.\n");
+	}
+
+	// measured before anything else runs, so the probes have the machine to themselves
+	MachinePeaks machinePeaks;
+	MachinePeaks* peaks = NULL;
+	if (options.roofline) {
+		printf("Measuring machine peaks on %d threads...\n", options.threads);
+		machinePeaks = measureMachinePeaks(options.threads);
+		if (machinePeaks.bandwidthGBs > 0.0 && machinePeaks.gflops > 0.0)
+			peaks = &machinePeaks;
+	}
+
+	if (options.tracePath != NULL)
+		startTracing(options.tracePath);
+
+	std::vector<BenchResult> results;
+	int drifted = 0;
+	for (size_t i = 0; i < options.images.size(); i++) {
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.images[i].c_str(), &imageW, &imageH);
+		if (floatPixels == NULL)
+			continue;
+		unsigned char* outPixels = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		if (outPixels == NULL) {
+			fprintf(stderr, "Not enough memory to blur %s, skipping it\n", options.images[i].c_str());
+			free(floatPixels);
+			continue;
+		}
+
+		for (size_t m = 0; m < options.masks.size(); m++) {
+			for (size_t s = 0; s < options.sigmas.size(); s++) {
+				ConvMask mask;
+				generateGuassianKernel(&mask, options.masks[m], options.sigmas[s]);
+
+				for (size_t b = 0; b < options.backends.size(); b++) {
+					BenchResult result;
+					result.image = options.images[i];
+					result.imageW = imageW;
+					result.imageH = imageH;
+					result.backend = options.backends[b];
+					result.threads = result.backend->multithreaded ? options.threads : 1;
+					result.maskSize = mask.size;
+					result.stdv = mask.stdv;
+					timeBackend(&result, floatPixels, outPixels, &mask, options.warmupRuns, options.timedRuns, counters);
+
+					printf("%s %dx%d mask %dx%d sigma %g: %s (%d threads) min %fms, median %fms, p95 %fms",
+						result.image.c_str(), imageW, imageH, mask.size, mask.size, mask.stdv,
+						result.backend->name, result.threads, result.minMs, result.medianMs, result.p95Ms);
+					if (instructionsPerCycle(&result.counters) > 0.0)
+						printf(", IPC %.2f", instructionsPerCycle(&result.counters));
+					if (peaks != NULL && result.backend->exact) {
+						RooflinePoint point = rooflinePoint(&result, peaks);
+						printf(", %.2f GFLOP/s, %.2f GB/s", point.achievedGflops, point.achievedGBs);
+					}
+					printf("\n");
+					double drift = clockDrift(&result);
+					if (drift > options.maxDrift) {
+						printf("Warning: CPU clock changed %.1f%% during the timed runs (%.0f MHz before, %.0f MHz after), turbo or throttling?\n",
+							100.0 * drift, result.mhzBefore, result.mhzAfter);
+						drifted++;
+					}
+					results.push_back(result);
+				}
+			}
+		}
+
+		free(outPixels);
+		free(floatPixels);
+	}
+
+	if (counters != NULL)
+		closePerfCounters(counters);
+	if (drifted > 0)
+		printf("Warning: the CPU clock drifted more than %g%% in %d of %d combinations, compare those with care.\n",
+			100.0 * options.maxDrift, drifted, (int)results.size());
+
+	if (peaks != NULL && !results.empty())
+		printRooflineReport(results, peaks);
+
+	bool written = finishTracing();
+	if (options.csvPath != NULL)
+		written = writeResultsCSV(results, peaks, options.csvPath) && written;
+	if (options.jsonPath != NULL)
+		written = writeResultsJSON(results, peaks, options.jsonPath) && written;
+	if (options.saveBaselineName != NULL && !results.empty())
+		written = saveBaseline(results, options.saveBaselineName) && written;
+	if (!written || results.empty())
+		return 1;
+
+	if (options.baselineName != NULL) {
+		int regressions = compareWithBaseline(results, options.baselineName, options.threshold, options.alpha);
+		if (regressions < 0)
+			return 1;
+		if (regressions > 0)
+			return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "blur.h"
+#include "perfcounters.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+struct MachinePeaks;
+
+////
+// Timing of one (image, mask, sigma, backend) combination of the benchmark sweep.
+////
+struct BenchResult {
+	std::string image; // name of the image that was blurred
+	int imageW, imageH;
+	const Backend* backend;
+	int threads; // threads the backend actually used (1 for serial backends)
+	int maskSize;
+	float stdv;
+	std::vector<double> samples; // wall clock time of every timed run in ms, in the order they ran
+	double minMs;
+	double medianMs;
+	double p95Ms;
+	double meanMs;
+	double mhzBefore, mhzAfter; // average CPU clock just before and just after the timed runs, 0 if unknown
+	CounterValues counters; // hardware counters per timed run (averaged), where available
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+int runBenchmark(int argc, char** argv);
+std::vector<std::string> splitList(const char* list);
+bool parseMaskList(const char* list, std::vector<int>* masks);
+bool parseSigmaList(const char* list, std::vector<float>* sigmas);
+bool parseBackendList(const char* list, std::vector<const Backend*>* backendList);
+void timeBackend(BenchResult* result, float* inPixels, unsigned char* outPixels, const ConvMask* mask, int warmupRuns, int timedRuns, PerfCounters* perfCounters);
+void summarizeSamples(BenchResult* result);
+double percentile(const std::vector<double>& sorted, double fraction);
+double millisecondsSince(std::chrono::steady_clock::time_point start);
+bool writeResultsCSV(const std::vector<BenchResult>& results, const MachinePeaks* peaks, const char* path);
+bool writeResultsJSON(const std::vector<BenchResult>& results, const MachinePeaks* peaks, const char* path);
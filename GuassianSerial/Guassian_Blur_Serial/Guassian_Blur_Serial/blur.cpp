@@ -0,0 +1,397 @@
+#define _USE_MATH_DEFINES
+#include "blur.h"
+#include "pyramid.h"
+#include "trace.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+
+/// Generate the guassian convolution kernel
+// CPU runnable
+// based on: https://www.codewithc.com/gaussian-filter-generation-in-c/
+// Modified to be adaptable, the code is messy but the timing of CUDA vs SERIAL will not be affected by this;
+// Parameters:
+// mask: mask to fill in.
+// Width: Dimensional width (and height) of the kernel, odd and no more than MAX_MASK_SIZE
+// stdv: strength of the blur
+////
+void generateGuassianKernel(ConvMask* mask, int width, float stdv) {
+	double r, s = 2.0 * stdv * stdv;
+	double sum = 0.0;   // Initialization of sun for normalization
+
+	mask->size = width;
+	mask->offset = (width - 1) / 2;
+	mask->stdv = stdv;
+
+	// Loop to generate kSize x kSize kernel
+	for (int x = ((width - 1) / 2) * -1; x <= ((width - 1) / 2); x++) {
+		for (int y = ((width - 1) / 2) * -1; y <= ((width - 1) / 2); y++) {
+			r = sqrt(x * x + y * y);
+			mask->values[x + ((width - 1) / 2)][y + ((width - 1) / 2)] = (exp(-(r * r) / s)) / (M_PI * s); // generate using the guassian function
+			sum += mask->values[x + ((width - 1) / 2)][y + ((width - 1) / 2)];// used gor normalizing the kernel (See below...)
+		}
+	}
+	for (int i = 0; i < width; ++i) // Loop to normalize the kernel so the image doesnt get dimmer
+		for (int j = 0; j < width; ++j)
+			mask->values[i][j] /= sum;
+}
+
+
+////
+// Calculate the index of an element index by x,y in a one dimensional
+// flattened array (row major), where y is the major axis.
+// if an index is calculated to be out of range of the array, set the index to
+// minimum or maximum depending on if the index is below or above the range.
+// Parameters:
+// x: x coordinate of whole pixel (not accounting for RGBA values).
+// y: Y coordinate of whole pixel (not accounting for RGBA values).
+// imageW, imageH: width & height of the image.
+////
+int get1dIndex(int width, int height, int x, int y)
+{
+	//check x and y boundaries
+	if (x < 0)
+		x = 0;
+	if (x >= width)
+		x = width - 1;
+	if (y < 0)
+		y = 0;
+	if (y >= height)
+		y = height - 1;
+
+	// check index boundaries
+	int i = y * width * 4 + x * 4;
+	if (i < 0)
+		i = 0;
+	if (i > width * height * 4)
+		i = ((width * height * 4) - 1);
+	return i;
+}
+
+////
+// CPU version of the convolution code.
+// Applies the convolution kernel to each pixel (including RGBA values)
+// The 8-bit RGBA result is written straight into the destination, so a locked
+// texture (or any other pitched buffer) can be passed in without a staging copy.
+// Parameters:
+// inPixels: array of floats containing the original image pixels.
+// outPixels: 8-bit RGBA destination where the modified image should be written.
+// outPitch: length of one destination row in bytes (can be more than imageW * 4).
+// imageW, imageH: width & height of the image.
+// mask: convolution mask to apply.
+////
+void convolveImageCPU(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask)
+{
+	int maskSize = mask->size;
+	int offset = mask->offset;
+
+	for (int imageX = 0; imageX < imageW; imageX++) {
+		for (int imageY = 0; imageY < imageH; imageY++) {
+			if (imageX < imageW && imageY < imageH) {
+				int i = imageX;
+				int j = imageY;
+
+				//give the position of the output pixel in the (pitched) destination
+				unsigned char* outPixel = outPixels + j * outPitch + i * 4;
+
+				//declare the sum of each pixel colour value, the sum of the pixels around multiplied by the convolution kernels related value
+				float rsum = 0.0f;
+				float gsum = 0.0f;
+				float bsum = 0.0f;
+
+				//loop over guassianKernel
+				// x = x of convulutionKernel (Matrix Axis)
+				// y = y of convolutionKernel (Matrix Axis)
+				for (int x = 0; x < maskSize; x++) {
+					for (int y = 0; y < maskSize; y++) {
+
+						// Get the pixel value for the corresponding kernel value and multiply it buy the convulutionKernel value that relates to it
+						rsum += (mask->values[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 0];
+						gsum += (mask->values[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 1];
+						bsum += (mask->values[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 2];
+
+					}
+				}
+				//pixels that are now newly calculated now guassian smoothing has been applied
+				outPixel[0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+				outPixel[1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+				outPixel[2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+				outPixel[3] = 255;
+			}
+		}
+	}
+}
+
+////
+// Convolve part of one row.
+// Same maths (and summation order) as convolveImageCPU so the results are identical.
+// Parameters:
+// j: the row to produce.
+// firstColumn, lastColumn: the pixels of the row to produce, lastColumn is exclusive.
+// (the rest as convolveImageCPU)
+////
+static void convolveSpanCPU(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int j, int firstColumn, int lastColumn)
+{
+	int maskSize = mask->size;
+	int offset = mask->offset;
+	unsigned char* outRow = outPixels + j * outPitch;
+
+	for (int i = firstColumn; i < lastColumn; i++) {
+		float rsum = 0.0f;
+		float gsum = 0.0f;
+		float bsum = 0.0f;
+
+		for (int x = 0; x < maskSize; x++) {
+			for (int y = 0; y < maskSize; y++) {
+				int index = get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset));
+				rsum += (mask->values[x][y]) * inPixels[index + 0];
+				gsum += (mask->values[x][y]) * inPixels[index + 1];
+				bsum += (mask->values[x][y]) * inPixels[index + 2];
+			}
+		}
+		outRow[i * 4 + 0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+		outRow[i * 4 + 1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+		outRow[i * 4 + 2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+		outRow[i * 4 + 3] = 255;
+	}
+}
+
+////
+// Convolve a band of whole rows, walking the image row by row so each worker
+// streams through its own part of the input and output.
+// Parameters:
+// firstRow, lastRow: the band to produce, lastRow is exclusive.
+// cancel: checked before every row, the band is left unfinished once it's set. NULL if it can't be cancelled.
+// (the rest as convolveImageCPU)
+////
+static void convolveRowsCPU(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int firstRow, int lastRow, const std::atomic<bool>* cancel)
+{
+	TraceScope trace("band", firstRow, lastRow);
+	for (int j = firstRow; j < lastRow; j++) {
+		if (cancel != NULL && *cancel)
+			return;
+		convolveSpanCPU(inPixels, outPixels, outPitch, imageW, imageH, mask, j, 0, imageW);
+	}
+}
+
+////
+// Multithreaded CPU version of the convolution code.
+// Splits the image into one band of rows per thread, the calling thread works on the last band.
+// Parameters:
+// threads: number of threads to use, values below 1 are treated as 1.
+// (the rest as convolveImageCPU)
+////
+void convolveImageCPUThreaded(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads)
+{
+	convolveImageCPUCancellable(inPixels, outPixels, outPitch, imageW, imageH, mask, threads, NULL);
+}
+
+////
+// convolveImageCPUThreaded that can be stopped part way through by another thread, e.g. when the
+// result is no longer wanted because the settings changed. Every thread checks before each row, so
+// it stops within the time of one row.
+// Parameters:
+// cancel: set (by any thread) to stop, NULL if the blur can't be cancelled.
+// (the rest as convolveImageCPUThreaded)
+// Returns false if it was cancelled, in which case the output is only partly written.
+////
+bool convolveImageCPUCancellable(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads, const std::atomic<bool>* cancel)
+{
+	if (threads < 1)
+		threads = 1;
+	if (threads > imageH)
+		threads = imageH;
+
+	std::vector<std::thread> workers;
+	int rowsPerThread = imageH / threads;
+	int extraRows = imageH % threads; // the first extraRows bands get one more row each
+	int firstRow = 0;
+	for (int t = 0; t < threads; t++) {
+		int lastRow = firstRow + rowsPerThread + (t < extraRows ? 1 : 0);
+		if (t == threads - 1)
+			convolveRowsCPU(inPixels, outPixels, outPitch, imageW, imageH, mask, firstRow, lastRow, cancel);
+		else
+			workers.push_back(std::thread(convolveRowsCPU, inPixels, outPixels, outPitch, imageW, imageH, mask, firstRow, lastRow, cancel));
+		firstRow = lastRow;
+	}
+	TraceScope trace("join");
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	return cancel == NULL || !*cancel;
+}
+
+////
+// Re-blur only the output pixels that changed input pixels can reach, leaving the rest of the
+// previous output as it is. Each dirty rectangle is grown by mask->offset (clipped to the image) and
+// the grown rectangles are merged row by row, so overlapping ones cost nothing extra and the work is
+// proportional to the changed area. The result is identical to blurring the whole image again.
+// Parameters:
+// inPixels: the whole input, already updated.
+// outPixels: the previous output (same pitch and size), updated in place.
+// dirty, dirtyCount: the input rectangles that changed, they may overlap or reach outside the image.
+// (the rest as convolveImageCPU)
+// Returns the number of output pixels that were convolved.
+////
+long long reblurDirtyRects(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, const BlurRect* dirty, int dirtyCount)
+{
+	// grown and clipped, as [x0, x1) x [y0, y1)
+	std::vector<BlurRect> grown;
+	int firstRow = imageH;
+	int lastRow = 0;
+	for (int r = 0; r < dirtyCount; r++) {
+		BlurRect rect;
+		rect.x = std::max(dirty[r].x - mask->offset, 0);
+		rect.y = std::max(dirty[r].y - mask->offset, 0);
+		int x1 = std::min(dirty[r].x + dirty[r].w + mask->offset, imageW);
+		int y1 = std::min(dirty[r].y + dirty[r].h + mask->offset, imageH);
+		if (dirty[r].w <= 0 || dirty[r].h <= 0 || rect.x >= x1 || rect.y >= y1)
+			continue;
+		rect.w = x1 - rect.x;
+		rect.h = y1 - rect.y;
+		grown.push_back(rect);
+		firstRow = std::min(firstRow, rect.y);
+		lastRow = std::max(lastRow, y1);
+	}
+
+	long long convolved = 0;
+	std::vector<std::pair<int, int> > spans;
+	for (int j = firstRow; j < lastRow; j++) {
+		spans.clear();
+		for (size_t r = 0; r < grown.size(); r++) {
+			if (j >= grown[r].y && j < grown[r].y + grown[r].h)
+				spans.push_back(std::make_pair(grown[r].x, grown[r].x + grown[r].w));
+		}
+		std::sort(spans.begin(), spans.end());
+		size_t s = 0;
+		while (s < spans.size()) {
+			int first = spans[s].first;
+			int last = spans[s].second;
+			for (s++; s < spans.size() && spans[s].first <= last; s++)
+				last = std::max(last, spans[s].second);
+			convolveSpanCPU(inPixels, outPixels, outPitch, imageW, imageH, mask, j, first, last);
+			convolved += last - first;
+		}
+	}
+	return convolved;
+}
+
+////
+// Blur only the given regions of an 8-bit RGBA image, in place. Pixels outside the regions are
+// neither read past the mask's reach nor written, so nothing is copied for them and the cost is
+// proportional to the area of the regions. Each region's pixels (grown by mask->offset) are taken
+// as floats before any region is written, so overlapping regions see the original image and every
+// blurred pixel is identical to the same pixel of a whole-image blur.
+// Parameters:
+// pixels: 8-bit RGBA image, blurred where the regions say and left alone elsewhere.
+// pitch: length of one row in bytes (can be more than imageW * 4).
+// regions, regionCount: the regions to blur, they may overlap or reach outside the image.
+// (the rest as convolveImageCPU)
+// Returns the number of pixels that were blurred.
+////
+long long blurRegionsInPlace(unsigned char* pixels, int pitch, int imageW, int imageH, const ConvMask* mask, const BlurRegion* regions, int regionCount)
+{
+	int maskSize = mask->size;
+	int offset = mask->offset;
+
+	// the input each region reads: its rectangle grown by offset, clipped to the image
+	std::vector<BlurRect> tiles(regionCount);
+	std::vector<std::vector<float> > tilePixels(regionCount);
+	for (int r = 0; r < regionCount; r++) {
+		const BlurRect& rect = regions[r].rect;
+		BlurRect& tile = tiles[r];
+		tile.x = std::max(rect.x - offset, 0);
+		tile.y = std::max(rect.y - offset, 0);
+		tile.w = std::min(rect.x + rect.w + offset, imageW) - tile.x;
+		tile.h = std::min(rect.y + rect.h + offset, imageH) - tile.y;
+		if (rect.w <= 0 || rect.h <= 0 || tile.w <= 0 || tile.h <= 0)
+			continue;
+		tilePixels[r].resize((size_t)tile.w * tile.h * 4);
+		for (int y = 0; y < tile.h; y++) {
+			const unsigned char* row = pixels + (tile.y + y) * pitch + tile.x * 4;
+			float* tileRow = &tilePixels[r][(size_t)y * tile.w * 4];
+			for (int x = 0; x < tile.w * 4; x++)
+				tileRow[x] = (float)row[x];
+		}
+	}
+
+	long long blurred = 0;
+	for (int r = 0; r < regionCount; r++) {
+		if (tilePixels[r].empty())
+			continue;
+		const BlurRegion& region = regions[r];
+		const BlurRect& tile = tiles[r];
+		const float* tileIn = &tilePixels[r][0];
+		int firstX = std::max(region.rect.x, 0);
+		int lastX = std::min(region.rect.x + region.rect.w, imageW);
+		int firstY = std::max(region.rect.y, 0);
+		int lastY = std::min(region.rect.y + region.rect.h, imageH);
+		for (int j = firstY; j < lastY; j++) {
+			unsigned char* outRow = pixels + j * pitch;
+			for (int i = firstX; i < lastX; i++) {
+				if (region.coverage != NULL && region.coverage[(j - region.rect.y) * region.rect.w + (i - region.rect.x)] == 0)
+					continue;
+				float rsum = 0.0f;
+				float gsum = 0.0f;
+				float bsum = 0.0f;
+				for (int x = 0; x < maskSize; x++) {
+					// clamped to the image edge, which the tile reaches wherever the mask leaves it
+					int column = std::min(std::max(x + (i - offset), 0), imageW - 1) - tile.x;
+					for (int y = 0; y < maskSize; y++) {
+						int row = std::min(std::max(y + (j - offset), 0), imageH - 1) - tile.y;
+						const float* pixel = tileIn + ((size_t)row * tile.w + column) * 4;
+						rsum += (mask->values[x][y]) * pixel[0];
+						gsum += (mask->values[x][y]) * pixel[1];
+						bsum += (mask->values[x][y]) * pixel[2];
+					}
+				}
+				outRow[i * 4 + 0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+				outRow[i * 4 + 1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+				outRow[i * 4 + 2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+				outRow[i * 4 + 3] = 255;
+				blurred++;
+			}
+		}
+	}
+	return blurred;
+}
+
+// Adapts convolveImageCPU to the backend signature.
+static void convolveNaive(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int /*threads*/)
+{
+	convolveImageCPU(inPixels, outPixels, outPitch, imageW, imageH, mask);
+}
+
+const Backend backends[] = {
+	{ "cpu", "original serial convolution (reference)", convolveNaive, false, true },
+	{ "threads", "row bands split across threads", convolveImageCPUThreaded, true, true },
+	{ "pyramid", "blur at reduced resolution when the error bound allows (approximate)", convolvePyramidAuto, true, false },
+};
+const int backendCount = sizeof(backends) / sizeof(backends[0]);
+
+////
+// Look up a backend by name.
+// Returns NULL if there is no backend with that name.
+////
+const Backend* findBackend(const char* name)
+{
+	for (int i = 0; i < backendCount; i++) {
+		if (strcmp(backends[i].name, name) == 0)
+			return &backends[i];
+	}
+	return NULL;
+}
+
+////
+// Number of threads to use when none is given, one per hardware thread.
+////
+int defaultThreadCount()
+{
+	int threads = (int)std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Largest mask width that fits in a ConvMask, must be an odd value
+#define MAX_MASK_SIZE 31
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Guassian convolution mask plus the values derived from it.
+// Passed to the backends explicitly so several blurs with different settings can run at once.
+////
+struct ConvMask {
+	int size; // width of the blur in pixels, must be an odd value (3, 5, 7, 9, 11, 13 ... MAX_MASK_SIZE)
+	int offset; // how many x or y coordinates the convolution kernel will take you away from the central origin
+	float stdv; // strength of the blur (1.0, 3.0, 5.0, 10.0, 20.0)?
+	float values[MAX_MASK_SIZE][MAX_MASK_SIZE]; // only the first size x size entries are used
+};
+
+////
+// Signature shared by every convolution backend.
+// Parameters:
+// inPixels: array of floats containing the original image pixels (RGBA, row major).
+// outPixels: 8-bit RGBA destination where the modified image should be written.
+// outPitch: length of one destination row in bytes (can be more than imageW * 4).
+// imageW, imageH: width & height of the image.
+// mask: convolution mask to apply.
+// threads: how many threads the backend may use (ignored by serial backends).
+////
+typedef void (*ConvolveFunction)(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads);
+
+////
+// A named convolution backend that can be picked on the command line.
+////
+struct Backend {
+	const char* name;
+	const char* description;
+	ConvolveFunction convolve;
+	bool multithreaded; // false if the backend ignores the threads argument
+	bool exact; // false for approximations, which --validate and --golden only check when asked to
+};
+
+////
+// A rectangle of pixels, x and y being its top left corner.
+////
+struct BlurRect {
+	int x, y;
+	int w, h;
+};
+
+////
+// A region to blur, e.g. a face or a number plate to redact.
+////
+struct BlurRegion {
+	BlurRect rect;
+	const unsigned char* coverage; // rect.w * rect.h bytes, only pixels with a non zero value are blurred, NULL for all of them
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void generateGuassianKernel(ConvMask* mask, int width, float stdv);
+int get1dIndex(int width, int height, int x, int y);
+void convolveImageCPU(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask);
+long long reblurDirtyRects(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, const BlurRect* dirty, int dirtyCount);
+long long blurRegionsInPlace(unsigned char* pixels, int pitch, int imageW, int imageH, const ConvMask* mask, const BlurRegion* regions, int regionCount);
+void convolveImageCPUThreaded(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads);
+bool convolveImageCPUCancellable(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads, const std::atomic<bool>* cancel);
+
+// All backends available in this build, the first one is the reference.
+extern const Backend backends[];
+extern const int backendCount;
+const Backend* findBackend(const char* name);
+int defaultThreadCount();
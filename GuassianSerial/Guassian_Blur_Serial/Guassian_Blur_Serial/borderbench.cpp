@@ -0,0 +1,522 @@
+#include "borderbench.h"
+#include "bench.h"
+#include "blur.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Where an output pixel is relative to the part of the image the mask can reach without leaving it.
+#define REGION_INTERIOR 0
+#define REGION_ROWS 1 // top and bottom bands, the mask leaves the image vertically
+#define REGION_COLUMNS 2 // left and right bands, the mask leaves the image horizontally
+#define REGION_CORNERS 3 // both
+#define REGION_COUNT 4
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGES = "synth:noise:240p,synth:noise:720p";
+static const char* DEFAULT_MASKS = "3,7,13";
+static const char* regionNames[REGION_COUNT] = { "interior", "rows", "columns", "corners" };
+// Each region pass is repeated until it takes at least this long, so the tiny corners can be timed.
+static const double MIN_MEASURE_MS = 2.0;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Output pixels x0 <= x < x1, y0 <= y < y1.
+////
+struct Rect {
+	int x0, y0, x1, y1;
+};
+
+////
+// The input in every layout the strategies need, built once per image and mask.
+////
+struct BorderInput {
+	float* pixels; // the image as given (RGBA floats)
+	int imageW, imageH;
+	int offset; // mask offset the tables and halo were built for
+	int* xTable; // byte offset of clamped column k - offset, for k in 0 .. imageW + 2 * offset
+	int* yTable; // byte offset of clamped row k - offset, for k in 0 .. imageH + 2 * offset
+	float* padded; // the image with offset edge pixels replicated on every side
+	int paddedW;
+};
+
+////
+// Convolve the output pixels of one rectangle, reading pixels outside the image some way.
+////
+typedef void (*BorderKernel)(const BorderInput* input, const ConvMask* mask, const Rect* rect, unsigned char* outPixels, int outPitch);
+
+////
+// A way of handling the image border.
+////
+struct BorderStrategy {
+	const char* name;
+	const char* description;
+	BorderKernel convolve;
+};
+
+////
+// Settings for a border benchmark run, filled in from the command line.
+////
+struct BorderOptions {
+	std::vector<std::string> images;
+	std::vector<int> masks;
+	float stdv;
+	int repeat;
+	const char* csvPath;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Write the 8-bit result of one pixel.
+static inline void storePixel(unsigned char* outPixel, float rsum, float gsum, float bsum)
+{
+	outPixel[0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+	outPixel[1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+	outPixel[2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+	outPixel[3] = 255;
+}
+
+////
+// Today's approach: get1dIndex clamps every tap with a chain of branches.
+////
+static void convolveClamp(const BorderInput* input, const ConvMask* mask, const Rect* rect, unsigned char* outPixels, int outPitch)
+{
+	int offset = mask->offset;
+	for (int j = rect->y0; j < rect->y1; j++) {
+		for (int i = rect->x0; i < rect->x1; i++) {
+			float rsum = 0.0f;
+			float gsum = 0.0f;
+			float bsum = 0.0f;
+			for (int x = 0; x < mask->size; x++) {
+				for (int y = 0; y < mask->size; y++) {
+					int index = get1dIndex(input->imageW, input->imageH, x + (i - offset), y + (j - offset));
+					rsum += mask->values[x][y] * input->pixels[index + 0];
+					gsum += mask->values[x][y] * input->pixels[index + 1];
+					bsum += mask->values[x][y] * input->pixels[index + 2];
+				}
+			}
+			storePixel(outPixels + j * outPitch + i * 4, rsum, gsum, bsum);
+		}
+	}
+}
+
+////
+// Clamp each coordinate with std::min/std::max, which compilers turn into conditional moves instead of branches.
+////
+static void convolveMinMax(const BorderInput* input, const ConvMask* mask, const Rect* rect, unsigned char* outPixels, int outPitch)
+{
+	int offset = mask->offset;
+	int maxX = input->imageW - 1;
+	int maxY = input->imageH - 1;
+	for (int j = rect->y0; j < rect->y1; j++) {
+		for (int i = rect->x0; i < rect->x1; i++) {
+			float rsum = 0.0f;
+			float gsum = 0.0f;
+			float bsum = 0.0f;
+			for (int x = 0; x < mask->size; x++) {
+				int column = std::min(std::max(x + (i - offset), 0), maxX);
+				for (int y = 0; y < mask->size; y++) {
+					int row = std::min(std::max(y + (j - offset), 0), maxY);
+					int index = (row * input->imageW + column) * 4;
+					rsum += mask->values[x][y] * input->pixels[index + 0];
+					gsum += mask->values[x][y] * input->pixels[index + 1];
+					bsum += mask->values[x][y] * input->pixels[index + 2];
+				}
+			}
+			storePixel(outPixels + j * outPitch + i * 4, rsum, gsum, bsum);
+		}
+	}
+}
+
+////
+// Look the clamped row and column offsets up in tables built once per image and mask.
+////
+static void convolveTable(const BorderInput* input, const ConvMask* mask, const Rect* rect, unsigned char* outPixels, int outPitch)
+{
+	for (int j = rect->y0; j < rect->y1; j++) {
+		for (int i = rect->x0; i < rect->x1; i++) {
+			float rsum = 0.0f;
+			float gsum = 0.0f;
+			float bsum = 0.0f;
+			for (int x = 0; x < mask->size; x++) {
+				int column = input->xTable[i + x];
+				for (int y = 0; y < mask->size; y++) {
+					int index = input->yTable[j + y] + column;
+					rsum += mask->values[x][y] * input->pixels[index + 0];
+					gsum += mask->values[x][y] * input->pixels[index + 1];
+					bsum += mask->values[x][y] * input->pixels[index + 2];
+				}
+			}
+			storePixel(outPixels + j * outPitch + i * 4, rsum, gsum, bsum);
+		}
+	}
+}
+
+////
+// Read from a copy of the image with the edge pixels replicated around it, so no tap needs any check.
+////
+static void convolveHalo(const BorderInput* input, const ConvMask* mask, const Rect* rect, unsigned char* outPixels, int outPitch)
+{
+	int rowLength = input->paddedW * 4;
+	for (int j = rect->y0; j < rect->y1; j++) {
+		for (int i = rect->x0; i < rect->x1; i++) {
+			float rsum = 0.0f;
+			float gsum = 0.0f;
+			float bsum = 0.0f;
+			// padded pixel (i, j) is image pixel (i - offset, j - offset), the top left of the mask
+			const float* corner = input->padded + (size_t)j * rowLength + i * 4;
+			for (int x = 0; x < mask->size; x++) {
+				for (int y = 0; y < mask->size; y++) {
+					const float* pixel = corner + y * rowLength + x * 4;
+					rsum += mask->values[x][y] * pixel[0];
+					gsum += mask->values[x][y] * pixel[1];
+					bsum += mask->values[x][y] * pixel[2];
+				}
+			}
+			storePixel(outPixels + j * outPitch + i * 4, rsum, gsum, bsum);
+		}
+	}
+}
+
+static const BorderStrategy strategies[] = {
+	{ "clamp", "branchy get1dIndex clamp (what the backends use)", convolveClamp },
+	{ "minmax", "branchless std::min/std::max clamp", convolveMinMax },
+	{ "table", "precomputed row and column offset tables", convolveTable },
+	{ "halo", "halo-padded copy of the input, no checks", convolveHalo },
+};
+static const int strategyCount = sizeof(strategies) / sizeof(strategies[0]);
+
+////
+// Build the index tables and the halo-padded copy of the input for a mask offset.
+// Parameters:
+// setupMs: time taken to build the tables and the padded copy, in ms.
+// Returns false (with nothing left to free) if there isn't enough memory.
+////
+static bool prepareBorderInput(BorderInput* input, float* pixels, int imageW, int imageH, int offset, double setupMs[2])
+{
+	input->pixels = pixels;
+	input->imageW = imageW;
+	input->imageH = imageH;
+	input->offset = offset;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	input->xTable = (int*)malloc(sizeof(int) * (imageW + 2 * offset));
+	input->yTable = (int*)malloc(sizeof(int) * (imageH + 2 * offset));
+	input->padded = NULL;
+	if (input->xTable == NULL || input->yTable == NULL) {
+		free(input->xTable);
+		free(input->yTable);
+		return false;
+	}
+	for (int k = 0; k < imageW + 2 * offset; k++)
+		input->xTable[k] = std::min(std::max(k - offset, 0), imageW - 1) * 4;
+	for (int k = 0; k < imageH + 2 * offset; k++)
+		input->yTable[k] = std::min(std::max(k - offset, 0), imageH - 1) * imageW * 4;
+	std::chrono::steady_clock::time_point tablesDone = std::chrono::steady_clock::now();
+
+	input->paddedW = imageW + 2 * offset;
+	int paddedH = imageH + 2 * offset;
+	input->padded = (float*)malloc(sizeof(float) * 4 * input->paddedW * paddedH);
+	if (input->padded == NULL) {
+		free(input->xTable);
+		free(input->yTable);
+		return false;
+	}
+	for (int y = 0; y < paddedH; y++) {
+		const float* sourceRow = pixels + (size_t)std::min(std::max(y - offset, 0), imageH - 1) * imageW * 4;
+		float* row = input->padded + (size_t)y * input->paddedW * 4;
+		for (int x = 0; x < offset; x++)
+			memcpy(row + x * 4, sourceRow, sizeof(float) * 4);
+		memcpy(row + offset * 4, sourceRow, sizeof(float) * 4 * imageW);
+		for (int x = offset + imageW; x < input->paddedW; x++)
+			memcpy(row + x * 4, sourceRow + (imageW - 1) * 4, sizeof(float) * 4);
+	}
+	std::chrono::steady_clock::time_point paddingDone = std::chrono::steady_clock::now();
+
+	setupMs[0] = std::chrono::duration<double, std::milli>(tablesDone - start).count();
+	setupMs[1] = std::chrono::duration<double, std::milli>(paddingDone - tablesDone).count();
+	return true;
+}
+
+static void freeBorderInput(BorderInput* input)
+{
+	free(input->xTable);
+	free(input->yTable);
+	free(input->padded);
+}
+
+////
+// Split the image into the rectangles of every region. With masks wider than the image the interior
+// (and the middle of the bands) are empty, every pixel still belongs to exactly one region.
+////
+static void splitRegions(int imageW, int imageH, int offset, std::vector<Rect> regions[REGION_COUNT])
+{
+	// left, middle and right columns, top, middle and bottom rows
+	int xs[4] = { 0, std::min(offset, imageW), std::max(imageW - offset, std::min(offset, imageW)), imageW };
+	int ys[4] = { 0, std::min(offset, imageH), std::max(imageH - offset, std::min(offset, imageH)), imageH };
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 3; column++) {
+			Rect rect = { xs[column], ys[row], xs[column + 1], ys[row + 1] };
+			if (rect.x0 == rect.x1 || rect.y0 == rect.y1)
+				continue;
+			bool edgeRow = (row != 1);
+			bool edgeColumn = (column != 1);
+			int region = edgeRow ? (edgeColumn ? REGION_CORNERS : REGION_ROWS) : (edgeColumn ? REGION_COLUMNS : REGION_INTERIOR);
+			regions[region].push_back(rect);
+		}
+	}
+}
+
+static long long regionPixels(const std::vector<Rect>& rects)
+{
+	long long pixels = 0;
+	for (size_t i = 0; i < rects.size(); i++)
+		pixels += (long long)(rects[i].x1 - rects[i].x0) * (rects[i].y1 - rects[i].y0);
+	return pixels;
+}
+
+// Run a strategy over every rectangle of a region passes times.
+static double timeRegion(const BorderStrategy* strategy, const BorderInput* input, const ConvMask* mask,
+	const std::vector<Rect>& rects, unsigned char* outPixels, int passes)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < rects.size(); i++)
+			strategy->convolve(input, mask, &rects[i], outPixels, input->imageW * 4);
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+////
+// Median time per output pixel of a strategy on one region, in ns.
+// The pass count is doubled until one measurement takes MIN_MEASURE_MS, then repeat measurements are taken.
+////
+static double measureRegion(const BorderStrategy* strategy, const BorderInput* input, const ConvMask* mask,
+	const std::vector<Rect>& rects, unsigned char* outPixels, int repeat)
+{
+	long long pixels = regionPixels(rects);
+	if (pixels == 0)
+		return 0.0;
+
+	int passes = 1;
+	while (timeRegion(strategy, input, mask, rects, outPixels, passes) < MIN_MEASURE_MS && passes < (1 << 20))
+		passes *= 2;
+
+	std::vector<double> samples;
+	for (int r = 0; r < repeat; r++)
+		samples.push_back(timeRegion(strategy, input, mask, rects, outPixels, passes) * 1e6 / ((double)pixels * passes));
+	std::sort(samples.begin(), samples.end());
+	return percentile(samples, 0.5);
+}
+
+static void printBorderUsage(const char* program)
+{
+	printf("Usage: %s --border [options]\n", program);
+	printf("  --images <list>  comma separated images (default %s)\n", DEFAULT_IMAGES);
+	printf("  --masks <list>   comma separated mask widths (default %s)\n", DEFAULT_MASKS);
+	printf("  --sigma <f>      strength of the blur (default 5)\n");
+	printf("  --repeat <n>     measurements per strategy and region, the median is reported (default 5)\n");
+	printf("  --csv <file>     write every measurement as CSV\n");
+	printf("Strategies (single threaded, all produce the same output as get1dIndex):\n");
+	for (int i = 0; i < strategyCount; i++)
+		printf("  %-8s %s\n", strategies[i].name, strategies[i].description);
+	printf("Exits with code 2 if a strategy's output differs from clamp.\n");
+}
+
+////
+// Read the border benchmark command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseBorderOptions(int argc, char** argv, BorderOptions* options)
+{
+	const char* images = DEFAULT_IMAGES;
+	const char* masks = DEFAULT_MASKS;
+	options->stdv = 5.0f;
+	options->repeat = 5;
+	options->csvPath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--images") == 0)
+			images = value;
+		else if (strcmp(arg, "--masks") == 0)
+			masks = value;
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--repeat") == 0)
+			options->repeat = atoi(value);
+		else if (strcmp(arg, "--csv") == 0)
+			options->csvPath = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->repeat < 1) {
+		fprintf(stderr, "Repeat must be at least 1\n");
+		return false;
+	}
+	options->images = splitList(images);
+	if (!parseMaskList(masks, &options->masks))
+		return false;
+	if (options->images.empty() || options->masks.empty()) {
+		fprintf(stderr, "Nothing to do\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Border benchmark mode entry point, argv[0] is "--border".
+// Times each border handling strategy separately on the interior, the top and bottom rows, the left and
+// right columns and the corners of every image and mask, so the cost of the edge logic can be seen on its own.
+// Returns 0 on success, 2 if a strategy's output differs from clamp, 1 on other failures.
+////
+int runBorderBenchmark(int argc, char** argv)
+{
+	BorderOptions options;
+	if (!parseBorderOptions(argc, argv, &options)) {
+		printBorderUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	FILE* csv = NULL;
+	if (options.csvPath != NULL) {
+		csv = fopen(options.csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Could not write %s\n", options.csvPath);
+			return 1;
+		}
+		fprintf(csv, "image,width,height,mask,region,pixels,strategy,ns_per_pixel,setup_ms\n");
+	}
+
+	int mismatches = 0;
+	int skipped = 0; // image and mask combinations there wasn't enough memory to measure
+	for (size_t i = 0; i < options.images.size(); i++) {
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.images[i].c_str(), &imageW, &imageH);
+		if (floatPixels == NULL) {
+			if (csv != NULL)
+				fclose(csv);
+			return 1;
+		}
+		unsigned char* reference = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		unsigned char* outPixels = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		if (reference == NULL || outPixels == NULL) {
+			fprintf(stderr, "Not enough memory to blur %s, skipping it\n", options.images[i].c_str());
+			free(outPixels);
+			free(reference);
+			free(floatPixels);
+			skipped++;
+			continue;
+		}
+
+		for (size_t m = 0; m < options.masks.size(); m++) {
+			ConvMask mask;
+			generateGuassianKernel(&mask, options.masks[m], options.stdv);
+			BorderInput input;
+			double setupMs[2];
+			if (!prepareBorderInput(&input, floatPixels, imageW, imageH, mask.offset, setupMs)) {
+				fprintf(stderr, "Not enough memory to pad %s for mask %dx%d, skipping it\n", options.images[i].c_str(), mask.size, mask.size);
+				skipped++;
+				continue;
+			}
+			double strategySetupMs[4] = { 0.0, 0.0, setupMs[0], setupMs[1] };
+			std::vector<Rect> regions[REGION_COUNT];
+			splitRegions(imageW, imageH, mask.offset, regions);
+			long long borderPixels = regionPixels(regions[REGION_ROWS]) + regionPixels(regions[REGION_COLUMNS]) + regionPixels(regions[REGION_CORNERS]);
+
+			// every strategy has to produce exactly what get1dIndex does before its timing means anything
+			Rect whole = { 0, 0, imageW, imageH };
+			convolveClamp(&input, &mask, &whole, reference, imageW * 4);
+			bool differs[4] = { false, false, false, false };
+			for (int s = 1; s < strategyCount; s++) {
+				memset(outPixels, 0, (size_t)4 * imageW * imageH);
+				strategies[s].convolve(&input, &mask, &whole, outPixels, imageW * 4);
+				if (memcmp(outPixels, reference, (size_t)4 * imageW * imageH) != 0) {
+					printf("MISMATCH: %s output differs from clamp, it can't be the fastest.\n", strategies[s].name);
+					differs[s] = true;
+					mismatches++;
+				}
+			}
+
+			printf("\n%s (%dx%d) mask %dx%d, %.1f%% of pixels within %d of the border\n", options.images[i].c_str(), imageW, imageH,
+				mask.size, mask.size, 100.0 * borderPixels / ((double)imageW * imageH), mask.offset);
+			printf("%-10s %9s", "ns/pixel", "pixels");
+			for (int s = 0; s < strategyCount; s++)
+				printf(" %9s", strategies[s].name);
+			printf("  %s\n", "fastest");
+
+			double totalMs[4] = { 0.0, 0.0, 0.0, 0.0 };
+			for (int r = 0; r < REGION_COUNT; r++) {
+				long long pixels = regionPixels(regions[r]);
+				printf("%-10s %9lld", regionNames[r], pixels);
+				if (pixels == 0) {
+					printf("\n");
+					continue;
+				}
+				int fastest = 0;
+				double nsPerPixel[4];
+				for (int s = 0; s < strategyCount; s++) {
+					nsPerPixel[s] = measureRegion(&strategies[s], &input, &mask, regions[r], outPixels, options.repeat);
+					totalMs[s] += nsPerPixel[s] * pixels / 1e6;
+					if (!differs[s] && nsPerPixel[s] < nsPerPixel[fastest])
+						fastest = s;
+					printf(" %9.2f", nsPerPixel[s]);
+					if (csv != NULL)
+						fprintf(csv, "%s,%d,%d,%d,%s,%lld,%s,%.4f,%.4f\n", options.images[i].c_str(), imageW, imageH, mask.size,
+							regionNames[r], pixels, strategies[s].name, nsPerPixel[s], strategySetupMs[s]);
+				}
+				printf("  %s\n", strategies[fastest].name);
+			}
+			printf("%-10s %9s", "image ms", "");
+			for (int s = 0; s < strategyCount; s++)
+				printf(" %9.3f", totalMs[s]);
+			printf("\n%-10s %9s", "setup ms", "");
+			for (int s = 0; s < strategyCount; s++)
+				printf(" %9.3f", strategySetupMs[s]);
+			printf("\n");
+
+			freeBorderInput(&input);
+		}
+
+		free(outPixels);
+		free(reference);
+		free(floatPixels);
+	}
+
+	if (csv != NULL) {
+		fclose(csv);
+		printf("Wrote %s.\n", options.csvPath);
+	}
+	if (skipped > 0)
+		printf("%d measurement%s skipped.\n", skipped, skipped == 1 ? "" : "s");
+	if (mismatches > 0) {
+		printf("FAILED: %d strategy outputs differ from clamp.\n", mismatches);
+		return 2;
+	}
+	return skipped > 0 ? 1 : 0;
+}
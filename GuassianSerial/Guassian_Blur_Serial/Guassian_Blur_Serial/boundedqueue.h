@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Fixed capacity queue connecting the stages of a pipeline, any number of threads may push and pop.
+// push blocks while the queue is full, so a fast stage can't run away from a slow one and fill memory.
+// Once closed, pushes fail and pops drain what is left and then fail, which is how stages shut down.
+////
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+	////
+	// Add an item, waiting for space. Returns false (and drops nothing) if the queue was closed.
+	////
+	bool push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+		if (closed)
+			return false;
+		items.push_back(item);
+		notEmpty.notify_one();
+		return true;
+	}
+
+	////
+	// Take the oldest item, waiting for one. Returns false once the queue is closed and empty.
+	////
+	bool pop(T* item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+		if (items.empty())
+			return false;
+		*item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	////
+	// Take the oldest item if there is one, without waiting. Returns false if the queue is empty.
+	////
+	bool tryPop(T* item)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+			return false;
+		*item = items.front();
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	////
+	// No more items will be pushed, wakes everyone waiting.
+	////
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+	std::deque<T> items;
+	size_t capacity;
+	bool closed;
+};
@@ -0,0 +1,1102 @@
+#include "daemon.h"
+
+#include <stdio.h>
+
+#ifdef __linux__
+#include "bench.h"
+#include "blur.h"
+#include "boundedqueue.h"
+#include "image.h"
+#include "synthetic.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Masks the server keeps, past this the least recently used one is dropped (each is about 4KB, and every
+// distinct sigma a client sends would otherwise add one for good).
+#define KERNEL_CACHE_SIZE 64
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for the server, filled in from the command line.
+////
+struct ServerOptions {
+	const char* socketPath;
+	const Backend* backend; // used when a request doesn't name one
+	int workers; // requests blurred at the same time
+	int threads; // threads per request, for multithreaded backends
+	int queueDepth; // requests waiting for a worker before connections stop being read
+};
+
+////
+// One client connection. Shared by its reader thread and the workers answering its requests, the socket is
+// closed once the last of them lets go.
+////
+struct Connection {
+	int socket;
+	std::mutex sendMutex; // responses from different workers must not interleave
+	~Connection() { close(socket); }
+};
+
+////
+// A blur request waiting for a worker, with the handles that came with it.
+////
+struct BlurJob {
+	std::shared_ptr<Connection> connection;
+	DaemonRequest request;
+	int inputFd, outputFd;
+	std::chrono::steady_clock::time_point received;
+};
+
+////
+// A generated mask and when it was last asked for.
+////
+struct CachedKernel {
+	ConvMask mask;
+	long long lastUsed; // value of Server::kernelClock
+};
+
+////
+// State kept warm between requests.
+////
+struct Server {
+	const ServerOptions* options;
+	int listenSocket;
+	std::atomic<bool> stopping;
+	BoundedQueue<BlurJob>* jobs;
+	std::mutex poolMutex; // guards floatPool, kernels and the counters below
+	std::vector<std::vector<float>*> floatPool; // input conversion buffers, reused by size
+	std::map<std::pair<int, float>, CachedKernel> kernels; // by mask width and sigma, at most KERNEL_CACHE_SIZE
+	long long kernelClock; // counts kernel lookups, to find the least recently used one
+	long long requests, failures, poolHits, poolMisses, kernelHits, kernelMisses;
+	double blurMsTotal;
+	std::mutex connectionsMutex; // guards connections, liveReaders and connectionCount
+	std::vector<std::weak_ptr<Connection> > connections; // open ones, to wake their readers at shutdown
+	int liveReaders; // reader threads still running, they are detached
+	std::condition_variable readersDone; // signalled when liveReaders drops to 0
+	long long connectionCount; // accepted since the start
+};
+
+////
+// Settings for the client and load generator, filled in from the command line.
+////
+struct ClientOptions {
+	const char* socketPath;
+	const char* inputPath; // client: image to blur
+	const char* outputPath; // client: where to save the result, NULL to not save
+	int imageW, imageH; // load generator: size of the synthetic image every request blurs
+	int maskSize;
+	float stdv;
+	const char* backend; // NULL for the server's default
+	int clients; // load generator: connections sending requests at the same time
+	int requests; // load generator: requests per connection
+	bool verify; // load generator: check each connection's first result against a local blur
+	bool stats; // client: print the server's counters instead of blurring
+	bool shutdown; // client: stop the server
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Fill in the unix socket address of path. Returns false (after printing why) if the path is too long.
+static bool socketAddress(const char* path, sockaddr_un* address)
+{
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		fprintf(stderr, "Socket path %s is too long\n", path);
+		return false;
+	}
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+////
+// Send a message, with up to two file descriptors attached (fdCount 0 for none).
+// Returns false if the other end has gone.
+////
+static bool sendMessage(int socket, const void* message, size_t size, const int* fds, int fdCount)
+{
+	iovec io;
+	io.iov_base = (void*)message;
+	io.iov_len = size;
+	msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &io;
+	header.msg_iovlen = 1;
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	if (fdCount > 0) {
+		memset(control, 0, sizeof(control));
+		header.msg_control = control;
+		header.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+		cmsghdr* fdMessage = CMSG_FIRSTHDR(&header);
+		fdMessage->cmsg_level = SOL_SOCKET;
+		fdMessage->cmsg_type = SCM_RIGHTS;
+		fdMessage->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+		memcpy(CMSG_DATA(fdMessage), fds, fdCount * sizeof(int));
+	}
+	return sendmsg(socket, &header, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+////
+// Receive one message of exactly size bytes and the file descriptors that came with it (at most 2, any more
+// are closed). Returns false if the connection closed or the message is the wrong size.
+////
+static bool receiveMessage(int socket, void* message, size_t size, int* fds, int* fdCount)
+{
+	iovec io;
+	io.iov_base = message;
+	io.iov_len = size;
+	msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &io;
+	header.msg_iovlen = 1;
+	char control[CMSG_SPACE(4 * sizeof(int))];
+	header.msg_control = control;
+	header.msg_controllen = sizeof(control);
+	ssize_t received = recvmsg(socket, &header, MSG_CMSG_CLOEXEC);
+
+	*fdCount = 0;
+	for (cmsghdr* fdMessage = CMSG_FIRSTHDR(&header); fdMessage != NULL; fdMessage = CMSG_NXTHDR(&header, fdMessage)) {
+		if (fdMessage->cmsg_level != SOL_SOCKET || fdMessage->cmsg_type != SCM_RIGHTS)
+			continue;
+		int count = (int)((fdMessage->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+		for (int f = 0; f < count; f++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(fdMessage) + f * sizeof(int), sizeof(int));
+			if (*fdCount < 2)
+				fds[(*fdCount)++] = fd;
+			else
+				close(fd);
+		}
+	}
+	return received == (ssize_t)size && (header.msg_flags & MSG_TRUNC) == 0;
+}
+
+////
+// Map a shared memory handle, which must hold at least bytes.
+// Returns NULL if it's too small or can't be mapped.
+////
+static unsigned char* mapBuffer(int fd, size_t bytes, bool writable)
+{
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < bytes)
+		return NULL;
+	void* pixels = mmap(NULL, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	return pixels == MAP_FAILED ? NULL : (unsigned char*)pixels;
+}
+
+////
+// Whether a handle is a memfd sealed against shrinking. Without the seal the client could truncate it while
+// it's mapped here, and touching the pages that went away kills the server with SIGBUS.
+////
+static bool sealedAgainstShrinking(int fd)
+{
+	int seals = fcntl(fd, F_GET_SEALS);
+	return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+}
+
+////
+// Take a float buffer of at least count floats from the pool, allocating one only if none is big enough.
+////
+static std::vector<float>* takeFloatBuffer(Server* server, size_t count)
+{
+	std::lock_guard<std::mutex> lock(server->poolMutex);
+	for (size_t b = 0; b < server->floatPool.size(); b++) {
+		if (server->floatPool[b]->size() >= count) {
+			std::vector<float>* buffer = server->floatPool[b];
+			server->floatPool.erase(server->floatPool.begin() + b);
+			server->poolHits++;
+			return buffer;
+		}
+	}
+	server->poolMisses++;
+	return new std::vector<float>(count);
+}
+
+static void returnFloatBuffer(Server* server, std::vector<float>* buffer)
+{
+	std::lock_guard<std::mutex> lock(server->poolMutex);
+	server->floatPool.push_back(buffer);
+}
+
+// The mask for a width and sigma, generated the first time it's asked for and kept until it's the least
+// recently used of KERNEL_CACHE_SIZE.
+static ConvMask cachedKernel(Server* server, int maskSize, float stdv)
+{
+	std::lock_guard<std::mutex> lock(server->poolMutex);
+	server->kernelClock++;
+	std::pair<int, float> key(maskSize, stdv);
+	std::map<std::pair<int, float>, CachedKernel>::iterator found = server->kernels.find(key);
+	if (found != server->kernels.end()) {
+		server->kernelHits++;
+		found->second.lastUsed = server->kernelClock;
+		return found->second.mask;
+	}
+	server->kernelMisses++;
+	if (server->kernels.size() >= KERNEL_CACHE_SIZE) {
+		// a linear scan is fine for a cache this small
+		std::map<std::pair<int, float>, CachedKernel>::iterator oldest = server->kernels.begin();
+		for (std::map<std::pair<int, float>, CachedKernel>::iterator k = server->kernels.begin(); k != server->kernels.end(); ++k) {
+			if (k->second.lastUsed < oldest->second.lastUsed)
+				oldest = k;
+		}
+		server->kernels.erase(oldest);
+	}
+	CachedKernel& cached = server->kernels[key];
+	generateGuassianKernel(&cached.mask, maskSize, stdv);
+	cached.lastUsed = server->kernelClock;
+	return cached.mask;
+}
+
+////
+// Blur one request straight from the input mapping into the output mapping.
+// Returns a DaemonStatus, with the reason in response->message if it failed. response->backend is set to the
+// backend used once it's known.
+////
+static int blurRequest(Server* server, const BlurJob* job, DaemonResponse* response)
+{
+	const DaemonRequest& request = job->request;
+	if (request.imageW < 1 || request.imageH < 1 || (long long)request.imageW * request.imageH * 4 > INT_MAX ||
+		request.maskSize < 1 || request.maskSize > MAX_MASK_SIZE || request.maskSize % 2 == 0 || !(request.stdv > 0.0f)) {
+		snprintf(response->message, sizeof(response->message), "bad image size, mask width or sigma");
+		return DAEMON_BAD_REQUEST;
+	}
+	const Backend* backend = server->options->backend;
+	if (request.backend[0] != '\0') {
+		char name[sizeof(request.backend) + 1];
+		memcpy(name, request.backend, sizeof(request.backend));
+		name[sizeof(request.backend)] = '\0';
+		backend = findBackend(name);
+		if (backend == NULL) {
+			snprintf(response->message, sizeof(response->message), "unknown backend %s", name);
+			return DAEMON_UNKNOWN_BACKEND;
+		}
+	}
+	strncpy(response->backend, backend->name, sizeof(response->backend) - 1);
+	if (job->inputFd < 0 || job->outputFd < 0) {
+		snprintf(response->message, sizeof(response->message), "a blur needs an input and an output handle");
+		return DAEMON_BAD_BUFFER;
+	}
+	if (!sealedAgainstShrinking(job->inputFd) || !sealedAgainstShrinking(job->outputFd)) {
+		snprintf(response->message, sizeof(response->message), "the handles must be memfds sealed with F_SEAL_SHRINK");
+		return DAEMON_BAD_BUFFER;
+	}
+
+	size_t bytes = (size_t)request.imageW * request.imageH * 4;
+	unsigned char* input = mapBuffer(job->inputFd, bytes, false);
+	unsigned char* output = mapBuffer(job->outputFd, bytes, true);
+	int status = DAEMON_OK;
+	if (input == NULL || output == NULL) {
+		snprintf(response->message, sizeof(response->message), "the handles must be mappable and hold %dx%d RGBA pixels", request.imageW, request.imageH);
+		status = DAEMON_BAD_BUFFER;
+	}
+	else {
+		ConvMask mask = cachedKernel(server, request.maskSize, request.stdv);
+		std::vector<float>* floats = takeFloatBuffer(server, bytes);
+		for (size_t p = 0; p < bytes; p++)
+			(*floats)[p] = (float)input[p];
+		backend->convolve(&(*floats)[0], output, request.imageW * 4, request.imageW, request.imageH, &mask, server->options->threads);
+		returnFloatBuffer(server, floats);
+	}
+	if (input != NULL)
+		munmap(input, bytes);
+	if (output != NULL)
+		munmap(output, bytes);
+	return status;
+}
+
+// Body of every worker thread: blur queued requests and answer them until the queue is closed.
+static void serverWorker(Server* server)
+{
+	for (;;) {
+		BlurJob job;
+		if (!server->jobs->pop(&job))
+			break;
+		DaemonResponse response;
+		memset(&response, 0, sizeof(response));
+		response.magic = DAEMON_MAGIC;
+		response.id = job.request.id;
+		response.queueMs = (float)millisecondsSince(job.received);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		response.status = blurRequest(server, &job, &response);
+		response.blurMs = (float)millisecondsSince(start);
+		if (job.inputFd >= 0)
+			close(job.inputFd);
+		if (job.outputFd >= 0)
+			close(job.outputFd);
+		{
+			std::lock_guard<std::mutex> lock(server->poolMutex);
+			server->requests++;
+			if (response.status != DAEMON_OK)
+				server->failures++;
+			else
+				server->blurMsTotal += response.blurMs;
+		}
+		std::lock_guard<std::mutex> lock(job.connection->sendMutex);
+		sendMessage(job.connection->socket, &response, sizeof(response), NULL, 0);
+	}
+}
+
+// Stop accepting connections and wake every thread blocked on a socket.
+static void stopServer(Server* server)
+{
+	if (server->stopping.exchange(true))
+		return;
+	shutdown(server->listenSocket, SHUT_RDWR);
+	std::lock_guard<std::mutex> lock(server->connectionsMutex);
+	for (size_t c = 0; c < server->connections.size(); c++) {
+		std::shared_ptr<Connection> connection = server->connections[c].lock();
+		if (connection)
+			shutdown(connection->socket, SHUT_RD);
+	}
+}
+
+////
+// Body of each connection's reader thread: queue its blur requests, answer the rest, until it closes.
+// The thread is detached, runServer waits for liveReaders to reach 0 before it tears the server down.
+////
+static void serveConnection(Server* server, std::shared_ptr<Connection> connection)
+{
+	for (;;) {
+		DaemonRequest request;
+		int fds[2];
+		int fdCount;
+		bool received = receiveMessage(connection->socket, &request, sizeof(request), fds, &fdCount);
+		if (!received) {
+			for (int f = 0; f < fdCount; f++)
+				close(fds[f]);
+			break;
+		}
+
+		DaemonResponse response;
+		memset(&response, 0, sizeof(response));
+		response.magic = DAEMON_MAGIC;
+		response.id = request.id;
+		if (request.magic != DAEMON_MAGIC || request.version != DAEMON_VERSION ||
+			(request.command == DAEMON_BLUR && fdCount != 2) || (request.command != DAEMON_BLUR && fdCount != 0)) {
+			response.status = DAEMON_BAD_REQUEST;
+			snprintf(response.message, sizeof(response.message), "expected a version %d request with 2 handles for a blur and none otherwise", DAEMON_VERSION);
+		}
+		else if (request.command == DAEMON_BLUR) {
+			BlurJob job;
+			job.connection = connection;
+			job.request = request;
+			job.inputFd = fds[0];
+			job.outputFd = fds[1];
+			job.received = std::chrono::steady_clock::now();
+			fdCount = 0; // the worker closes them
+			if (server->jobs->push(job))
+				continue;
+			close(job.inputFd);
+			close(job.outputFd);
+			response.status = DAEMON_BAD_REQUEST;
+			snprintf(response.message, sizeof(response.message), "the server is shutting down");
+		}
+		else if (request.command == DAEMON_STATS) {
+			std::lock_guard<std::mutex> lock(server->poolMutex);
+			snprintf(response.message, sizeof(response.message),
+				"requests %lld, failed %lld, mean blur %.2fms, buffer pool %lld hits %lld misses, kernel cache %lld hits %lld misses",
+				server->requests, server->failures, server->requests > server->failures ? server->blurMsTotal / (server->requests - server->failures) : 0.0,
+				server->poolHits, server->poolMisses, server->kernelHits, server->kernelMisses);
+		}
+		else if (request.command == DAEMON_SHUTDOWN) {
+			snprintf(response.message, sizeof(response.message), "shutting down");
+			{
+				std::lock_guard<std::mutex> lock(connection->sendMutex);
+				sendMessage(connection->socket, &response, sizeof(response), NULL, 0);
+			}
+			stopServer(server);
+			break;
+		}
+		else {
+			response.status = DAEMON_BAD_REQUEST;
+			snprintf(response.message, sizeof(response.message), "unknown command %u", request.command);
+		}
+		for (int f = 0; f < fdCount; f++)
+			close(fds[f]);
+		std::lock_guard<std::mutex> lock(connection->sendMutex);
+		sendMessage(connection->socket, &response, sizeof(response), NULL, 0);
+	}
+
+	// the socket closes once the workers have answered what is still queued for it
+	connection.reset();
+	std::lock_guard<std::mutex> lock(server->connectionsMutex);
+	if (--server->liveReaders == 0)
+		server->readersDone.notify_all();
+}
+
+static void printServerUsage(const char* program)
+{
+	printf("Usage: %s --serve [options]\n", program);
+	printf("  --socket <path>    unix socket to listen on (default %s)\n", DAEMON_DEFAULT_SOCKET);
+	printf("  --backend <name>   backend for requests that don't name one (default cpu)\n");
+	printf("  --workers <n>      requests blurred at the same time (default %d)\n", defaultThreadCount());
+	printf("  --threads <n>      threads per request, for multithreaded backends (default 1). They are started for every\n");
+	printf("                     request, only the --workers are kept warm, so more requests beat more threads each\n");
+	printf("  --queue <n>        requests waiting for a worker before the connections stop being read (default 64)\n");
+	printf("Runs until a client sends a shutdown request (%s --client --shutdown).\n", program);
+}
+
+////
+// Read the server command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseServerOptions(int argc, char** argv, ServerOptions* options)
+{
+	options->socketPath = DAEMON_DEFAULT_SOCKET;
+	options->backend = &backends[0];
+	options->workers = defaultThreadCount();
+	options->threads = 1;
+	options->queueDepth = 64;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--socket") == 0)
+			options->socketPath = value;
+		else if (strcmp(arg, "--backend") == 0) {
+			options->backend = findBackend(value);
+			if (options->backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--workers") == 0)
+			options->workers = atoi(value);
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--queue") == 0)
+			options->queueDepth = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->workers < 1 || options->threads < 1 || options->queueDepth < 1) {
+		fprintf(stderr, "Workers, threads and queue depth must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Make way for bind() at path. Only a socket no server is listening on (left by one that didn't shut down
+// cleanly) is removed, anything else there is left alone and reported.
+// Returns false if the path is taken.
+////
+static bool removeStaleSocket(const char* path, const sockaddr_un* address)
+{
+	struct stat info;
+	if (lstat(path, &info) != 0) {
+		if (errno == ENOENT)
+			return true;
+		fprintf(stderr, "Could not check %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	if (!S_ISSOCK(info.st_mode)) {
+		fprintf(stderr, "%s exists and isn't a socket, not replacing it\n", path);
+		return false;
+	}
+	int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (probe < 0) {
+		fprintf(stderr, "Could not create a socket: %s\n", strerror(errno));
+		return false;
+	}
+	int connectError = connect(probe, (const sockaddr*)address, sizeof(*address)) == 0 ? 0 : errno;
+	close(probe);
+	if (connectError == 0 || connectError == EAGAIN) {
+		fprintf(stderr, "A server is already listening on %s\n", path);
+		return false;
+	}
+	if (connectError != ECONNREFUSED) {
+		fprintf(stderr, "Could not tell whether %s is in use: %s\n", path, strerror(connectError));
+		return false;
+	}
+	if (unlink(path) != 0) {
+		fprintf(stderr, "Could not remove the stale socket %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+////
+// Server entry point, argv[0] is "--serve".
+// Listens on a unix socket and blurs requests whose pixels are in shared memory handles sent with them, with
+// the worker threads, float buffers and masks kept between requests so each one only pays for the blur.
+// Returns 0 after a shutdown request, 1 if it couldn't start.
+////
+int runServer(int argc, char** argv)
+{
+	ServerOptions options;
+	if (!parseServerOptions(argc, argv, &options)) {
+		printServerUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	sockaddr_un address;
+	if (!socketAddress(options.socketPath, &address))
+		return 1;
+	int listenSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (listenSocket < 0) {
+		fprintf(stderr, "Could not create a socket: %s\n", strerror(errno));
+		return 1;
+	}
+	if (!removeStaleSocket(options.socketPath, &address)) {
+		close(listenSocket);
+		return 1;
+	}
+	if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 16) != 0) {
+		fprintf(stderr, "Could not listen on %s: %s\n", options.socketPath, strerror(errno));
+		close(listenSocket);
+		return 1;
+	}
+
+	Server server;
+	server.options = &options;
+	server.listenSocket = listenSocket;
+	server.stopping = false;
+	BoundedQueue<BlurJob> jobs(options.queueDepth);
+	server.jobs = &jobs;
+	server.requests = server.failures = server.poolHits = server.poolMisses = server.kernelHits = server.kernelMisses = 0;
+	server.blurMsTotal = 0.0;
+	server.kernelClock = 0;
+	server.liveReaders = 0;
+	server.connectionCount = 0;
+	std::vector<std::thread> workers;
+	for (int w = 0; w < options.workers; w++)
+		workers.push_back(std::thread(serverWorker, &server));
+	printf("Listening on %s with %d workers, %s backend with %d threads per request.\n", options.socketPath, options.workers,
+		options.backend->name, options.threads);
+	fflush(stdout);
+
+	while (!server.stopping) {
+		int clientSocket = accept4(listenSocket, NULL, NULL, SOCK_CLOEXEC);
+		if (clientSocket < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		std::shared_ptr<Connection> connection(new Connection());
+		connection->socket = clientSocket;
+		{
+			std::lock_guard<std::mutex> lock(server.connectionsMutex);
+			// forget the connections that have closed, so a long running server doesn't collect one per client
+			server.connections.erase(std::remove_if(server.connections.begin(), server.connections.end(),
+				[](const std::weak_ptr<Connection>& c) { return c.expired(); }), server.connections.end());
+			server.connections.push_back(connection);
+			server.liveReaders++;
+			server.connectionCount++;
+			if (server.stopping)
+				shutdown(clientSocket, SHUT_RD);
+		}
+		std::thread(serveConnection, &server, connection).detach();
+	}
+
+	stopServer(&server);
+	{
+		std::unique_lock<std::mutex> lock(server.connectionsMutex);
+		server.readersDone.wait(lock, [&server] { return server.liveReaders == 0; });
+	}
+	jobs.close();
+	for (size_t w = 0; w < workers.size(); w++)
+		workers[w].join();
+	close(listenSocket);
+	unlink(options.socketPath);
+	for (size_t b = 0; b < server.floatPool.size(); b++)
+		delete server.floatPool[b];
+
+	printf("Served %lld requests (%lld failed) on %lld connections. Buffer pool %lld hits %lld misses, kernel cache %lld hits %lld misses.\n",
+		server.requests, server.failures, server.connectionCount, server.poolHits, server.poolMisses, server.kernelHits, server.kernelMisses);
+	return 0;
+}
+
+////
+// Connect to the server. Returns the socket, or -1 (after printing why) if it isn't running.
+////
+static int connectToServer(const char* socketPath)
+{
+	sockaddr_un address;
+	if (!socketAddress(socketPath, &address))
+		return -1;
+	int clientSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (clientSocket < 0 || connect(clientSocket, (sockaddr*)&address, sizeof(address)) != 0) {
+		fprintf(stderr, "Could not connect to %s: %s (is %s --serve running?)\n", socketPath, strerror(errno), "Guassian_Blur_Serial");
+		if (clientSocket >= 0)
+			close(clientSocket);
+		return -1;
+	}
+	return clientSocket;
+}
+
+////
+// Shared memory buffer of bytes, mapped in this process. It's sealed against shrinking, which the server
+// requires so a buffer can't be truncated under it while it blurs.
+// Returns false (after printing why) if it couldn't be created.
+////
+static bool createSharedBuffer(size_t bytes, const char* name, int* fd, unsigned char** pixels)
+{
+	*fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (*fd < 0 || ftruncate(*fd, (off_t)bytes) != 0 || fcntl(*fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+		fprintf(stderr, "Could not create a shared memory buffer: %s\n", strerror(errno));
+		if (*fd >= 0)
+			close(*fd);
+		return false;
+	}
+	void* mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (mapped == MAP_FAILED) {
+		fprintf(stderr, "Could not map a shared memory buffer: %s\n", strerror(errno));
+		close(*fd);
+		return false;
+	}
+	*pixels = (unsigned char*)mapped;
+	return true;
+}
+
+// A request with the settings of options filled in.
+static DaemonRequest makeRequest(const ClientOptions* options, uint32_t command, uint32_t id, int imageW, int imageH)
+{
+	DaemonRequest request;
+	memset(&request, 0, sizeof(request));
+	request.magic = DAEMON_MAGIC;
+	request.version = DAEMON_VERSION;
+	request.command = command;
+	request.id = id;
+	request.imageW = imageW;
+	request.imageH = imageH;
+	request.maskSize = options->maskSize;
+	request.stdv = options->stdv;
+	if (options->backend != NULL)
+		strncpy(request.backend, options->backend, sizeof(request.backend) - 1);
+	return request;
+}
+
+////
+// Send a request and wait for its response.
+// Returns false (after printing why) if the connection failed, a failed request still returns true.
+////
+static bool sendRequest(int clientSocket, const DaemonRequest* request, const int* fds, int fdCount, DaemonResponse* response)
+{
+	int unexpectedFds[2];
+	int unexpectedCount;
+	if (!sendMessage(clientSocket, request, sizeof(*request), fds, fdCount) ||
+		!receiveMessage(clientSocket, response, sizeof(*response), unexpectedFds, &unexpectedCount)) {
+		fprintf(stderr, "Lost the connection to the server\n");
+		return false;
+	}
+	for (int f = 0; f < unexpectedCount; f++)
+		close(unexpectedFds[f]);
+	if (response->magic != DAEMON_MAGIC || response->id != request->id) {
+		fprintf(stderr, "The server sent an unexpected response\n");
+		return false;
+	}
+	response->message[sizeof(response->message) - 1] = '\0';
+	response->backend[sizeof(response->backend) - 1] = '\0';
+	return true;
+}
+
+static void printClientUsage(const char* program)
+{
+	printf("Usage: %s --client --input <image> [options]\n", program);
+	printf("       %s --client --stats | --shutdown [--socket <path>]\n", program);
+	printf("  --socket <path>    server socket (default %s)\n", DAEMON_DEFAULT_SOCKET);
+	printf("  --input <image>    image to blur\n");
+	printf("  --output <file>    save the result (.png, .jpg, .bmp, .ppm or .raw)\n");
+	printf("  --mask <n>         mask width (default 5)\n");
+	printf("  --sigma <f>        strength of the blur (default 5)\n");
+	printf("  --backend <name>   backend (default the server's)\n");
+	printf("  --stats            print the server's counters\n");
+	printf("  --shutdown         stop the server once it has answered the requests it has\n");
+}
+
+static void printLoadUsage(const char* program)
+{
+	printf("Usage: %s --load [options]\n", program);
+	printf("  --socket <path>    server socket (default %s)\n", DAEMON_DEFAULT_SOCKET);
+	printf("  --clients <n>      connections sending requests at the same time (default 4)\n");
+	printf("  --requests <n>     requests per connection (default 50)\n");
+	printf("  --size <w>x<h>     size of the synthetic image every request blurs (default 640x480)\n");
+	printf("  --mask <n>         mask width (default 5)\n");
+	printf("  --sigma <f>        strength of the blur (default 5)\n");
+	printf("  --backend <name>   backend (default the server's)\n");
+	printf("  --no-verify        don't check each connection's first result against a local blur\n");
+	printf("Exits with code 2 if a result doesn't match the local blur.\n");
+}
+
+////
+// Read the client or load generator command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseClientOptions(int argc, char** argv, bool load, ClientOptions* options)
+{
+	options->socketPath = DAEMON_DEFAULT_SOCKET;
+	options->inputPath = NULL;
+	options->outputPath = NULL;
+	options->imageW = 640;
+	options->imageH = 480;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->backend = NULL;
+	options->clients = 4;
+	options->requests = 50;
+	options->verify = true;
+	options->stats = false;
+	options->shutdown = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (!load && strcmp(arg, "--stats") == 0) {
+			options->stats = true;
+			continue;
+		}
+		if (!load && strcmp(arg, "--shutdown") == 0) {
+			options->shutdown = true;
+			continue;
+		}
+		if (load && strcmp(arg, "--no-verify") == 0) {
+			options->verify = false;
+			continue;
+		}
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--socket") == 0)
+			options->socketPath = value;
+		else if (!load && strcmp(arg, "--input") == 0)
+			options->inputPath = value;
+		else if (!load && strcmp(arg, "--output") == 0)
+			options->outputPath = value;
+		else if (load && strcmp(arg, "--size") == 0) {
+			if (sscanf(value, "%dx%d", &options->imageW, &options->imageH) != 2 || options->imageW < 1 || options->imageH < 1) {
+				fprintf(stderr, "Image size must be <width>x<height>, not %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--backend") == 0)
+			options->backend = value;
+		else if (load && strcmp(arg, "--clients") == 0)
+			options->clients = atoi(value);
+		else if (load && strcmp(arg, "--requests") == 0)
+			options->requests = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (!load && !options->stats && !options->shutdown && options->inputPath == NULL) {
+		fprintf(stderr, "An input image is required\n");
+		return false;
+	}
+	if (load && (options->clients < 1 || options->requests < 1)) {
+		fprintf(stderr, "Clients and requests must be at least 1\n");
+		return false;
+	}
+	// the server checks the rest
+	return true;
+}
+
+////
+// Client entry point, argv[0] is "--client".
+// Blurs one image through the server (or asks it for its counters, or to shut down).
+// Returns 0 on success, 1 otherwise.
+////
+int runClient(int argc, char** argv)
+{
+	ClientOptions options;
+	if (!parseClientOptions(argc, argv, false, &options)) {
+		printClientUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	int clientSocket = connectToServer(options.socketPath);
+	if (clientSocket < 0)
+		return 1;
+
+	DaemonResponse response;
+	if (options.stats || options.shutdown) {
+		DaemonRequest request = makeRequest(&options, options.stats ? DAEMON_STATS : DAEMON_SHUTDOWN, 1, 0, 0);
+		bool sent = sendRequest(clientSocket, &request, NULL, 0, &response);
+		close(clientSocket);
+		if (!sent)
+			return 1;
+		printf("%s\n", response.message);
+		return response.status == DAEMON_OK ? 0 : 1;
+	}
+
+	SDL_Surface* image = loadImage(options.inputPath);
+	if (image == NULL) {
+		close(clientSocket);
+		return 1;
+	}
+	printf("Loaded %dx%d image.\n", image->w, image->h);
+	size_t bytes = (size_t)image->w * image->h * 4;
+	int fds[2];
+	unsigned char* input;
+	unsigned char* output;
+	if (!createSharedBuffer(bytes, "blur-input", &fds[0], &input)) {
+		SDL_FreeSurface(image);
+		close(clientSocket);
+		return 1;
+	}
+	if (!createSharedBuffer(bytes, "blur-output", &fds[1], &output)) {
+		munmap(input, bytes);
+		close(fds[0]);
+		SDL_FreeSurface(image);
+		close(clientSocket);
+		return 1;
+	}
+	for (int y = 0; y < image->h; y++)
+		memcpy(input + (size_t)y * image->w * 4, (unsigned char*)image->pixels + y * image->pitch, image->w * 4);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	DaemonRequest request = makeRequest(&options, DAEMON_BLUR, 1, image->w, image->h);
+	bool sent = sendRequest(clientSocket, &request, fds, 2, &response);
+	double roundTripMs = millisecondsSince(start);
+	close(clientSocket);
+	int result = 0;
+	if (!sent)
+		result = 1;
+	else if (response.status != DAEMON_OK) {
+		fprintf(stderr, "The server couldn't blur the image: %s\n", response.message);
+		result = 1;
+	}
+	else {
+		printf("Blurred %dx%d with %s in %.3fms round trip (%.3fms queued, %.3fms blurring).\n", image->w, image->h,
+			response.backend, roundTripMs, response.queueMs, response.blurMs);
+		if (options.outputPath != NULL) {
+			for (int y = 0; y < image->h; y++)
+				memcpy((unsigned char*)image->pixels + y * image->pitch, output + (size_t)y * image->w * 4, image->w * 4);
+			if (saveImage(image, options.outputPath))
+				printf("Saved %s.\n", options.outputPath);
+			else
+				result = 1;
+		}
+	}
+	munmap(input, bytes);
+	munmap(output, bytes);
+	close(fds[0]);
+	close(fds[1]);
+	SDL_FreeSurface(image);
+	return result;
+}
+
+////
+// What one load generator connection saw.
+////
+struct LoadClientStats {
+	std::vector<double> latencies; // round trip of every successful request
+	int failures;
+	bool verified; // the first result was compared with the local blur (the server used an exact backend)
+	bool mismatch; // the first result differed from the local blur
+	bool lostConnection;
+};
+
+// Body of each load generator thread: one connection sending its requests one after another, reusing the
+// same two shared memory buffers for all of them.
+static void loadClient(const ClientOptions* options, const unsigned char* image, const unsigned char* expected, int client, LoadClientStats* stats)
+{
+	stats->failures = 0;
+	stats->verified = false;
+	stats->mismatch = false;
+	stats->lostConnection = false;
+	int clientSocket = connectToServer(options->socketPath);
+	if (clientSocket < 0) {
+		stats->lostConnection = true;
+		return;
+	}
+	size_t bytes = (size_t)options->imageW * options->imageH * 4;
+	int fds[2];
+	unsigned char* input;
+	unsigned char* output;
+	if (!createSharedBuffer(bytes, "load-input", &fds[0], &input)) {
+		close(clientSocket);
+		stats->lostConnection = true;
+		return;
+	}
+	if (!createSharedBuffer(bytes, "load-output", &fds[1], &output)) {
+		munmap(input, bytes);
+		close(fds[0]);
+		close(clientSocket);
+		stats->lostConnection = true;
+		return;
+	}
+	memcpy(input, image, bytes);
+
+	for (int r = 0; r < options->requests; r++) {
+		DaemonRequest request = makeRequest(options, DAEMON_BLUR, (uint32_t)(client * options->requests + r), options->imageW, options->imageH);
+		DaemonResponse response;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!sendRequest(clientSocket, &request, fds, 2, &response)) {
+			stats->lostConnection = true;
+			break;
+		}
+		double ms = millisecondsSince(start);
+		if (response.status != DAEMON_OK) {
+			if (stats->failures == 0)
+				fprintf(stderr, "Request failed: %s\n", response.message);
+			stats->failures++;
+			continue;
+		}
+		stats->latencies.push_back(ms);
+		// the server picks the backend when none is named, and approximate ones don't match the reference
+		const Backend* used = findBackend(response.backend);
+		if (r == 0 && expected != NULL && used != NULL && used->exact) {
+			stats->verified = true;
+			stats->mismatch = memcmp(output, expected, bytes) != 0;
+		}
+	}
+	munmap(input, bytes);
+	munmap(output, bytes);
+	close(fds[0]);
+	close(fds[1]);
+	close(clientSocket);
+}
+
+////
+// Load generator entry point, argv[0] is "--load".
+// Several connections send blur requests to a running server as fast as it answers them. Reports the
+// throughput and latency percentiles, and checks the results against blurring the same image locally.
+// Returns 0 if every request succeeded (and matched), 2 if a result didn't match, 1 on other failures.
+////
+int runLoadGenerator(int argc, char** argv)
+{
+	ClientOptions options;
+	if (!parseClientOptions(argc, argv, true, &options)) {
+		printLoadUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	SyntheticSpec spec;
+	spec.pattern = PATTERN_NOISE;
+	spec.imageW = options.imageW;
+	spec.imageH = options.imageH;
+	spec.seed = 1;
+	float* floatPixels = generateSyntheticImage(&spec);
+	if (floatPixels == NULL)
+		return 1;
+	size_t bytes = (size_t)options.imageW * options.imageH * 4;
+	std::vector<unsigned char> image(bytes);
+	for (size_t p = 0; p < bytes; p++)
+		image[p] = (unsigned char)floatPixels[p];
+	// every backend in this build gives the same output as the reference (approximate ones aside)
+	std::vector<unsigned char> expected;
+	const Backend* backend = options.backend != NULL ? findBackend(options.backend) : NULL;
+	if (options.verify && (backend == NULL || backend->exact) && options.maskSize >= 1 && options.maskSize <= MAX_MASK_SIZE &&
+		options.maskSize % 2 == 1 && options.stdv > 0.0f) {
+		ConvMask mask;
+		generateGuassianKernel(&mask, options.maskSize, options.stdv);
+		expected.resize(bytes);
+		convolveImageCPU(floatPixels, &expected[0], options.imageW * 4, options.imageW, options.imageH, &mask);
+	}
+	free(floatPixels);
+
+	printf("%d connections sending %d requests each, %dx%d mask %dx%d sigma %g.\n", options.clients, options.requests,
+		options.imageW, options.imageH, options.maskSize, options.maskSize, options.stdv);
+	std::vector<LoadClientStats> stats(options.clients);
+	std::vector<std::thread> threads;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int c = 0; c < options.clients; c++)
+		threads.push_back(std::thread(loadClient, &options, &image[0], expected.empty() ? NULL : &expected[0], c, &stats[c]));
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	double wallMs = millisecondsSince(start);
+
+	std::vector<double> latencies;
+	int failures = 0;
+	int verified = 0;
+	int mismatches = 0;
+	bool lost = false;
+	for (size_t c = 0; c < stats.size(); c++) {
+		latencies.insert(latencies.end(), stats[c].latencies.begin(), stats[c].latencies.end());
+		failures += stats[c].failures;
+		verified += stats[c].verified ? 1 : 0;
+		mismatches += stats[c].mismatch ? 1 : 0;
+		lost = lost || stats[c].lostConnection;
+	}
+	int done = (int)latencies.size();
+	double seconds = wallMs / 1000.0;
+	printf("\n%d requests in %.2fs: %.1f requests/s, %.1f megapixels/s", done, seconds, done / seconds,
+		(double)done * options.imageW * options.imageH / 1e6 / seconds);
+	if (failures > 0)
+		printf(", %d failed", failures);
+	printf("\n");
+	if (done > 0) {
+		std::sort(latencies.begin(), latencies.end());
+		printf("%-8s %9s %9s %9s %9s\n", "", "p50", "p95", "p99", "max");
+		printf("%-8s %7.2fms %7.2fms %7.2fms %7.2fms\n", "latency", percentile(latencies, 0.5), percentile(latencies, 0.95),
+			percentile(latencies, 0.99), latencies.back());
+	}
+	if (mismatches > 0) {
+		printf("FAILED: %d connections got a result that differs from the local blur.\n", mismatches);
+		return 2;
+	}
+	if (verified > 0)
+		printf("The first result of %d connections matches the local blur.\n", verified);
+	else if (!expected.empty() && done > 0)
+		printf("Results not checked, the server blurred with an approximate backend.\n");
+	return (failures == 0 && !lost) ? 0 : 1;
+}
+
+#else
+
+// Unix domain sockets with handle passing and memfd are Linux only.
+static int notSupported()
+{
+	fprintf(stderr, "--serve, --client and --load need unix sockets and memfd, they are only available on Linux\n");
+	return 1;
+}
+
+int runServer(int argc, char** argv)
+{
+	return notSupported();
+}
+
+int runClient(int argc, char** argv)
+{
+	return notSupported();
+}
+
+int runLoadGenerator(int argc, char** argv)
+{
+	return notSupported();
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// First field of every message, "GBUD"
+#define DAEMON_MAGIC 0x44554247u
+// Bumped whenever the layout or the meaning of the messages changes
+#define DAEMON_VERSION 2
+// Socket the server listens on when none is given
+#define DAEMON_DEFAULT_SOCKET "/tmp/guassian-blur.sock"
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// What a request asks the server to do.
+enum DaemonCommand {
+	DAEMON_BLUR = 1, // blur the image in the first shared memory handle into the second
+	DAEMON_STATS = 2, // reply with the server's counters in the message
+	DAEMON_SHUTDOWN = 3 // finish the requests already queued and exit
+};
+
+// Outcome of a request.
+enum DaemonStatus {
+	DAEMON_OK = 0,
+	DAEMON_BAD_REQUEST = 1, // wrong magic, version, command or settings
+	DAEMON_BAD_BUFFER = 2, // the handles are missing, not sealed, too small or can't be mapped
+	DAEMON_UNKNOWN_BACKEND = 3
+};
+
+////
+// Request sent over the socket. For DAEMON_BLUR two memfd handles travel with it (SCM_RIGHTS): the input and
+// the output, each at least imageW * imageH * 4 bytes of tightly packed 8-bit RGBA. The pixels themselves
+// never go through the socket. Both must carry F_SEAL_SHRINK, so they can't be truncated during the blur.
+////
+struct DaemonRequest {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t command; // a DaemonCommand
+	uint32_t id; // echoed in the response
+	int32_t imageW, imageH;
+	int32_t maskSize;
+	float stdv;
+	char backend[32]; // backend name, empty for the server's default
+};
+
+////
+// Reply to a request, one per request.
+////
+struct DaemonResponse {
+	uint32_t magic;
+	uint32_t id;
+	int32_t status; // a DaemonStatus
+	float queueMs; // time the request waited for a worker
+	float blurMs; // time the worker spent on it
+	char backend[32]; // backend that blurred the image, only approximate ones may differ from the reference
+	char message[160]; // why it failed, or the counters for DAEMON_STATS
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+int runServer(int argc, char** argv);
+int runClient(int argc, char** argv);
+int runLoadGenerator(int argc, char** argv);
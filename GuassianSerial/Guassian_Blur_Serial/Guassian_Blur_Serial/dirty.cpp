@@ -0,0 +1,198 @@
+#include "dirty.h"
+#include "bench.h"
+#include "blur.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGE = "synth:noise:720p";
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a dirty rectangle run, filled in from the command line.
+////
+struct DirtyOptions {
+	const char* image;
+	int maskSize;
+	float stdv;
+	int updates; // how many times the input is changed and re-blurred
+	int rects; // dirty rectangles per update
+	int rectSize; // largest width and height of a dirty rectangle
+	unsigned int seed;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Next value of a xorshift generator, so the updates are the same on every platform.
+static unsigned int nextRandom(unsigned int* state)
+{
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static void printDirtyUsage(const char* program)
+{
+	printf("Usage: %s --dirty [options]\n", program);
+	printf("  --input <image>      image to update (default %s)\n", DEFAULT_IMAGE);
+	printf("  --mask <n>           mask width (default 5)\n");
+	printf("  --sigma <f>          strength of the blur (default 5)\n");
+	printf("  --updates <n>        times the input is changed and re-blurred (default 20)\n");
+	printf("  --rects <n>          dirty rectangles per update, placed at random (default 4)\n");
+	printf("  --rect-size <n>      largest width and height of a dirty rectangle (default 32)\n");
+	printf("  --seed <n>           seed for the rectangles (default 1)\n");
+}
+
+////
+// Read the dirty rectangle command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseDirtyOptions(int argc, char** argv, DirtyOptions* options)
+{
+	options->image = DEFAULT_IMAGE;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->updates = 20;
+	options->rects = 4;
+	options->rectSize = 32;
+	options->seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->image = value;
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--updates") == 0)
+			options->updates = atoi(value);
+		else if (strcmp(arg, "--rects") == 0)
+			options->rects = atoi(value);
+		else if (strcmp(arg, "--rect-size") == 0)
+			options->rectSize = atoi(value);
+		else if (strcmp(arg, "--seed") == 0)
+			options->seed = (unsigned int)strtoul(value, NULL, 10);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->updates < 1 || options->rects < 1 || options->rectSize < 1) {
+		fprintf(stderr, "Updates, rectangles and rectangle size must be at least 1\n");
+		return false;
+	}
+	if (options->seed == 0)
+		options->seed = 1; // xorshift would stay at 0
+	return true;
+}
+
+////
+// Dirty rectangle benchmark entry point, argv[0] is "--dirty".
+// Repeatedly paints random rectangles into the input and brings the kept output up to date with
+// reblurDirtyRects, comparing its time with blurring the whole image again and checking that both
+// give the same output.
+// Returns 0 if every update matched the full blur, 2 if one didn't, 1 on other errors.
+////
+int runDirtyBenchmark(int argc, char** argv)
+{
+	DirtyOptions options;
+	if (!parseDirtyOptions(argc, argv, &options)) {
+		printDirtyUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	int imageW, imageH;
+	float* inPixels = loadFloatImage(options.image, &imageW, &imageH);
+	if (inPixels == NULL)
+		return 1;
+	printf("Loaded %dx%d image.\n", imageW, imageH);
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+
+	int pitch = imageW * 4;
+	std::vector<unsigned char> kept((size_t)pitch * imageH);
+	std::vector<unsigned char> full((size_t)pitch * imageH);
+	convolveImageCPU(inPixels, &kept[0], pitch, imageW, imageH, &mask);
+
+	printf("Updating %s (%dx%d), mask %dx%d sigma %g: %d updates of %d rectangles up to %dx%d.\n", options.image, imageW,
+		imageH, mask.size, mask.size, mask.stdv, options.updates, options.rects, options.rectSize, options.rectSize);
+	unsigned int state = options.seed;
+	std::vector<BlurRect> dirty(options.rects);
+	std::vector<double> dirtyMs, fullMs;
+	long long convolved = 0;
+	int mismatches = 0;
+	for (int u = 0; u < options.updates; u++) {
+		for (int r = 0; r < options.rects; r++) {
+			BlurRect& rect = dirty[r];
+			rect.w = 1 + nextRandom(&state) % options.rectSize;
+			rect.h = 1 + nextRandom(&state) % options.rectSize;
+			rect.x = nextRandom(&state) % imageW;
+			rect.y = nextRandom(&state) % imageH;
+			float colour[3] = { (float)(nextRandom(&state) % 256), (float)(nextRandom(&state) % 256), (float)(nextRandom(&state) % 256) };
+			for (int y = rect.y; y < std::min(rect.y + rect.h, imageH); y++) {
+				for (int x = rect.x; x < std::min(rect.x + rect.w, imageW); x++) {
+					float* pixel = inPixels + ((size_t)y * imageW + x) * 4;
+					pixel[0] = colour[0];
+					pixel[1] = colour[1];
+					pixel[2] = colour[2];
+				}
+			}
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		convolved += reblurDirtyRects(inPixels, &kept[0], pitch, imageW, imageH, &mask, &dirty[0], options.rects);
+		dirtyMs.push_back(millisecondsSince(start));
+
+		start = std::chrono::steady_clock::now();
+		convolveImageCPU(inPixels, &full[0], pitch, imageW, imageH, &mask);
+		fullMs.push_back(millisecondsSince(start));
+		if (memcmp(&kept[0], &full[0], kept.size()) != 0)
+			mismatches++;
+	}
+	free(inPixels);
+
+	std::sort(dirtyMs.begin(), dirtyMs.end());
+	std::sort(fullMs.begin(), fullMs.end());
+	double dirtyMedian = percentile(dirtyMs, 0.5);
+	double fullMedian = percentile(fullMs, 0.5);
+	printf("Re-blurred %.2f%% of the output per update on average.\n",
+		100.0 * convolved / ((double)options.updates * imageW * imageH));
+	printf("%-8s %9s %9s\n", "", "median", "p95");
+	printf("%-8s %7.3fms %7.3fms\n", "dirty", dirtyMedian, percentile(dirtyMs, 0.95));
+	printf("%-8s %7.3fms %7.3fms\n", "full", fullMedian, percentile(fullMs, 0.95));
+	printf("Speedup %.1fx.\n", dirtyMedian > 0.0 ? fullMedian / dirtyMedian : 0.0);
+	if (mismatches > 0) {
+		printf("FAILED: %d of %d updates differ from blurring the whole image.\n", mismatches, options.updates);
+		return 2;
+	}
+	printf("Every update matches blurring the whole image.\n");
+	return 0;
+}
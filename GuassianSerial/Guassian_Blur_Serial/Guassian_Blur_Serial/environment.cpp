@@ -0,0 +1,362 @@
+#include "environment.h"
+#include "json.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/utsname.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <powrprof.h>
+#include <intrin.h>
+#pragma comment(lib, "PowrProf.lib")
+#endif
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Write a list of CPU numbers compactly, runs of consecutive CPUs as a range ("0-3,8,10-11").
+////
+static std::string formatCpuList(const std::vector<int>& cpus)
+{
+	std::string list;
+	char text[32];
+	for (size_t i = 0; i < cpus.size(); ) {
+		size_t last = i;
+		while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1)
+			last++;
+		if (last == i)
+			sprintf(text, "%s%d", list.empty() ? "" : ",", cpus[i]);
+		else
+			sprintf(text, "%s%d-%d", list.empty() ? "" : ",", cpus[i], cpus[last]);
+		list += text;
+		i = last + 1;
+	}
+	return list.empty() ? "unknown" : list;
+}
+
+////
+// The compiler and the build settings that can be seen through predefined macros
+// (the actual command line isn't available to the program).
+////
+static void describeCompiler(Environment* environment)
+{
+	char text[256];
+#if defined(_MSC_VER)
+	sprintf(text, "MSVC %d", _MSC_FULL_VER);
+#elif defined(__clang__)
+	sprintf(text, "clang %s", __clang_version__);
+#elif defined(__GNUC__)
+	sprintf(text, "GCC %s", __VERSION__);
+#else
+	sprintf(text, "unknown");
+#endif
+	environment->compiler = text;
+
+	std::string flags;
+#if defined(_DEBUG) || (!defined(NDEBUG) && !defined(__OPTIMIZE__))
+	flags += "debug";
+#else
+	flags += "optimized";
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+	flags += " x64";
+#elif defined(_M_IX86) || defined(__i386__)
+	flags += " x86";
+#elif defined(_M_ARM64) || defined(__aarch64__)
+	flags += " arm64";
+#endif
+#if defined(__AVX512F__)
+	flags += " avx512f";
+#endif
+#if defined(__AVX2__)
+	flags += " avx2";
+#elif defined(__AVX__)
+	flags += " avx";
+#elif defined(__SSE4_2__)
+	flags += " sse4.2";
+#endif
+#if defined(__FMA__)
+	flags += " fma";
+#endif
+#if defined(__FAST_MATH__) || defined(_M_FP_FAST)
+	flags += " fast-math";
+#endif
+#if defined(_OPENMP)
+	flags += " openmp";
+#endif
+	environment->compilerFlags = flags;
+}
+
+#ifdef __linux__
+
+// First line of a small text file without the newline, or "" if it can't be read.
+static std::string readFirstLine(const char* path)
+{
+	char line[256];
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return "";
+	if (fgets(line, sizeof(line), file) == NULL)
+		line[0] = '\0';
+	fclose(file);
+	line[strcspn(line, "\r\n")] = '\0';
+	return line;
+}
+
+// CPUs this process may run on.
+static std::vector<int> allowedCpus()
+{
+	std::vector<int> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set))
+				cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+void captureEnvironment(Environment* environment)
+{
+	environment->cpuModel = "unknown";
+	char line[512];
+	FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+	if (cpuinfo != NULL) {
+		while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+			const char* colon = strchr(line, ':');
+			if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+				line[strcspn(line, "\r\n")] = '\0';
+				environment->cpuModel = colon + 2;
+				break;
+			}
+		}
+		fclose(cpuinfo);
+	}
+
+	std::vector<int> cpus = allowedCpus();
+	environment->affinity = formatCpuList(cpus);
+	environment->affinityCount = (int)cpus.size();
+	environment->hardwareThreads = (int)std::thread::hardware_concurrency();
+
+	char path[128];
+	sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpus.empty() ? 0 : cpus[0]);
+	environment->governor = readFirstLine(path);
+	if (environment->governor.empty())
+		environment->governor = "unknown";
+
+	struct utsname names;
+	if (uname(&names) == 0)
+		environment->kernel = std::string(names.sysname) + " " + names.release;
+	else
+		environment->kernel = "unknown";
+
+	describeCompiler(environment);
+}
+
+////
+// Current clock averaged over the CPUs this process may run on, in MHz.
+// Uses cpufreq where the kernel exposes it, otherwise the "cpu MHz" lines of /proc/cpuinfo.
+// Returns 0 if neither is available.
+////
+double sampleCpuMHz()
+{
+	std::vector<int> cpus = allowedCpus();
+	double total = 0.0;
+	int count = 0;
+	char path[128];
+	for (size_t i = 0; i < cpus.size(); i++) {
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpus[i]);
+		std::string khz = readFirstLine(path);
+		if (!khz.empty()) {
+			total += atof(khz.c_str()) / 1000.0;
+			count++;
+		}
+	}
+	if (count > 0)
+		return total / count;
+
+	FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+	if (cpuinfo == NULL)
+		return 0.0;
+	char line[512];
+	int processor = -1;
+	while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+		const char* colon = strchr(line, ':');
+		if (colon == NULL)
+			continue;
+		if (strncmp(line, "processor", 9) == 0)
+			processor = atoi(colon + 1);
+		else if (strncmp(line, "cpu MHz", 7) == 0) {
+			for (size_t i = 0; i < cpus.size(); i++) {
+				if (cpus[i] == processor) {
+					total += atof(colon + 1);
+					count++;
+					break;
+				}
+			}
+		}
+	}
+	fclose(cpuinfo);
+	return count > 0 ? total / count : 0.0;
+}
+
+#elif defined(_WIN32)
+
+// Not in the SDK headers, documented with CallNtPowerInformation.
+struct ProcessorPowerInformation {
+	ULONG Number;
+	ULONG MaxMhz;
+	ULONG CurrentMhz;
+	ULONG MhzLimit;
+	ULONG MaxIdleState;
+	ULONG CurrentIdleState;
+};
+
+void captureEnvironment(Environment* environment)
+{
+	int registers[4];
+	char brand[49];
+	memset(brand, 0, sizeof(brand));
+	__cpuid(registers, 0x80000000);
+	if ((unsigned int)registers[0] >= 0x80000004) {
+		for (int i = 0; i < 3; i++) {
+			__cpuid(registers, 0x80000002 + i);
+			memcpy(brand + i * 16, registers, 16);
+		}
+	}
+	const char* model = brand;
+	while (*model == ' ')
+		model++;
+	environment->cpuModel = (*model != '\0') ? model : "unknown";
+
+	std::vector<int> cpus;
+	DWORD_PTR processMask, systemMask;
+	if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+		for (int cpu = 0; cpu < (int)sizeof(DWORD_PTR) * 8; cpu++) {
+			if (processMask & ((DWORD_PTR)1 << cpu))
+				cpus.push_back(cpu);
+		}
+	}
+	environment->affinity = formatCpuList(cpus);
+	environment->affinityCount = (int)cpus.size();
+	environment->hardwareThreads = (int)std::thread::hardware_concurrency();
+
+	environment->governor = "unknown";
+	GUID* scheme = NULL;
+	if (PowerGetActiveScheme(NULL, &scheme) == ERROR_SUCCESS) {
+		WCHAR name[128];
+		DWORD size = sizeof(name);
+		char text[128];
+		if (PowerReadFriendlyName(NULL, scheme, NULL, NULL, (UCHAR*)name, &size) == ERROR_SUCCESS &&
+			WideCharToMultiByte(CP_UTF8, 0, name, -1, text, sizeof(text), NULL, NULL) > 0)
+			environment->governor = text;
+		LocalFree(scheme);
+	}
+
+	// GetVersionEx lies to programs without a manifest, RtlGetVersion doesn't
+	environment->kernel = "Windows";
+	typedef LONG(WINAPI* RtlGetVersionFunction)(OSVERSIONINFOW*);
+	RtlGetVersionFunction rtlGetVersion = (RtlGetVersionFunction)GetProcAddress(GetModuleHandleA("ntdll.dll"), "RtlGetVersion");
+	OSVERSIONINFOW version;
+	memset(&version, 0, sizeof(version));
+	version.dwOSVersionInfoSize = sizeof(version);
+	if (rtlGetVersion != NULL && rtlGetVersion(&version) == 0) {
+		char text[64];
+		sprintf(text, "Windows %lu.%lu.%lu", version.dwMajorVersion, version.dwMinorVersion, version.dwBuildNumber);
+		environment->kernel = text;
+	}
+
+	describeCompiler(environment);
+}
+
+////
+// Current clock averaged over the CPUs this process may run on, in MHz.
+// Returns 0 if it isn't available.
+////
+double sampleCpuMHz()
+{
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	std::vector<ProcessorPowerInformation> power(system.dwNumberOfProcessors);
+	if (CallNtPowerInformation(ProcessorInformation, NULL, 0, &power[0], (ULONG)(power.size() * sizeof(ProcessorPowerInformation))) != 0)
+		return 0.0;
+
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+		processMask = ~(DWORD_PTR)0;
+	double total = 0.0;
+	int count = 0;
+	for (size_t i = 0; i < power.size(); i++) {
+		if (power[i].Number < sizeof(DWORD_PTR) * 8 && (processMask & ((DWORD_PTR)1 << power[i].Number))) {
+			total += power[i].CurrentMhz;
+			count++;
+		}
+	}
+	return count > 0 ? total / count : 0.0;
+}
+
+#else
+
+void captureEnvironment(Environment* environment)
+{
+	environment->cpuModel = "unknown";
+	environment->governor = "unknown";
+	environment->kernel = "unknown";
+	environment->affinity = "unknown";
+	environment->affinityCount = 0;
+	environment->hardwareThreads = (int)std::thread::hardware_concurrency();
+	describeCompiler(environment);
+}
+
+double sampleCpuMHz()
+{
+	return 0.0;
+}
+
+#endif
+
+void printEnvironment(const Environment* environment)
+{
+	printf("CPU: %s, governor %s, %s\n", environment->cpuModel.c_str(), environment->governor.c_str(), environment->kernel.c_str());
+	printf("Affinity: CPUs %s (%d of %d), built with %s (%s)\n", environment->affinity.c_str(), environment->affinityCount,
+		environment->hardwareThreads, environment->compiler.c_str(), environment->compilerFlags.c_str());
+}
+
+////
+// Write the environment as a JSON object (no trailing comma or newline).
+////
+void writeEnvironmentJSON(FILE* file, const Environment* environment)
+{
+	fprintf(file, "{\"cpu\": ");
+	writeJSONString(file, environment->cpuModel.c_str());
+	fprintf(file, ", \"governor\": ");
+	writeJSONString(file, environment->governor.c_str());
+	fprintf(file, ", \"kernel\": ");
+	writeJSONString(file, environment->kernel.c_str());
+	fprintf(file, ", \"affinity\": ");
+	writeJSONString(file, environment->affinity.c_str());
+	fprintf(file, ", \"affinity_cpus\": %d, \"hardware_threads\": %d, \"compiler\": ", environment->affinityCount, environment->hardwareThreads);
+	writeJSONString(file, environment->compiler.c_str());
+	fprintf(file, ", \"compiler_flags\": ");
+	writeJSONString(file, environment->compilerFlags.c_str());
+	fprintf(file, "}");
+}
+
+////
+// Write the environment as "# key: value" comment lines, for the top of a CSV file.
+////
+void writeEnvironmentCSV(FILE* file, const Environment* environment)
+{
+	fprintf(file, "# cpu: %s\n", environment->cpuModel.c_str());
+	fprintf(file, "# governor: %s\n", environment->governor.c_str());
+	fprintf(file, "# kernel: %s\n", environment->kernel.c_str());
+	fprintf(file, "# affinity: %s (%d of %d)\n", environment->affinity.c_str(), environment->affinityCount, environment->hardwareThreads);
+	fprintf(file, "# compiler: %s (%s)\n", environment->compiler.c_str(), environment->compilerFlags.c_str());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// What the benchmarks ran on, so results from different machines and runs can be told apart.
+// Anything that couldn't be found out is "unknown".
+////
+struct Environment {
+	std::string cpuModel;
+	std::string governor; // cpufreq governor on Linux, active power plan on Windows
+	std::string kernel; // OS name and kernel version
+	std::string affinity; // CPUs the process may run on, e.g. "0-7,16"
+	int affinityCount; // number of those CPUs
+	int hardwareThreads;
+	std::string compiler;
+	std::string compilerFlags; // build settings as seen through the predefined macros
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void captureEnvironment(Environment* environment);
+double sampleCpuMHz();
+void printEnvironment(const Environment* environment);
+void writeEnvironmentJSON(FILE* file, const Environment* environment);
+void writeEnvironmentCSV(FILE* file, const Environment* environment);
@@ -0,0 +1,474 @@
+#include "golden.h"
+#include "bench.h"
+#include "image.h"
+#include "json.h"
+#include "validate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_STORE = "golden.json";
+static const char* DEFAULT_IMAGES = "synth:noise:720p,synth:edges:720p,synth:gradient:720p";
+static const char* DEFAULT_MASKS = "3,7,13";
+static const char* DEFAULT_SIGMAS = "1,5,20";
+// Border mode of every backend in this build (get1dIndex clamps to the nearest edge pixel).
+static const char* BORDER_MODE = "clamp";
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for recording or checking golden outputs, filled in from the command line.
+////
+struct GoldenOptions {
+	bool record; // record references instead of checking against them
+	const char* storePath;
+	std::vector<std::string> images;
+	std::vector<int> masks;
+	std::vector<float> sigmas;
+	const Backend* reference; // backend the references are recorded with
+	std::vector<const Backend*> backends; // backends to check
+	int threads;
+	int downsample; // store a reference image shrunk by this factor, 0 for hashes only
+	int tolerance; // per channel tolerance when falling back to the reference image
+	double maxBadPercent;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// 64 bit FNV-1a hash of an 8-bit RGBA image, row by row so the pitch (padding) doesn't change it.
+////
+unsigned long long hashPixels(const unsigned char* pixels, int pitch, int imageW, int imageH)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (int y = 0; y < imageH; y++) {
+		const unsigned char* row = pixels + (size_t)y * pitch;
+		for (int i = 0; i < imageW * 4; i++) {
+			hash ^= row[i];
+			hash *= 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+////
+// Shrink an 8-bit RGBA image by averaging factor x factor blocks (partial blocks at the right and bottom edge
+// average what they have). Returns a malloc'd image with pitch outW * 4, free with free(), or NULL if there
+// isn't enough memory.
+////
+unsigned char* downsamplePixels(const unsigned char* pixels, int pitch, int imageW, int imageH, int factor, int* outW, int* outH)
+{
+	*outW = (imageW + factor - 1) / factor;
+	*outH = (imageH + factor - 1) / factor;
+	unsigned char* out = (unsigned char*)malloc((size_t)*outW * *outH * 4);
+	if (out == NULL)
+		return NULL;
+	for (int by = 0; by < *outH; by++) {
+		for (int bx = 0; bx < *outW; bx++) {
+			int sums[4] = { 0, 0, 0, 0 };
+			int count = 0;
+			for (int y = by * factor; y < by * factor + factor && y < imageH; y++) {
+				const unsigned char* row = pixels + (size_t)y * pitch;
+				for (int x = bx * factor; x < bx * factor + factor && x < imageW; x++) {
+					for (int c = 0; c < 4; c++)
+						sums[c] += row[x * 4 + c];
+					count++;
+				}
+			}
+			unsigned char* outPixel = out + ((size_t)by * *outW + bx) * 4;
+			for (int c = 0; c < 4; c++)
+				outPixel[c] = (unsigned char)((sums[c] + count / 2) / count);
+		}
+	}
+	return out;
+}
+
+// Directory part of a path including the trailing separator, empty if there is none.
+static std::string directoryOf(const char* path)
+{
+	const char* slash = strrchr(path, '/');
+	const char* backslash = strrchr(path, '\\');
+	if (backslash != NULL && (slash == NULL || backslash > slash))
+		slash = backslash;
+	return slash == NULL ? std::string() : std::string(path, slash + 1);
+}
+
+// Index of the entry for a combination, or -1.
+static int findEntry(const std::vector<GoldenEntry>& entries, const std::string& image, int maskSize, float stdv, const char* border)
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		const GoldenEntry& entry = entries[i];
+		if (entry.image == image && entry.maskSize == maskSize && fabs(entry.stdv - stdv) < 1e-6f && entry.border == border)
+			return (int)i;
+	}
+	return -1;
+}
+
+////
+// Read a golden store. A store that doesn't exist yet reads as empty.
+// Returns false (after printing why) if the store exists but can't be parsed.
+////
+static bool loadGoldenStore(const char* path, std::vector<GoldenEntry>* entries)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return true;
+	fclose(file);
+
+	JsonValue document;
+	if (!readJSONFile(path, &document))
+		return false;
+	const JsonValue* list = findMember(&document, "golden");
+	if (list == NULL || list->type != JSON_ARRAY) {
+		fprintf(stderr, "%s is not a golden output store\n", path);
+		return false;
+	}
+	for (size_t i = 0; i < list->items.size(); i++) {
+		const JsonValue* item = &list->items[i];
+		const JsonValue* image = findMember(item, "image");
+		const JsonValue* border = findMember(item, "border");
+		const JsonValue* reference = findMember(item, "reference");
+		const JsonValue* hash = findMember(item, "hash");
+		const JsonValue* referenceImage = findMember(item, "reference_image");
+		if (image == NULL || image->type != JSON_STRING || hash == NULL || hash->type != JSON_STRING)
+			continue;
+
+		GoldenEntry entry;
+		entry.image = image->text;
+		entry.imageW = (int)memberNumber(item, "width", 0);
+		entry.imageH = (int)memberNumber(item, "height", 0);
+		entry.maskSize = (int)memberNumber(item, "mask", 0);
+		entry.stdv = (float)memberNumber(item, "sigma", 0);
+		entry.border = (border != NULL && border->type == JSON_STRING) ? border->text : BORDER_MODE;
+		entry.reference = (reference != NULL && reference->type == JSON_STRING) ? reference->text : "";
+		entry.hash = strtoull(hash->text.c_str(), NULL, 16);
+		entry.downsample = (int)memberNumber(item, "downsample", 0);
+		entry.referenceImage = (referenceImage != NULL && referenceImage->type == JSON_STRING) ? referenceImage->text : "";
+		entries->push_back(entry);
+	}
+	return true;
+}
+
+////
+// Write every entry to the store.
+// Returns false (after printing why) if the file could not be written.
+////
+static bool saveGoldenStore(const char* path, const std::vector<GoldenEntry>& entries)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	fprintf(file, "{\n  \"golden\": [\n");
+	for (size_t i = 0; i < entries.size(); i++) {
+		const GoldenEntry& e = entries[i];
+		fprintf(file, "    {\"image\": ");
+		writeJSONString(file, e.image.c_str());
+		// %.9g so any float sigma reads back as the same value
+		fprintf(file, ", \"width\": %d, \"height\": %d, \"mask\": %d, \"sigma\": %.9g, \"border\": ", e.imageW, e.imageH, e.maskSize, e.stdv);
+		writeJSONString(file, e.border.c_str());
+		fprintf(file, ", \"reference\": ");
+		writeJSONString(file, e.reference.c_str());
+		fprintf(file, ", \"hash\": \"%016llx\", \"downsample\": %d, \"reference_image\": ", e.hash, e.downsample);
+		if (e.referenceImage.empty())
+			fprintf(file, "null");
+		else
+			writeJSONString(file, e.referenceImage.c_str());
+		fprintf(file, "}%s\n", i + 1 < entries.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	printf("Wrote %s.\n", path);
+	return true;
+}
+
+////
+// Save a tightly packed 8-bit RGBA image as a PNG.
+////
+static bool savePixels(const unsigned char* pixels, int imageW, int imageH, const char* path)
+{
+	SDL_Surface* surface = createResultSurface(imageW, imageH);
+	for (int y = 0; y < imageH; y++)
+		memcpy((unsigned char*)surface->pixels + (size_t)y * surface->pitch, pixels + (size_t)y * imageW * 4, (size_t)imageW * 4);
+	bool saved = saveImage(surface, path);
+	SDL_FreeSurface(surface);
+	return saved;
+}
+
+////
+// Check one backend's output against a recorded entry: the hash first, then the reference image if it differs.
+// Returns true if it matches exactly or within the tolerance.
+////
+static bool checkAgainstEntry(const GoldenOptions* options, const GoldenEntry* entry, const unsigned char* pixels, int imageW, int imageH, const char** how)
+{
+	if (hashPixels(pixels, imageW * 4, imageW, imageH) == entry->hash) {
+		*how = "hash matches";
+		return true;
+	}
+	if (entry->referenceImage.empty() || entry->downsample < 1) {
+		*how = "hash differs, no reference image to compare with";
+		return false;
+	}
+
+	std::string path = directoryOf(options->storePath) + entry->referenceImage;
+	SDL_Surface* reference = loadImage(path.c_str());
+	if (reference == NULL) {
+		*how = "hash differs, reference image missing";
+		return false;
+	}
+	int smallW, smallH;
+	unsigned char* small = downsamplePixels(pixels, imageW * 4, imageW, imageH, entry->downsample, &smallW, &smallH);
+	bool matches = false;
+	if (small == NULL) {
+		*how = "hash differs, not enough memory to compare with the reference image";
+	}
+	else if (reference->w != smallW || reference->h != smallH) {
+		*how = "hash differs, reference image has the wrong size";
+	}
+	else {
+		ErrorStats stats;
+		compareImages(small, smallW * 4, (unsigned char*)reference->pixels, reference->pitch, smallW, smallH, options->tolerance, options->threads, &stats);
+		matches = 100.0 * stats.badPixels / stats.pixels <= options->maxBadPercent;
+		*how = matches ? "hash differs, within tolerance of the reference image" : "hash differs, reference image doesn't match";
+		printErrorStats(&stats, options->tolerance);
+	}
+	free(small);
+	SDL_FreeSurface(reference);
+	return matches;
+}
+
+static void printGoldenUsage(const char* program)
+{
+	printf("Usage: %s --golden <record|check> [options]\n", program);
+	printf("  --store <file>      golden output store (default %s), reference images are kept next to it\n", DEFAULT_STORE);
+	printf("  --images <list>     comma separated images to blur (default %s)\n", DEFAULT_IMAGES);
+	printf("  --masks <list>      comma separated mask widths (default %s)\n", DEFAULT_MASKS);
+	printf("  --sigmas <list>     comma separated blur strengths (default %s)\n", DEFAULT_SIGMAS);
+	printf("  --threads <n>       threads for multithreaded backends (default %d)\n", defaultThreadCount());
+	printf("record:\n");
+	printf("  --reference <name>  backend to record (default %s)\n", backends[0].name);
+	printf("  --downsample <n>    also store the reference shrunk n times as a PNG, 0 for hashes only (default 4)\n");
+	printf("check:\n");
+	printf("  --backends <list>   comma separated backends to check (default all exact ones)\n");
+	printf("  --tolerance <n>     per channel tolerance against the reference image when the hash differs (default 1)\n");
+	printf("  --max-bad <pct>     percentage of (downsampled) pixels allowed beyond the tolerance (default 0)\n");
+	printf("check exits with code 2 if any backend doesn't match.\n");
+}
+
+////
+// Read the golden command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseGoldenOptions(int argc, char** argv, GoldenOptions* options)
+{
+	if (argc < 2 || (strcmp(argv[1], "record") != 0 && strcmp(argv[1], "check") != 0))
+		return false;
+	options->record = (strcmp(argv[1], "record") == 0);
+
+	const char* images = DEFAULT_IMAGES;
+	const char* masks = DEFAULT_MASKS;
+	const char* sigmas = DEFAULT_SIGMAS;
+	const char* backendList = NULL;
+	options->storePath = DEFAULT_STORE;
+	options->reference = &backends[0];
+	options->threads = defaultThreadCount();
+	options->downsample = 4;
+	options->tolerance = 1;
+	options->maxBadPercent = 0.0;
+
+	for (int i = 2; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--store") == 0)
+			options->storePath = value;
+		else if (strcmp(arg, "--images") == 0)
+			images = value;
+		else if (strcmp(arg, "--masks") == 0)
+			masks = value;
+		else if (strcmp(arg, "--sigmas") == 0)
+			sigmas = value;
+		else if (strcmp(arg, "--backends") == 0)
+			backendList = value;
+		else if (strcmp(arg, "--reference") == 0) {
+			options->reference = findBackend(value);
+			if (options->reference == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--downsample") == 0)
+			options->downsample = atoi(value);
+		else if (strcmp(arg, "--tolerance") == 0)
+			options->tolerance = atoi(value);
+		else if (strcmp(arg, "--max-bad") == 0)
+			options->maxBadPercent = atof(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->threads < 1 || options->downsample < 0 || options->tolerance < 0 || options->maxBadPercent < 0.0) {
+		fprintf(stderr, "Threads must be at least 1, downsample, tolerance and max-bad at least 0\n");
+		return false;
+	}
+
+	options->images = splitList(images);
+	if (!parseMaskList(masks, &options->masks) || !parseSigmaList(sigmas, &options->sigmas))
+		return false;
+	if (backendList == NULL) {
+		for (int i = 0; i < backendCount; i++) {
+			if (backends[i].exact)
+				options->backends.push_back(&backends[i]);
+		}
+	}
+	else if (!parseBackendList(backendList, &options->backends)) {
+		return false;
+	}
+
+	if (options->images.empty() || options->masks.empty() || options->sigmas.empty()) {
+		fprintf(stderr, "Nothing to do\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Golden output mode entry point, argv[0] is "--golden", argv[1] "record" or "check".
+// record blurs every image, mask and sigma with the reference backend and stores the hash of the output
+// (plus a downsampled copy). check blurs them with every backend and compares against the store, so the
+// slow reference never has to run again.
+// Returns 0 if everything matched (or was recorded), 2 if a check failed, 1 for any other failure.
+////
+int runGolden(int argc, char** argv)
+{
+	GoldenOptions options;
+	if (!parseGoldenOptions(argc, argv, &options)) {
+		printGoldenUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	std::vector<GoldenEntry> entries;
+	if (!loadGoldenStore(options.storePath, &entries))
+		return 1;
+	if (!options.record && entries.empty()) {
+		fprintf(stderr, "%s has no golden outputs, run --golden record first\n", options.storePath);
+		return 1;
+	}
+
+	int failures = 0;
+	int checks = 0;
+	int skipped = 0; // images there wasn't enough memory to blur
+	for (size_t i = 0; i < options.images.size(); i++) {
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.images[i].c_str(), &imageW, &imageH);
+		if (floatPixels == NULL)
+			return 1;
+		unsigned char* outPixels = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		if (outPixels == NULL) {
+			fprintf(stderr, "Not enough memory to blur %s, skipping it\n", options.images[i].c_str());
+			free(floatPixels);
+			skipped++;
+			continue;
+		}
+
+		for (size_t m = 0; m < options.masks.size(); m++) {
+			for (size_t s = 0; s < options.sigmas.size(); s++) {
+				ConvMask mask;
+				generateGuassianKernel(&mask, options.masks[m], options.sigmas[s]);
+				int index = findEntry(entries, options.images[i], mask.size, mask.stdv, BORDER_MODE);
+
+				if (options.record) {
+					GoldenEntry entry;
+					entry.image = options.images[i];
+					entry.imageW = imageW;
+					entry.imageH = imageH;
+					entry.maskSize = mask.size;
+					entry.stdv = mask.stdv;
+					entry.border = BORDER_MODE;
+					entry.reference = options.reference->name;
+					options.reference->convolve(floatPixels, outPixels, imageW * 4, imageW, imageH, &mask, options.threads);
+					entry.hash = hashPixels(outPixels, imageW * 4, imageW, imageH);
+					entry.downsample = options.downsample;
+					if (options.downsample > 0) {
+						char name[64];
+						sprintf(name, "golden_%016llx_%d.png", entry.hash, options.downsample);
+						entry.referenceImage = name;
+						int smallW, smallH;
+						unsigned char* small = downsamplePixels(outPixels, imageW * 4, imageW, imageH, options.downsample, &smallW, &smallH);
+						if (small == NULL) {
+							fprintf(stderr, "Not enough memory for the reference image of %s\n", options.images[i].c_str());
+							return 1;
+						}
+						bool saved = savePixels(small, smallW, smallH, (directoryOf(options.storePath) + name).c_str());
+						free(small);
+						if (!saved)
+							return 1;
+					}
+					printf("%s mask %dx%d sigma %g: %016llx\n", entry.image.c_str(), mask.size, mask.size, mask.stdv, entry.hash);
+					if (index >= 0)
+						entries[index] = entry;
+					else
+						entries.push_back(entry);
+					continue;
+				}
+
+				if (index < 0) {
+					printf("%s mask %dx%d sigma %g: not recorded\n", options.images[i].c_str(), mask.size, mask.size, mask.stdv);
+					failures++;
+					checks++;
+					continue;
+				}
+				for (size_t b = 0; b < options.backends.size(); b++) {
+					const Backend* backend = options.backends[b];
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					backend->convolve(floatPixels, outPixels, imageW * 4, imageW, imageH, &mask, options.threads);
+					std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+					const char* how;
+					bool passed = (entries[index].imageW == imageW && entries[index].imageH == imageH);
+					if (passed)
+						passed = checkAgainstEntry(&options, &entries[index], outPixels, imageW, imageH, &how);
+					else
+						how = "image size differs from the recorded one";
+					std::chrono::steady_clock::time_point checked = std::chrono::steady_clock::now();
+					checks++;
+					if (!passed)
+						failures++;
+					printf("%s mask %dx%d sigma %g: %s %s (%s; blur %.1fms, check %.1fms)\n", options.images[i].c_str(), mask.size, mask.size,
+						mask.stdv, backend->name, passed ? "ok" : "FAILED", how,
+						std::chrono::duration<double, std::milli>(end - start).count(),
+						std::chrono::duration<double, std::milli>(checked - end).count());
+				}
+			}
+		}
+
+		free(outPixels);
+		free(floatPixels);
+	}
+
+	if (!options.record)
+		printf("\n%d of %d checks passed.\n", checks - failures, checks);
+	if (skipped > 0)
+		printf("%d image%s skipped.\n", skipped, skipped == 1 ? "" : "s");
+	if (options.record)
+		return (saveGoldenStore(options.storePath, entries) && skipped == 0) ? 0 : 1;
+	if (failures > 0)
+		return 2;
+	return skipped > 0 ? 1 : 0;
+}
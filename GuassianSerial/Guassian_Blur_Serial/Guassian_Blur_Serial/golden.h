@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Recorded reference output of one (image, mask, sigma, border mode) combination.
+////
+struct GoldenEntry {
+	std::string image;
+	int imageW, imageH;
+	int maskSize;
+	float stdv;
+	std::string border; // how pixels outside the image are read, only "clamp" exists so far
+	std::string reference; // backend that produced it
+	unsigned long long hash; // hashPixels of the full 8-bit RGBA output
+	int downsample; // factor the reference image was shrunk by, 0 if none was stored
+	std::string referenceImage; // file name of the downsampled reference (next to the store), empty if none
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+unsigned long long hashPixels(const unsigned char* pixels, int pitch, int imageW, int imageH);
+unsigned char* downsamplePixels(const unsigned char* pixels, int pitch, int imageW, int imageH, int factor, int* outW, int* outH);
+int runGolden(int argc, char** argv);
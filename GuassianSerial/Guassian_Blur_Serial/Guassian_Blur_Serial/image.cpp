@@ -0,0 +1,170 @@
+#include "image.h"
+#include "synthetic.h"
+#include "stagetimer.h"
+#include "SDL_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+////
+// Load an image and convert it to a 32 bit RGBA surface. Prints nothing on success (batch decoders call it for
+// every image), single image callers report the size themselves.
+// Returns NULL (after printing why) if the image could not be loaded.
+////
+SDL_Surface* loadImage(const char* path)
+{
+	SDL_Surface* image;
+	{
+		StageTimer timer("load");
+		image = IMG_Load(path);
+	}
+	if (image == NULL) {
+		fprintf(stderr, "Could not load %s: %s\n", path, IMG_GetError());
+		return NULL;
+	}
+	// Copy to a new surface so that we know the format (32 bit RGBA).
+	StageTimer timer("convert");
+	SDL_Surface* surface = createResultSurface(image->w, image->h);
+	if (surface == NULL) {
+		fprintf(stderr, "Could not convert %s: %s\n", path, SDL_GetError());
+		SDL_FreeSurface(image);
+		return NULL;
+	}
+	SDL_BlitSurface(image, NULL, surface, NULL);
+	SDL_FreeSurface(image);
+	return surface;
+}
+
+////
+// Write a 32 bit RGBA surface without SDL_image.
+// raw: tightly packed RGBA rows with no header, otherwise a binary PPM (P6, the alpha is dropped).
+// Returns 0 on success, -1 (with the reason in SDL_GetError) otherwise.
+////
+static int saveUncompressed(SDL_Surface* surface, const char* path, bool raw)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return SDL_SetError("could not open the file");
+	if (!raw)
+		fprintf(file, "P6\n%d %d\n255\n", surface->w, surface->h);
+	std::vector<unsigned char> row(surface->w * 3);
+	bool written = true;
+	for (int y = 0; y < surface->h && written; y++) {
+		const unsigned char* pixels = (const unsigned char*)surface->pixels + y * surface->pitch;
+		if (raw) {
+			written = fwrite(pixels, 4, surface->w, file) == (size_t)surface->w;
+			continue;
+		}
+		for (int x = 0; x < surface->w; x++) {
+			row[x * 3 + 0] = pixels[x * 4 + 0];
+			row[x * 3 + 1] = pixels[x * 4 + 1];
+			row[x * 3 + 2] = pixels[x * 4 + 2];
+		}
+		written = fwrite(&row[0], 3, surface->w, file) == (size_t)surface->w;
+	}
+	if (fclose(file) != 0 || !written)
+		return SDL_SetError("could not write the file");
+	return 0;
+}
+
+////
+// Save a surface, the format is picked from the file extension (.png, .jpg/.jpeg, .bmp, .ppm or .raw).
+// .ppm and .raw are written directly and are much faster to write than the compressed formats.
+// Nothing is printed on success, batch and async modes save thousands of images on several threads.
+// Returns false (after printing why) if the image could not be saved.
+////
+bool saveImage(SDL_Surface* surface, const char* path)
+{
+	StageTimer timer("save");
+	const char* extension = strrchr(path, '.');
+	int result;
+	if (extension != NULL && (SDL_strcasecmp(extension, ".jpg") == 0 || SDL_strcasecmp(extension, ".jpeg") == 0))
+		result = IMG_SaveJPG(surface, path, 95);
+	else if (extension != NULL && SDL_strcasecmp(extension, ".bmp") == 0)
+		result = SDL_SaveBMP(surface, path);
+	else if (extension != NULL && SDL_strcasecmp(extension, ".ppm") == 0)
+		result = saveUncompressed(surface, path, false);
+	else if (extension != NULL && SDL_strcasecmp(extension, ".raw") == 0)
+		result = saveUncompressed(surface, path, true);
+	else
+		result = IMG_SavePNG(surface, path);
+
+	if (result != 0) {
+		fprintf(stderr, "Could not save %s: %s\n", path, SDL_GetError());
+		return false;
+	}
+	return true;
+}
+
+////
+// Copy the pixels of a 32 bit RGBA surface into a newly malloc'd float array.
+// contains the RGBA values for every pixel repeeated over and over.
+// Note: stored in row major order, free with free()
+// Returns NULL (after printing why) if there isn't enough memory.
+////
+float* surfaceToFloatPixels(SDL_Surface* surface)
+{
+	StageTimer timer("to float");
+	size_t imageSize = (size_t)surface->w * surface->h;
+	float* floatPixels = (float*)malloc(4 * imageSize * sizeof(float));
+	if (floatPixels == NULL) {
+		fprintf(stderr, "Not enough memory for a %dx%d image\n", surface->w, surface->h);
+		return NULL;
+	}
+
+	// Copy surface data (image)
+	for (int y = 0; y < surface->h; y++) {
+		unsigned char* surfacePixels = (unsigned char*)surface->pixels + y * surface->pitch;
+		float* row = floatPixels + y * surface->w * 4;
+		for (int x = 0; x < surface->w; x++) {
+			row[x * 4 + 0] = ((float)surfacePixels[x * 4 + 0]);
+			row[x * 4 + 1] = ((float)surfacePixels[x * 4 + 1]);
+			row[x * 4 + 2] = ((float)surfacePixels[x * 4 + 2]);
+			row[x * 4 + 3] = ((float)surfacePixels[x * 4 + 3]);
+		}
+	}
+	return floatPixels;
+}
+
+////
+// Load an image straight into a malloc'd float array (see surfaceToFloatPixels).
+// If path is a synthetic spec (synth:<pattern>:<size>[:<seed>]) the image is generated instead, no file is read.
+// Returns NULL (after printing why) if the image could not be loaded.
+////
+float* loadFloatImage(const char* path, int* imageW, int* imageH)
+{
+	if (isSyntheticSpec(path)) {
+		SyntheticSpec spec;
+		if (!parseSyntheticSpec(path, &spec))
+			return NULL;
+		float* floatPixels;
+		{
+			StageTimer timer("synthesize");
+			floatPixels = generateSyntheticImage(&spec);
+		}
+		if (floatPixels == NULL)
+			return NULL;
+		*imageW = spec.imageW;
+		*imageH = spec.imageH;
+		return floatPixels;
+	}
+
+	SDL_Surface* surface = loadImage(path);
+	if (surface == NULL)
+		return NULL;
+	float* floatPixels = surfaceToFloatPixels(surface);
+	*imageW = surface->w;
+	*imageH = surface->h;
+	SDL_FreeSurface(surface);
+	return floatPixels;
+}
+
+////
+// Create an empty 32 bit RGBA surface, the format every backend writes.
+////
+SDL_Surface* createResultSurface(int imageW, int imageH)
+{
+	return SDL_CreateRGBSurface(0, imageW, imageH, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+}
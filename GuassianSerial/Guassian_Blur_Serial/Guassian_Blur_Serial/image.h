@@ -0,0 +1,12 @@
+#pragma once
+
+#include "SDL.h"
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Loading and saving images, none of these need SDL video to be initialized.
+
+SDL_Surface* loadImage(const char* path);
+bool saveImage(SDL_Surface* surface, const char* path);
+float* surfaceToFloatPixels(SDL_Surface* surface);
+float* loadFloatImage(const char* path, int* imageW, int* imageH);
+SDL_Surface* createResultSurface(int imageW, int imageH);
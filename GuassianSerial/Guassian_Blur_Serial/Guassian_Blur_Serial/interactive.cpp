@@ -0,0 +1,442 @@
+#include "interactive.h"
+#include "bench.h"
+#include "blur.h"
+#include "image.h"
+#include "SDL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGE = "4k.jpg";
+// Size of the window, the preview is blurred at this resolution (or the image's, if it's smaller).
+static const int WINDOW_WIDTH = 1280;
+static const int WINDOW_HEIGHT = 720;
+// Left and right arrow keys divide or multiply sigma by this.
+static const float SIGMA_STEP = 1.25f;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for an interactive session, filled in from the command line.
+////
+struct InteractiveOptions {
+	const char* inputPath;
+	int maskSize; // starting mask width
+	float stdv; // starting strength of the blur
+	int threads; // threads for the preview and for the full-resolution blur
+};
+
+////
+// The full-resolution blur, run on a background thread. Each change of settings is a new generation:
+// requesting one cancels the blur in progress and the thread starts again with the new mask.
+////
+struct Refiner {
+	float* inPixels;
+	int imageW, imageH;
+	int threads;
+	Uint32 doneEvent; // pushed with the generation as its code when a result is ready
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<bool> cancel; // set when the blur in progress is out of date
+	// the rest is guarded by mutex
+	bool quit;
+	int requested; // latest generation asked for
+	int started; // generation the thread last picked up
+	ConvMask mask; // mask of the requested generation
+	std::vector<unsigned char> result; // latest finished blur, imageW * 4 bytes per row
+	int finished; // generation of result, 0 for none
+	double finishedMs;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Body of the refinement thread: blur the latest requested generation at full resolution, giving up as
+// soon as a newer one is requested, until told to quit.
+////
+static void refineLoop(Refiner* refiner)
+{
+	std::vector<unsigned char> working(refiner->result.size());
+	for (;;) {
+		ConvMask mask;
+		int generation;
+		{
+			std::unique_lock<std::mutex> lock(refiner->mutex);
+			refiner->wake.wait(lock, [refiner] { return refiner->quit || refiner->requested != refiner->started; });
+			if (refiner->quit)
+				break;
+			generation = refiner->requested;
+			mask = refiner->mask;
+			refiner->started = generation;
+			refiner->cancel = false;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool complete = convolveImageCPUCancellable(refiner->inPixels, &working[0], refiner->imageW * 4, refiner->imageW,
+			refiner->imageH, &mask, refiner->threads, &refiner->cancel);
+		double ms = millisecondsSince(start);
+		if (!complete) {
+			printf("Full resolution mask %dx%d sigma %g cancelled after %.1fms.\n", mask.size, mask.size, mask.stdv, ms);
+			continue;
+		}
+		printf("Full resolution mask %dx%d sigma %g took %.1fms.\n", mask.size, mask.size, mask.stdv, ms);
+		{
+			std::lock_guard<std::mutex> lock(refiner->mutex);
+			refiner->result.swap(working);
+			refiner->finished = generation;
+			refiner->finishedMs = ms;
+		}
+		SDL_Event event;
+		SDL_zero(event);
+		event.type = refiner->doneEvent;
+		event.user.code = generation;
+		SDL_PushEvent(&event);
+	}
+}
+
+// Start a full-resolution blur with mask, cancelling the one in progress.
+static void requestRefinement(Refiner* refiner, int generation, const ConvMask* mask)
+{
+	std::lock_guard<std::mutex> lock(refiner->mutex);
+	refiner->requested = generation;
+	refiner->mask = *mask;
+	refiner->cancel = true;
+	refiner->wake.notify_one();
+}
+
+////
+// Shrink an image to previewW x previewH by averaging the pixels each preview pixel covers.
+// Returns a malloc'd RGBA float buffer.
+////
+static float* downsampleFloatPixels(const float* pixels, int imageW, int imageH, int previewW, int previewH)
+{
+	float* preview = (float*)malloc((size_t)previewW * previewH * 4 * sizeof(float));
+	for (int py = 0; py < previewH; py++) {
+		int y0 = (int)((long long)py * imageH / previewH);
+		int y1 = std::max(y0 + 1, (int)((long long)(py + 1) * imageH / previewH));
+		for (int px = 0; px < previewW; px++) {
+			int x0 = (int)((long long)px * imageW / previewW);
+			int x1 = std::max(x0 + 1, (int)((long long)(px + 1) * imageW / previewW));
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int y = y0; y < y1; y++) {
+				const float* row = pixels + ((size_t)y * imageW + x0) * 4;
+				for (int x = 0; x < (x1 - x0) * 4; x++)
+					sum[x % 4] += row[x];
+			}
+			float count = (float)((x1 - x0) * (y1 - y0));
+			float* out = preview + ((size_t)py * previewW + px) * 4;
+			for (int c = 0; c < 4; c++)
+				out[c] = sum[c] / count;
+		}
+	}
+	return preview;
+}
+
+////
+// Shrink an 8-bit RGBA image into out (outW x outH, tightly packed) by averaging, like downsampleFloatPixels.
+////
+static void downsampleBytePixels(const unsigned char* pixels, int imageW, int imageH, unsigned char* out, int outW, int outH)
+{
+	for (int oy = 0; oy < outH; oy++) {
+		int y0 = (int)((long long)oy * imageH / outH);
+		int y1 = std::max(y0 + 1, (int)((long long)(oy + 1) * imageH / outH));
+		for (int ox = 0; ox < outW; ox++) {
+			int x0 = (int)((long long)ox * imageW / outW);
+			int x1 = std::max(x0 + 1, (int)((long long)(ox + 1) * imageW / outW));
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+			for (int y = y0; y < y1; y++) {
+				const unsigned char* row = pixels + ((size_t)y * imageW + x0) * 4;
+				for (int x = 0; x < (x1 - x0) * 4; x++)
+					sum[x % 4] += row[x];
+			}
+			unsigned int count = (unsigned int)((x1 - x0) * (y1 - y0));
+			unsigned char* pixel = out + ((size_t)oy * outW + ox) * 4;
+			for (int c = 0; c < 4; c++)
+				pixel[c] = (unsigned char)((sum[c] + count / 2) / count);
+		}
+	}
+}
+
+////
+// Mask that looks, on an image shrunk by scale, like maskSize and stdv do on the full image.
+////
+static void generatePreviewKernel(ConvMask* preview, int maskSize, float stdv, float scale)
+{
+	int offset = (int)floorf((maskSize - 1) / 2 * scale + 0.5f);
+	generateGuassianKernel(preview, 2 * offset + 1, std::max(stdv * scale, 0.01f));
+}
+
+static void printInteractiveUsage(const char* program)
+{
+	printf("Usage: %s --interactive [options]\n", program);
+	printf("  --input <image>   image to blur (default %s)\n", DEFAULT_IMAGE);
+	printf("  --mask <n>        starting mask width (default 5)\n");
+	printf("  --sigma <f>       starting strength of the blur (default 5)\n");
+	printf("  --threads <n>     threads to blur with (default %d)\n", defaultThreadCount());
+	printf("Keys: up/down change the mask width, left/right change sigma, escape quits.\n");
+	printf("Each change shows a preview blurred at window resolution straight away, then the full resolution\n");
+	printf("result once it's done. A change while it's being blurred cancels it.\n");
+}
+
+////
+// Read the interactive command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseInteractiveOptions(int argc, char** argv, InteractiveOptions* options)
+{
+	options->inputPath = DEFAULT_IMAGE;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->threads = defaultThreadCount();
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->inputPath = value;
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->threads < 1) {
+		fprintf(stderr, "Threads must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Interactive viewer entry point, argv[0] is "--interactive".
+// Shows the image in a window with the mask width and sigma on the arrow keys. Every change is shown at
+// once as a preview blurred at window resolution, while the full resolution blur runs on a background
+// thread and replaces the preview when it's done; changing the settings again cancels it.
+// Returns 0 when the window is closed, 1 if the image or window can't be opened.
+////
+int runInteractiveViewer(int argc, char** argv)
+{
+	InteractiveOptions options;
+	if (!parseInteractiveOptions(argc, argv, &options)) {
+		printInteractiveUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	int imageW, imageH;
+	float* floatPixels = loadFloatImage(options.inputPath, &imageW, &imageH);
+	if (floatPixels == NULL)
+		return 1;
+	printf("Loaded %dx%d image.\n", imageW, imageH);
+
+	float scale = std::min(1.0f, std::min((float)WINDOW_WIDTH / imageW, (float)WINDOW_HEIGHT / imageH));
+	int previewW = std::max(1, (int)(imageW * scale + 0.5f));
+	int previewH = std::max(1, (int)(imageH * scale + 0.5f));
+	float* previewPixels = downsampleFloatPixels(floatPixels, imageW, imageH, previewW, previewH);
+
+	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+		fprintf(stderr, "Could not start SDL: %s\n", SDL_GetError());
+		free(previewPixels);
+		free(floatPixels);
+		return 1;
+	}
+	SDL_Window* window = SDL_CreateWindow("Guassian Blur Applicator, CPU", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+		WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+	SDL_Renderer* renderer = window != NULL ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC) : NULL;
+	// 16k and bigger images don't fit in one texture, the full resolution result is then shrunk to the largest that does
+	int fullW = imageW;
+	int fullH = imageH;
+	SDL_RendererInfo info;
+	if (renderer != NULL && SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0 && info.max_texture_height > 0 &&
+		(imageW > info.max_texture_width || imageH > info.max_texture_height)) {
+		float fit = std::min((float)info.max_texture_width / imageW, (float)info.max_texture_height / imageH);
+		fullW = std::max(1, std::min(info.max_texture_width, (int)(imageW * fit)));
+		fullH = std::max(1, std::min(info.max_texture_height, (int)(imageH * fit)));
+	}
+	SDL_Texture* previewTexture = renderer != NULL ?
+		SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, previewW, previewH) : NULL;
+	SDL_Texture* fullTexture = previewTexture != NULL ?
+		SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, fullW, fullH) : NULL;
+	if (fullTexture == NULL) {
+		fprintf(stderr, "Could not create the window, renderer or textures: %s\n", SDL_GetError());
+		if (previewTexture != NULL)
+			SDL_DestroyTexture(previewTexture);
+		if (renderer != NULL)
+			SDL_DestroyRenderer(renderer);
+		if (window != NULL)
+			SDL_DestroyWindow(window);
+		SDL_Quit();
+		free(previewPixels);
+		free(floatPixels);
+		return 1;
+	}
+	std::vector<unsigned char> shrunkPixels; // the full resolution result at fullW x fullH, when it had to be shrunk
+	if (fullW != imageW || fullH != imageH) {
+		shrunkPixels.resize((size_t)fullW * fullH * 4);
+		printf("The full resolution result is shown at %dx%d, the largest texture the renderer supports.\n", fullW, fullH);
+	}
+
+	Refiner refiner;
+	refiner.inPixels = floatPixels;
+	refiner.imageW = imageW;
+	refiner.imageH = imageH;
+	refiner.threads = options.threads;
+	refiner.doneEvent = SDL_RegisterEvents(1);
+	refiner.cancel = false;
+	refiner.quit = false;
+	refiner.requested = 0;
+	refiner.started = 0;
+	refiner.result.resize((size_t)imageW * imageH * 4);
+	refiner.finished = 0;
+	refiner.finishedMs = 0.0;
+	refiner.thread = std::thread(refineLoop, &refiner);
+
+	int maskSize = options.maskSize;
+	float stdv = options.stdv;
+	int generation = 0;
+	bool showingFull = false;
+	bool changed = true; // the first preview
+	bool running = true;
+	while (running) {
+		if (changed) {
+			generation++;
+			ConvMask mask;
+			generateGuassianKernel(&mask, maskSize, stdv);
+			ConvMask previewMask;
+			generatePreviewKernel(&previewMask, maskSize, stdv, scale);
+
+			// stop the out of date full resolution blur first so it doesn't compete with the preview for the cores
+			refiner.cancel = true;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			unsigned char* pixels;
+			int pitch;
+			// without the preview the window keeps showing the last image until the full resolution one is ready
+			bool previewed = SDL_LockTexture(previewTexture, NULL, (void**)(&pixels), &pitch) == 0;
+			if (previewed) {
+				convolveImageCPUThreaded(previewPixels, pixels, pitch, previewW, previewH, &previewMask, options.threads);
+				SDL_UnlockTexture(previewTexture);
+				printf("Preview mask %dx%d sigma %g (%dx%d sigma %g at %dx%d) took %.1fms.\n", maskSize, maskSize, stdv,
+					previewMask.size, previewMask.size, previewMask.stdv, previewW, previewH, millisecondsSince(start));
+			}
+			else
+				fprintf(stderr, "Could not lock the preview texture, skipping the preview: %s\n", SDL_GetError());
+			requestRefinement(&refiner, generation, &mask);
+
+			char title[128];
+			snprintf(title, sizeof(title), "Guassian Blur Applicator, CPU - mask %dx%d sigma %.2f - %s", maskSize, maskSize, stdv,
+				previewed ? "preview, refining" : "refining");
+			SDL_SetWindowTitle(window, title);
+			if (previewed) {
+				showingFull = false;
+				SDL_RenderCopy(renderer, previewTexture, NULL, NULL);
+				SDL_RenderPresent(renderer);
+			}
+			changed = false;
+		}
+
+		SDL_Event event;
+		if (SDL_WaitEvent(&event) == 0)
+			break;
+		// take every event already queued before blurring again, so held down keys don't pile up previews
+		do {
+			if (event.type == SDL_QUIT)
+				running = false;
+			else if (event.type == SDL_KEYDOWN) {
+				switch (event.key.keysym.sym) {
+				case SDLK_ESCAPE:
+					running = false;
+					break;
+				case SDLK_UP:
+					if (maskSize + 2 <= MAX_MASK_SIZE) {
+						maskSize += 2;
+						changed = true;
+					}
+					break;
+				case SDLK_DOWN:
+					if (maskSize - 2 >= 1) {
+						maskSize -= 2;
+						changed = true;
+					}
+					break;
+				case SDLK_RIGHT:
+					stdv *= SIGMA_STEP;
+					changed = true;
+					break;
+				case SDLK_LEFT:
+					stdv /= SIGMA_STEP;
+					changed = true;
+					break;
+				}
+			}
+			else if (event.type == refiner.doneEvent && event.user.code == generation && !changed) {
+				std::lock_guard<std::mutex> lock(refiner.mutex);
+				if (refiner.finished == generation) {
+					if (shrunkPixels.empty())
+						SDL_UpdateTexture(fullTexture, NULL, &refiner.result[0], imageW * 4);
+					else {
+						downsampleBytePixels(&refiner.result[0], imageW, imageH, &shrunkPixels[0], fullW, fullH);
+						SDL_UpdateTexture(fullTexture, NULL, &shrunkPixels[0], fullW * 4);
+					}
+					showingFull = true;
+					char title[128];
+					snprintf(title, sizeof(title), "Guassian Blur Applicator, CPU - mask %dx%d sigma %.2f - full resolution (%.0fms)",
+						maskSize, maskSize, stdv, refiner.finishedMs);
+					SDL_SetWindowTitle(window, title);
+					SDL_RenderCopy(renderer, fullTexture, NULL, NULL);
+					SDL_RenderPresent(renderer);
+				}
+			}
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+				SDL_RenderCopy(renderer, showingFull ? fullTexture : previewTexture, NULL, NULL);
+				SDL_RenderPresent(renderer);
+			}
+		} while (running && SDL_PollEvent(&event));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(refiner.mutex);
+		refiner.quit = true;
+		refiner.cancel = true;
+		refiner.wake.notify_one();
+	}
+	refiner.thread.join();
+	SDL_DestroyTexture(fullTexture);
+	SDL_DestroyTexture(previewTexture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	free(previewPixels);
+	free(floatPixels);
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include "json.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Write a string as a quoted JSON string.
+////
+void writeJSONString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(file, "\\%c", *c);
+		else if ((unsigned char)*c < 0x20)
+			fprintf(file, "\\u%04x", (unsigned char)*c);
+		else
+			fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+static void skipSpace(const char** c)
+{
+	while (**c == ' ' || **c == '\t' || **c == '\n' || **c == '\r')
+		(*c)++;
+}
+
+////
+// Read a quoted string starting at *c, leaving *c after the closing quote.
+// \u escapes outside ASCII are kept as '?', nothing this program writes needs them.
+////
+static bool parseString(const char** c, std::string* text)
+{
+	if (**c != '"')
+		return false;
+	(*c)++;
+	text->clear();
+	while (**c != '"') {
+		if (**c == '\0')
+			return false;
+		if (**c != '\\') {
+			*text += *(*c)++;
+			continue;
+		}
+		(*c)++;
+		switch (**c) {
+		case 'n': *text += '\n'; break;
+		case 't': *text += '\t'; break;
+		case 'r': *text += '\r'; break;
+		case 'b': *text += '\b'; break;
+		case 'f': *text += '\f'; break;
+		case 'u': {
+			char hex[5] = { 0 };
+			for (int i = 0; i < 4; i++) {
+				if ((*c)[1 + i] == '\0')
+					return false;
+				hex[i] = (*c)[1 + i];
+			}
+			long code = strtol(hex, NULL, 16);
+			*text += code < 0x80 ? (char)code : '?';
+			*c += 4;
+			break;
+		}
+		case '\0': return false;
+		default: *text += **c; break; // \" \\ \/
+		}
+		(*c)++;
+	}
+	(*c)++;
+	return true;
+}
+
+static bool parseValue(const char** c, JsonValue* value, int depth)
+{
+	if (depth > 64)
+		return false;
+	skipSpace(c);
+	value->type = JSON_NULL;
+	value->boolean = false;
+	value->number = 0.0;
+	value->text.clear();
+	value->keys.clear();
+	value->items.clear();
+
+	if (**c == '{' || **c == '[') {
+		bool object = (**c == '{');
+		char close = object ? '}' : ']';
+		value->type = object ? JSON_OBJECT : JSON_ARRAY;
+		(*c)++;
+		skipSpace(c);
+		if (**c == close) {
+			(*c)++;
+			return true;
+		}
+		while (true) {
+			if (object) {
+				std::string key;
+				skipSpace(c);
+				if (!parseString(c, &key))
+					return false;
+				skipSpace(c);
+				if (**c != ':')
+					return false;
+				(*c)++;
+				value->keys.push_back(key);
+			}
+			value->items.push_back(JsonValue());
+			if (!parseValue(c, &value->items.back(), depth + 1))
+				return false;
+			skipSpace(c);
+			if (**c == ',') {
+				(*c)++;
+				continue;
+			}
+			if (**c != close)
+				return false;
+			(*c)++;
+			return true;
+		}
+	}
+	if (**c == '"') {
+		value->type = JSON_STRING;
+		return parseString(c, &value->text);
+	}
+	if (strncmp(*c, "true", 4) == 0 || strncmp(*c, "false", 5) == 0) {
+		value->type = JSON_BOOL;
+		value->boolean = (**c == 't');
+		*c += value->boolean ? 4 : 5;
+		return true;
+	}
+	if (strncmp(*c, "null", 4) == 0) {
+		*c += 4;
+		return true;
+	}
+
+	char* end;
+	value->number = strtod(*c, &end);
+	if (end == *c)
+		return false;
+	value->type = JSON_NUMBER;
+	*c = end;
+	return true;
+}
+
+////
+// Parse a whole JSON document.
+// Returns false if the text is not valid JSON (the parser is lenient about some details, e.g. number formats).
+////
+bool parseJSON(const char* text, JsonValue* value)
+{
+	const char* c = text;
+	if (!parseValue(&c, value, 0))
+		return false;
+	skipSpace(&c);
+	return *c == '\0';
+}
+
+////
+// Read and parse a JSON file.
+// Returns false (after printing why) if it can't be read or isn't valid JSON.
+////
+bool readJSONFile(const char* path, JsonValue* value)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Could not read %s\n", path);
+		return false;
+	}
+	std::string text;
+	char buffer[4096];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, count);
+	fclose(file);
+
+	if (!parseJSON(text.c_str(), value)) {
+		fprintf(stderr, "%s is not valid JSON\n", path);
+		return false;
+	}
+	return true;
+}
+
+////
+// Member of an object by name, NULL if object isn't an object or has no such member.
+////
+const JsonValue* findMember(const JsonValue* object, const char* key)
+{
+	if (object == NULL || object->type != JSON_OBJECT)
+		return NULL;
+	for (size_t i = 0; i < object->keys.size(); i++) {
+		if (object->keys[i] == key)
+			return &object->items[i];
+	}
+	return NULL;
+}
+
+// Number member of an object, or fallback if it is missing or not a number.
+double memberNumber(const JsonValue* object, const char* key, double fallback)
+{
+	const JsonValue* member = findMember(object, key);
+	return (member != NULL && member->type == JSON_NUMBER) ? member->number : fallback;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+enum JsonType {
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT
+};
+
+////
+// A parsed JSON value, just enough to read back the files this program writes.
+// Arrays keep their elements in items, objects keep their member names in keys and values in items (same order).
+////
+struct JsonValue {
+	JsonType type;
+	bool boolean;
+	double number;
+	std::string text;
+	std::vector<std::string> keys;
+	std::vector<JsonValue> items;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void writeJSONString(FILE* file, const char* text);
+bool parseJSON(const char* text, JsonValue* value);
+bool readJSONFile(const char* path, JsonValue* value);
+const JsonValue* findMember(const JsonValue* object, const char* key);
+double memberNumber(const JsonValue* object, const char* key, double fallback);
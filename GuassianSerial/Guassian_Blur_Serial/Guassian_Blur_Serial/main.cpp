@@ -2,21 +2,43 @@
 #include "SDL_image.h"
 #undef main
 
+#include "blur.h"
+#include "image.h"
+#include "bench.h"
+#include "scaling.h"
+#include "validate.h"
+#include "golden.h"
+#include "borderbench.h"
+#include "dirty.h"
+#include "roi.h"
+#include "shootout.h"
+#include "batch.h"
+#include "stream.h"
+#include "video.h"
+#include "daemon.h"
+#include "async.h"
+#include "interactive.h"
+#include "writer.h"
+#include "stagetimer.h"
+#include "trace.h"
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <memory.h>
 #include <math.h>
-#include <time.h>
+#include <chrono>
 
 //IF CHANGING VALUES AND RERUNNING CODE DOESNT CHANGE WHEN RUNNING CLOSE AND REOPEN MAIN.CPP
 
 /// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
-//change the gaussinan blur effect here
+//change the default gaussinan blur effect here (can also be set with --mask and --sigma)
 const int maskSize = 3; // width of the blur in pixels, must be an odd value (3, 5, 7, 9, 11, 13)
 const float stdv = 20.0; // strength of the blur (1.0, 3.0, 5.0, 10.0, 20.0)?
-// Change this to change the image file to be loaded. Note: needs to be a JPEG.
+// Change this to change the default image file to be loaded (can also be set with --input). Note: needs to be a JPEG.
 // file sizes are relative to their name, in order from smallest to largest the name's are
-// "240p", "480p", "720p", "1080p", "1440p", "4k", "8k", "16k". 
-// to Load a custom image please put your image in the project folder where these above images are found, 
+// "240p", "480p", "720p", "1080p", "1440p", "4k", "8k", "16k".
+// to Load a custom image please put your image in the project folder where these above images are found,
 // then input the file name below of your custom file. please note that keeping to a aspect ratio of 16:9
 // the image will not appear to be distorted if the window size stays the same.
 const char* IMAGE_PATH = "4k.jpg";
@@ -24,127 +46,180 @@ const char* IMAGE_PATH = "4k.jpg";
 // to be loaded otherwise it'll be distorted.
 const int WINDOW_WIDTH = 1280;
 const int WINDOW_HEIGHT = 720;
-// Host version of the convolution mask 2D array.
-float h_convMask[maskSize][maskSize];
-// used in the apllying of the convolution kernel, put here in order to set it once
-const int offset = (maskSize - 1) / 2; // how many x or y coordinates the convolution kernel will take you away from the central origin
-
-/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
-/// Generate the guassian convolution kernel
-// CPU runnable
-// based on: https://www.codewithc.com/gaussian-filter-generation-in-c/
-// Modified to be adaptable, the code is messy but the timing of CUDA vs SERIAL will not be affected by this;
-// Parameters:
-// Width: Dimensional width of the kernel
-// Height: Dimensional height of the kernel
 ////
-void generateGuassianKernel(int width, int height) {
-	double r, s = 2.0 * stdv * stdv;
-	double sum = 0.0;   // Initialization of sun for normalization
-
-	// Loop to generate kSize x kSize kernel
-	for (int x = ((width - 1) / 2) * -1; x <= ((width - 1) / 2); x++) {
-		for (int y = ((width - 1) / 2) * -1; y <= ((width - 1) / 2); y++) {
-			r = sqrt(x * x + y * y);
-			h_convMask[x + ((width - 1) / 2)][y + ((width - 1) / 2)] = (exp(-(r * r) / s)) / (M_PI * s); // generate using the guassian function
-			sum += h_convMask[x + ((width - 1) / 2)][y + ((width - 1) / 2)];// used gor normalizing the kernel (See below...)
-		}
-	}
-	for (int i = 0; i < maskSize; ++i) // Loop to normalize the kernel so the image doesnt get dimmer
-		for (int j = 0; j < maskSize; ++j)
-			h_convMask[i][j] /= sum;
-}
+// Settings for one run of the program, filled in from the command line.
+////
+struct Options {
+	const char* inputPath; // image to blur
+	const char* outputPath; // where to save the result (.png, .jpg, .bmp, .ppm or .raw), NULL to not save
+	int maskSize;
+	float stdv;
+	const Backend* backend;
+	int threads;
+	bool view; // show the result in an SDL window instead of exiting when done
+	int runs; // times the whole load, blur, save pipeline is run (the viewer always runs once)
+	bool stages; // print how long every pipeline stage took
+	const char* tracePath; // write a Chrome trace of every stage and worker band here, NULL to not trace
+};
 
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
 ////
-// Calculate the index of an element index by x,y in a one dimensional
-// flattened array (row major), where y is the major axis.
-// if an index is calculated to be out of range of the array, set the index to 
-// minimum or maximum depending on if the index is below or above the range.
-// Parameters:
-// x: x coordinate of whole pixel (not accounting for RGBA values).
-// y: Y coordinate of whole pixel (not accounting for RGBA values).
-// imageW, imageH: width & height of the image.
+// Print the command line help.
 ////
-int get1dIndex(int width, int height, int x, int y)
+void printUsage(const char* program)
 {
-	//check x and y boundaries
-	if (x < 0)
-		x = 0;
-	if (x >= width)
-		x = width - 1;
-	if (y < 0)
-		y = 0;
-	if (y >= height)
-		y = height - 1;
-
-	// check index boundaries
-	int i = y * width * 4 + x * 4;
-	if (i < 0)
-		i = 0;
-	if (i > width * height * 4)
-		i = ((width * height * 4) - 1);
-	return i;
+	printf("Usage: %s [options]\n", program);
+	printf("  --input <file>     image to blur (default %s)\n", IMAGE_PATH);
+	printf("                     or a generated one: synth:<gradient|noise|edges|checker>:<240p..32k|WxH>[:<seed>]\n");
+	printf("  --output <file>    save the blurred image, format picked by extension (.png, .jpg, .bmp, .ppm, .raw)\n");
+	printf("                     saved in the background, with --runs it overlaps the next run's load and blur\n");
+	printf("  --mask <n>         mask width, odd value from 1 to %d (default %d)\n", MAX_MASK_SIZE, maskSize);
+	printf("  --sigma <f>        strength of the blur (default %.1f)\n", stdv);
+	printf("  --backend <name>   convolution backend (default %s)\n", backends[0].name);
+	printf("  --threads <n>      threads for multithreaded backends (default %d)\n", defaultThreadCount());
+	printf("  --view             show the result in a window until it is closed\n");
+	printf("  --runs <n>         run the whole load, blur, save pipeline n times (default 1, not with --view)\n");
+	printf("  --stages           print a breakdown of the time spent in every pipeline stage\n");
+	printf("  --trace <file>     write a Chrome trace (chrome://tracing, ui.perfetto.dev) of every stage and worker band\n");
+	printf("Backends:\n");
+	for (int i = 0; i < backendCount; i++)
+		printf("  %-10s %s\n", backends[i].name, backends[i].description);
+	printf("Running with no options opens the viewer on the default image.\n");
+	printf("Other modes (run with --help after the mode for their options):\n");
+	printf("  --interactive      viewer with mask and sigma on the arrow keys, instant preview then full resolution\n");
+	printf("  --async            many requests in flight at once through the C++20 coroutine API on a small thread pool\n");
+	printf("  --batch            blur a whole directory with overlapping decode, blur and encode stages\n");
+	printf("  --video            blur a Y4M or raw RGBA frame stream with overlapping read, blur and write\n");
+	printf("  --serve            long running server blurring requests from a unix socket, pixels in shared memory\n");
+	printf("  --client           blur one image through a running --serve\n");
+	printf("  --load             load test a running --serve with many connections and report throughput and latency\n");
+	printf("  --stream           blur row by row through a rolling window, without holding the whole image\n");
+	printf("  --shootout         rank every backend (and GPU timings) by latency, with speedup, memory and max error\n");
+	printf("  --bench            sweep images, masks, sigmas and backends and report timing statistics\n");
+	printf("  --scaling          strong and weak thread scaling study of one backend\n");
+	printf("  --validate         check backends against a reference: max error, PSNR, error histogram\n");
+	printf("  --golden           record reference output hashes, or check every backend against them in milliseconds\n");
+	printf("  --roi              blur only some regions of an image (redaction), in place\n");
+	printf("  --dirty            re-blur only around changed rectangles and compare with blurring everything again\n");
+	printf("  --border           time border handling strategies on the interior, rows, columns and corners\n");
 }
 
 ////
-// CPU version of the convolution code.
-// Applies the convolution kernel to each pixel (including RGBA values)
-// Parameters:
-// inPixels: array of bytes containing the original image pixels.
-// outPixels: array of bytes where the modified image should be written.
-// imageW, imageH: width & height of the image.
+// Read the command line into options.
+// Returns false (after printing why) if the command line is not valid.
 ////
-void convolveImageCPU(float* inPixels, float* outPixels, int imageW, int imageH)
+bool parseOptions(int argc, char** argv, Options* options)
 {
-	for (int imageX = 0; imageX < imageW; imageX++) {
-		for (int imageY = 0; imageY < imageH; imageY++) {
-			if (imageX < imageW && imageY < imageH) {
-				int i = imageX;
-				int j = imageY;
-
-				// Extract the red, green and blue components.
-				//give the position of the r,g,b pixel in the array
-				int r = get1dIndex(imageW, imageH, i, j) + 0;
-				int g = get1dIndex(imageW, imageH, i, j) + 1;
-				int b = get1dIndex(imageW, imageH, i, j) + 2;
-
-				//declare the sum of each pixel colour value, the sum of the pixels around multiplied by the convolution kernels related value
-				float rsum = 0.0f;
-				float gsum = 0.0f;
-				float bsum = 0.0f;
-
-				//loop over guassianKernel
-				// x = x of convulutionKernel (Matrix Axis)
-				// y = y of convolutionKernel (Matrix Axis)
-				for (int x = 0; x < maskSize; x++) {
-					for (int y = 0; y < maskSize; y++) {
-
-						// Get the pixel value for the corresponding kernel value and multiply it buy the convulutionKernel value that relates to it
-						rsum += (h_convMask[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 0];
-						gsum += (h_convMask[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 1];
-						bsum += (h_convMask[x][y]) * inPixels[get1dIndex(imageW, imageH, x + (i - offset), y + (j - offset)) + 2];
-
-					}
-				}
-				//pixels that are now newly calculated now guassian smoothing has been applied
-				outPixels[r] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
-				outPixels[g] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
-				outPixels[b] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+	options->inputPath = IMAGE_PATH;
+	options->outputPath = NULL;
+	options->maskSize = maskSize;
+	options->stdv = stdv;
+	options->backend = &backends[0];
+	options->threads = defaultThreadCount();
+	options->view = (argc == 1); // keep the old behaviour when started without arguments
+	options->runs = 1;
+	options->stages = false;
+	options->tracePath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--view") == 0) {
+			options->view = true;
+			continue;
+		}
+		if (strcmp(arg, "--stages") == 0) {
+			options->stages = true;
+			continue;
+		}
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0) {
+			options->inputPath = value;
+		}
+		else if (strcmp(arg, "--output") == 0) {
+			options->outputPath = value;
+		}
+		else if (strcmp(arg, "--mask") == 0) {
+			options->maskSize = atoi(value);
+			if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+				fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+				return false;
 			}
 		}
+		else if (strcmp(arg, "--sigma") == 0) {
+			options->stdv = (float)atof(value);
+			if (options->stdv <= 0.0f) {
+				fprintf(stderr, "Sigma must be greater than 0\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--backend") == 0) {
+			options->backend = findBackend(value);
+			if (options->backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--trace") == 0) {
+			options->tracePath = value;
+		}
+		else if (strcmp(arg, "--runs") == 0) {
+			options->runs = atoi(value);
+			if (options->runs < 1) {
+				fprintf(stderr, "Runs must be at least 1\n");
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0) {
+			options->threads = atoi(value);
+			if (options->threads < 1) {
+				fprintf(stderr, "Thread count must be at least 1\n");
+				return false;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
 	}
+	return true;
 }
 
 ////
-// Program entry point.
+// Run the chosen backend and print how long it took (wall clock, so threaded backends are timed fairly).
+// Parameters:
+// outPixels, outPitch: pitched 8-bit RGBA destination for the result.
+////
+void runConvolution(const Options* options, const ConvMask* mask, float* floatPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	options->backend->convolve(floatPixels, outPixels, outPitch, imageW, imageH, mask, options->threads);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	float ms = std::chrono::duration<float, std::milli>(end - start).count();
+	recordStage("convolve", start, end);
+	printf("CPU Convolution (%s, %d threads) took %fms.\n\n", options->backend->name, options->threads, ms);
+}
+
 ////
-int main(int argc, int** argv)
+// Blur the image and show it in a window until the window is closed.
+// The loop sleeps in SDL_WaitEvent so it doesn't use any CPU while the image is on screen.
+////
+int runViewer(const Options* options, const ConvMask* mask, float* floatPixels, int imageW, int imageH)
 {
-	generateGuassianKernel(maskSize, maskSize);
 	// Initialize SDL and create window.
+	std::chrono::steady_clock::time_point windowStart = std::chrono::steady_clock::now();
 	SDL_Init(SDL_INIT_VIDEO);
 	SDL_Window* window = SDL_CreateWindow(
 		"Guassian Blur Applicator, CPU",
@@ -155,88 +230,169 @@ int main(int argc, int** argv)
 		-1,
 		SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
-	// Load a photo based on image path set at the top.
-	SDL_Surface* image = IMG_Load(IMAGE_PATH);
-	printf("Loaded %dx%d image.\n", image->w, image->h);
-	// Copy to a new surface so that we know the format (32 bit RGBA).
-	SDL_Surface* surface = SDL_CreateRGBSurface(0, image->w, image->h, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
-	SDL_BlitSurface(image, NULL, surface, NULL);
-	SDL_FreeSurface(image);
-	image = NULL;
-	//retreve the image size from the surface of the SDL panel
-	int imageSize = surface->w * surface->h;
-
-	// Allocate a pointer and space in memory for pixel data from the surface,
-	// contains the RGBA values for every pixel repeeated over and over.
-	// Note: stored in row major order
-	float* floatPixels;
-	floatPixels = (float*)malloc(4 * imageSize * sizeof(float));
-	float* floatPixelsOut;
-	floatPixelsOut = (float*)malloc(4 * imageSize * sizeof(float));
-
-	// Copy surface data (image)
-	unsigned char* surfacePixels = (unsigned char*)surface->pixels;
-	for (int i = 0; i < imageSize; i++) {
-		floatPixels[i * 4 + 0] = ((float)surfacePixels[i * 4 + 0]);
-		floatPixels[i * 4 + 1] = ((float)surfacePixels[i * 4 + 1]);
-		floatPixels[i * 4 + 2] = ((float)surfacePixels[i * 4 + 2]);
-	}
-
-	//CPU run and time
-	clock_t CPUStart = clock();
-	convolveImageCPU(floatPixels, floatPixelsOut, surface->w, surface->h);
-	clock_t CPUEnd = clock();
-	float CPUms = 1000.0f * (CPUEnd - CPUStart) / CLOCKS_PER_SEC;
-	printf("CPU Convolution took %fms.\n\n", CPUms);
-
-
 	// Allocate a texture that will be the actual image drawn to the screen.
 	SDL_Texture* texture = SDL_CreateTexture(
 		renderer,
 		SDL_PIXELFORMAT_ABGR8888,
 		SDL_TEXTUREACCESS_STREAMING,
-		surface->w, surface->h);
+		imageW, imageH);
+	recordStage("create window", windowStart, std::chrono::steady_clock::now());
 
 	unsigned char* pixelsTmp;
 	int pitch;
 
+	// the convolution writes its result straight into the locked texture,
+	// respecting the pitch SDL hands back (rows may be padded)
 	SDL_LockTexture(texture, NULL, (void**)(&pixelsTmp), &pitch);
-
-	// put the pixels from the calulations of the convolve kernel in pixelstmp ready
-	// to render the image
-	for (int i = 0; i < imageSize; i++) {
-		pixelsTmp[i * 4 + 0] = (unsigned char)(floatPixelsOut[i * 4]);
-		pixelsTmp[i * 4 + 1] = (unsigned char)(floatPixelsOut[i * 4 + 1]);
-		pixelsTmp[i * 4 + 2] = (unsigned char)(floatPixelsOut[i * 4 + 2]);
-	}
-
+	runConvolution(options, mask, floatPixels, pixelsTmp, pitch, imageW, imageH);
 	SDL_UnlockTexture(texture);
 
 	// Draw the image.
-	SDL_RenderCopy(renderer, texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+	{
+		StageTimer timer("render copy");
+		SDL_RenderCopy(renderer, texture, NULL, NULL);
+	}
+	{
+		StageTimer timer("present");
+		SDL_RenderPresent(renderer);
+	}
+	// everything after this is waiting on the user
+	if (options->stages)
+		printStageBreakdown();
 
-	// Main loop - runs continually until quit.
+	// Main loop - waits for events until quit.
 	bool running = true;
 	while (running) {
 		SDL_Event event;
-		while (SDL_PollEvent(&event)) {
-			if (event.type == SDL_QUIT) {
-				// User pressed the "X", Alt-4F, etc...
-				running = false;
-			}
+		if (SDL_WaitEvent(&event) == 0)
+			break;
+		if (event.type == SDL_QUIT) {
+			// User pressed the "X", Alt-4F, etc...
+			running = false;
+		}
+		else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
 		}
 	}
 
 	// Main loop finished - quit.
 	SDL_DestroyTexture(texture);
-	SDL_FreeSurface(surface);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
+	return 0;
+}
+
+////
+// Blur the image without opening a window, optionally saving the result.
+// The result is written straight into the surface that gets saved.
+// Parameters:
+// writer: saves the result in the background (and frees it), NULL if there is no output path.
+////
+int runHeadless(const Options* options, const ConvMask* mask, float* floatPixels, int imageW, int imageH, AsyncWriter* writer)
+{
+	SDL_Surface* result = createResultSurface(imageW, imageH);
+	if (result == NULL) {
+		fprintf(stderr, "Could not create the result surface: %s\n", SDL_GetError());
+		return 1;
+	}
+	runConvolution(options, mask, floatPixels, (unsigned char*)result->pixels, result->pitch, imageW, imageH);
 
-	free(floatPixels);
-	free(floatPixelsOut);
+	if (writer == NULL) {
+		SDL_FreeSurface(result);
+		return 0;
+	}
+	return writer->submit(result, options->outputPath) ? 0 : 1;
+}
 
-	return 0;
-}
\ No newline at end of file
+////
+// Program entry point.
+////
+int main(int argc, char** argv)
+{
+	// other modes have their own options
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return runBenchmark(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--interactive") == 0)
+		return runInteractiveViewer(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--async") == 0)
+		return runAsync(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+		return runBatch(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--video") == 0)
+		return runVideo(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+		return runServer(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--client") == 0)
+		return runClient(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--load") == 0)
+		return runLoadGenerator(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--stream") == 0)
+		return runStream(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--shootout") == 0)
+		return runShootout(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--scaling") == 0)
+		return runScaling(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--validate") == 0)
+		return runValidation(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--golden") == 0)
+		return runGolden(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--border") == 0)
+		return runBorderBenchmark(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--dirty") == 0)
+		return runDirtyBenchmark(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "--roi") == 0)
+		return runRegionBlur(argc - 1, argv + 1);
+
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+
+	if (options.tracePath != NULL)
+		startTracing(options.tracePath);
+
+	// one writer thread, every run saves to the same file so the writes must not overlap each other
+	AsyncWriter* writer = NULL;
+	if (!options.view && options.outputPath != NULL)
+		writer = new AsyncWriter(1, 2);
+
+	int result = 0;
+	int runs = options.view ? 1 : options.runs;
+	for (int run = 0; run < runs && result == 0; run++) {
+		// Load a photo based on the image path given (or the default set at the top).
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.inputPath, &imageW, &imageH);
+		if (floatPixels == NULL) {
+			result = 1;
+			break;
+		}
+		printf("Loaded %dx%d image.\n", imageW, imageH);
+
+		if (options.view)
+			result = runViewer(&options, &mask, floatPixels, imageW, imageH);
+		else
+			result = runHeadless(&options, &mask, floatPixels, imageW, imageH, writer);
+
+		free(floatPixels);
+	}
+
+	if (writer != NULL) {
+		WriterStats written = writer->finish();
+		if (written.failures > 0)
+			result = 1;
+		else if (written.written > 0)
+			printf("Saved %s.\n", options.outputPath);
+		delete writer;
+	}
+	if (options.stages && !options.view)
+		printStageBreakdown();
+	if (!finishTracing())
+		result = 1;
+	return result;
+}
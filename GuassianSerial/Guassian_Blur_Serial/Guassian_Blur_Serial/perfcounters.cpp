@@ -0,0 +1,185 @@
+#include "perfcounters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* counterNames[COUNTER_COUNT] = {
+	"cycles",
+	"instructions",
+	"l1d_misses",
+	"llc_misses",
+	"branch_misses",
+	"dtlb_misses",
+};
+
+#ifdef __linux__
+
+////
+// Open one counter for this process, including threads it starts later (inherit),
+// counting user space only so it works with the default perf_event_paranoid setting.
+// Returns the file descriptor, or -1 if the counter isn't available.
+////
+static int openCounter(unsigned int type, unsigned long long config)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	// the counters aren't grouped, so the kernel may multiplex them, scale by the time each actually ran
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// config value for a PERF_TYPE_HW_CACHE read miss event
+static unsigned long long cacheReadMiss(unsigned long long cache)
+{
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+////
+// Open every counter that's available.
+// Returns false if none of them could be opened.
+////
+bool openPerfCounters(PerfCounters* counters)
+{
+	counters->fds[COUNTER_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	counters->fds[COUNTER_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	counters->fds[COUNTER_L1D_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheReadMiss(PERF_COUNT_HW_CACHE_L1D));
+	counters->fds[COUNTER_LLC_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheReadMiss(PERF_COUNT_HW_CACHE_LL));
+	counters->fds[COUNTER_BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	counters->fds[COUNTER_DTLB_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheReadMiss(PERF_COUNT_HW_CACHE_DTLB));
+
+	bool any = false;
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] < 0)
+			counters->fds[i] = -1;
+		else
+			any = true;
+	}
+	return any;
+}
+
+void closePerfCounters(PerfCounters* counters)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] >= 0)
+			close(counters->fds[i]);
+		counters->fds[i] = -1;
+	}
+}
+
+////
+// Zero and start every open counter.
+////
+void startPerfCounters(PerfCounters* counters)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] >= 0) {
+			ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+////
+// Stop every open counter and read what it counted since startPerfCounters.
+////
+void stopPerfCounters(PerfCounters* counters, CounterValues* values)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] >= 0)
+			ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	clearCounterValues(values);
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		unsigned long long data[3]; // value, time enabled, time running
+		if (counters->fds[i] < 0 || read(counters->fds[i], data, sizeof(data)) != sizeof(data))
+			continue;
+		if (data[2] == 0)
+			continue; // never got scheduled on the PMU, no count
+		values->valid[i] = true;
+		values->values[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+	}
+}
+
+#else
+
+// No perf_event_open on this platform, every counter is reported as missing.
+bool openPerfCounters(PerfCounters* counters)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		counters->fds[i] = -1;
+	return false;
+}
+
+void closePerfCounters(PerfCounters* counters)
+{
+}
+
+void startPerfCounters(PerfCounters* counters)
+{
+}
+
+void stopPerfCounters(PerfCounters* counters, CounterValues* values)
+{
+	clearCounterValues(values);
+}
+
+#endif
+
+void clearCounterValues(CounterValues* values)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		values->valid[i] = false;
+		values->values[i] = 0.0;
+	}
+}
+
+////
+// Add one measurement onto a running total, a counter stays valid only while every measurement had it.
+// Start the total with every counter valid (see the benchmark) or it can never become valid.
+////
+void addCounterValues(CounterValues* total, const CounterValues* values)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		total->valid[i] = total->valid[i] && values->valid[i];
+		total->values[i] += values->values[i];
+	}
+}
+
+void scaleCounterValues(CounterValues* values, double factor)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		values->values[i] *= factor;
+}
+
+// True if at least one counter has a value.
+bool counterValuesValid(const CounterValues* values)
+{
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (values->valid[i])
+			return true;
+	}
+	return false;
+}
+
+// Instructions per cycle, or 0 if either counter is missing.
+double instructionsPerCycle(const CounterValues* values)
+{
+	if (!values->valid[COUNTER_CYCLES] || !values->valid[COUNTER_INSTRUCTIONS] || values->values[COUNTER_CYCLES] <= 0.0)
+		return 0.0;
+	return values->values[COUNTER_INSTRUCTIONS] / values->values[COUNTER_CYCLES];
+}
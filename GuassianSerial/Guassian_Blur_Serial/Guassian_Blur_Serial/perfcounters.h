@@ -0,0 +1,44 @@
+#pragma once
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Hardware events counted around each benchmark run.
+enum PerfCounterId {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_L1D_MISSES, // L1 data cache read misses
+	COUNTER_LLC_MISSES, // last level cache read misses
+	COUNTER_BRANCH_MISSES,
+	COUNTER_DTLB_MISSES, // data TLB read misses
+	COUNTER_COUNT
+};
+
+////
+// Open hardware counters (perf_event_open on Linux).
+// Counters that couldn't be opened (no permission, not supported by the CPU or VM, other OS) stay at -1
+// and are simply reported as missing.
+////
+struct PerfCounters {
+	int fds[COUNTER_COUNT];
+};
+
+////
+// Counter values for a measurement, valid[i] is false if counter i wasn't available.
+////
+struct CounterValues {
+	bool valid[COUNTER_COUNT];
+	double values[COUNTER_COUNT];
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+extern const char* counterNames[COUNTER_COUNT];
+bool openPerfCounters(PerfCounters* counters);
+void closePerfCounters(PerfCounters* counters);
+void startPerfCounters(PerfCounters* counters);
+void stopPerfCounters(PerfCounters* counters, CounterValues* values);
+void clearCounterValues(CounterValues* values);
+void addCounterValues(CounterValues* total, const CounterValues* values);
+void scaleCounterValues(CounterValues* values, double factor);
+bool counterValuesValid(const CounterValues* values);
+double instructionsPerCycle(const CounterValues* values);
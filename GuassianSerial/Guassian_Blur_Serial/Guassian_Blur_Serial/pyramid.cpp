@@ -0,0 +1,342 @@
+#include "pyramid.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// 5 tap binomial filter applied before each halving (a Gaussian with sigma 1), divided by 16.
+static const float REDUCE_TAPS[5] = { 1.0f, 4.0f, 6.0f, 4.0f, 1.0f };
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Call work(firstRow, lastRow) on bands of rows split across threads, the calling thread takes the last band.
+static void forRowBands(int rows, int threads, const std::function<void(int, int)>& work)
+{
+	threads = std::max(1, std::min(threads, rows));
+	std::vector<std::thread> workers;
+	int firstRow = 0;
+	for (int t = 0; t < threads; t++) {
+		int lastRow = firstRow + rows / threads + (t < rows % threads ? 1 : 0);
+		if (t == threads - 1)
+			work(firstRow, lastRow);
+		else
+			workers.push_back(std::thread(work, firstRow, lastRow));
+		firstRow = lastRow;
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+static int clampIndex(int i, int size)
+{
+	return std::min(std::max(i, 0), size - 1);
+}
+
+////
+// 1D kernel of the blur done at the reduced resolution, so that halving levels times, blurring with it and
+// scaling back up comes out close to mask. The halvings and the bilinear scale up already blur, so only
+// the variance they leave over is applied (sigmas add in quadrature).
+// Returns false if they already blur more than mask does, so there is nothing left to apply.
+////
+static bool levelKernel(const ConvMask* mask, int levels, std::vector<float>* kernel)
+{
+	double factor = (double)(1 << levels);
+	double variance = (double)mask->stdv * mask->stdv;
+	double reduceVariance = (factor * factor - 1.0) / 3.0; // sum of (2^k)^2 * 1 over the halvings
+	double upVariance = factor * factor / 6.0; // a triangle 2^levels pixels either side
+	double residual = variance - reduceVariance - upVariance;
+	if (residual <= 0.0)
+		return false;
+	double stdv = sqrt(residual) / factor;
+	int offset = (int)ceil(mask->offset / factor);
+
+	kernel->resize(2 * offset + 1);
+	double sum = 0.0;
+	for (int d = -offset; d <= offset; d++) {
+		(*kernel)[d + offset] = (float)exp(-(d * d) / (2.0 * stdv * stdv));
+		sum += (*kernel)[d + offset];
+	}
+	for (size_t i = 0; i < kernel->size(); i++)
+		(*kernel)[i] = (float)((*kernel)[i] / sum);
+	return true;
+}
+
+////
+// Halve an RGBA float image with the binomial filter, keeping the even pixels.
+// Returns a malloc'd image of (imageW + 1) / 2 x (imageH + 1) / 2, NULL if there isn't enough memory.
+////
+static float* reduceImage(const float* pixels, int imageW, int imageH, int threads)
+{
+	int reducedW = (imageW + 1) / 2;
+	int reducedH = (imageH + 1) / 2;
+	std::vector<float> across((size_t)reducedW * imageH * 4);
+	forRowBands(imageH, threads, [&](int firstRow, int lastRow) {
+		for (int y = firstRow; y < lastRow; y++) {
+			const float* row = pixels + (size_t)y * imageW * 4;
+			float* out = &across[(size_t)y * reducedW * 4];
+			for (int x = 0; x < reducedW; x++) {
+				for (int c = 0; c < 4; c++) {
+					float sum = 0.0f;
+					for (int t = 0; t < 5; t++)
+						sum += REDUCE_TAPS[t] * row[clampIndex(2 * x + t - 2, imageW) * 4 + c];
+					out[x * 4 + c] = sum / 16.0f;
+				}
+			}
+		}
+	});
+
+	float* reduced = (float*)malloc((size_t)reducedW * reducedH * 4 * sizeof(float));
+	if (reduced == NULL)
+		return NULL;
+	forRowBands(reducedH, threads, [&](int firstRow, int lastRow) {
+		for (int y = firstRow; y < lastRow; y++) {
+			float* out = reduced + (size_t)y * reducedW * 4;
+			for (int x = 0; x < reducedW * 4; x++) {
+				float sum = 0.0f;
+				for (int t = 0; t < 5; t++)
+					sum += REDUCE_TAPS[t] * across[(size_t)clampIndex(2 * y + t - 2, imageH) * reducedW * 4 + x];
+				out[x] = sum / 16.0f;
+			}
+		}
+	});
+	return reduced;
+}
+
+// Blur an RGBA float image in place with a separable kernel, clamping at the edges.
+static void blurSeparable(float* pixels, int imageW, int imageH, const std::vector<float>& kernel, int threads)
+{
+	int offset = (int)kernel.size() / 2;
+	std::vector<float> across((size_t)imageW * imageH * 4);
+	forRowBands(imageH, threads, [&](int firstRow, int lastRow) {
+		for (int y = firstRow; y < lastRow; y++) {
+			const float* row = pixels + (size_t)y * imageW * 4;
+			float* out = &across[(size_t)y * imageW * 4];
+			for (int x = 0; x < imageW; x++) {
+				for (int c = 0; c < 4; c++) {
+					float sum = 0.0f;
+					for (int d = -offset; d <= offset; d++)
+						sum += kernel[d + offset] * row[clampIndex(x + d, imageW) * 4 + c];
+					out[x * 4 + c] = sum;
+				}
+			}
+		}
+	});
+	forRowBands(imageH, threads, [&](int firstRow, int lastRow) {
+		for (int y = firstRow; y < lastRow; y++) {
+			float* out = pixels + (size_t)y * imageW * 4;
+			for (int x = 0; x < imageW * 4; x++) {
+				float sum = 0.0f;
+				for (int d = -offset; d <= offset; d++)
+					sum += kernel[d + offset] * across[(size_t)clampIndex(y + d, imageH) * imageW * 4 + x];
+				out[x] = sum;
+			}
+		}
+	});
+}
+
+////
+// Gaussian pyramid version of the convolution code, for large masks.
+// Halves the image levels times, blurs it there with what is left of the mask and scales it back up
+// bilinearly, so the blur itself costs about 4^levels less (and is done separably). The result is an
+// approximation, pyramidErrorBound says how close it is. levels 0 is the exact convolveImageCPUThreaded.
+// Parameters:
+// levels: times to halve the image, from 0 to PYRAMID_MAX_LEVELS. Lowered if the halvings alone would
+// blur more than mask does. Also falls back to 0 if the padded levels don't fit in memory.
+// threads: number of threads to use, values below 1 are treated as 1.
+// (the rest as convolveImageCPU)
+////
+void convolveImagePyramid(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int levels, int threads)
+{
+	std::vector<float> kernel;
+	levels = std::min(std::max(levels, 0), PYRAMID_MAX_LEVELS);
+	while (levels > 0 && !levelKernel(mask, levels, &kernel))
+		levels--;
+	if (levels == 0) {
+		convolveImageCPUThreaded(inPixels, outPixels, outPitch, imageW, imageH, mask, threads);
+		return;
+	}
+
+	// The exact convolution clamps at the edges, which reads as repeating the edge pixels outwards. Repeating
+	// them far enough (a whole number of reduced pixels) before reducing lets the pyramid see the same edges,
+	// otherwise its own clamping on the reduced levels weights the edge pixels very differently.
+	int factor = 1 << levels;
+	int pad = ((mask->offset + ((int)kernel.size() / 2 + 4) * factor + factor - 1) / factor) * factor;
+	int levelW = imageW + 2 * pad;
+	int levelH = imageH + 2 * pad;
+	float* level = (float*)malloc((size_t)levelW * levelH * 4 * sizeof(float));
+	if (level == NULL) {
+		fprintf(stderr, "Not enough memory for the pyramid of a %dx%d image, blurring it exactly\n", imageW, imageH);
+		convolveImageCPUThreaded(inPixels, outPixels, outPitch, imageW, imageH, mask, threads);
+		return;
+	}
+	{
+		TraceScope trace("pad");
+		forRowBands(levelH, threads, [&](int firstRow, int lastRow) {
+			for (int y = firstRow; y < lastRow; y++) {
+				const float* row = inPixels + (size_t)clampIndex(y - pad, imageH) * imageW * 4;
+				float* out = level + (size_t)y * levelW * 4;
+				for (int x = 0; x < levelW; x++) {
+					const float* pixel = row + clampIndex(x - pad, imageW) * 4;
+					for (int c = 0; c < 4; c++)
+						out[x * 4 + c] = pixel[c];
+				}
+			}
+		});
+	}
+	{
+		TraceScope trace("reduce");
+		for (int l = 0; l < levels; l++) {
+			float* reduced = reduceImage(level, levelW, levelH, threads);
+			free(level);
+			if (reduced == NULL) {
+				fprintf(stderr, "Not enough memory for the pyramid of a %dx%d image, blurring it exactly\n", imageW, imageH);
+				convolveImageCPUThreaded(inPixels, outPixels, outPitch, imageW, imageH, mask, threads);
+				return;
+			}
+			level = reduced;
+			levelW = (levelW + 1) / 2;
+			levelH = (levelH + 1) / 2;
+		}
+	}
+	{
+		TraceScope trace("level blur");
+		blurSeparable(level, levelW, levelH, kernel, threads);
+	}
+
+	// reduced pixel k sits on padded pixel k * factor, as only even pixels are kept
+	TraceScope trace("expand");
+	forRowBands(imageH, threads, [&](int firstRow, int lastRow) {
+		for (int y = firstRow; y < lastRow; y++) {
+			float py = (float)(y + pad) / factor;
+			int y0 = std::min((int)py, levelH - 1);
+			int y1 = std::min(y0 + 1, levelH - 1);
+			float fy = py - (int)py;
+			const float* row0 = level + (size_t)y0 * levelW * 4;
+			const float* row1 = level + (size_t)y1 * levelW * 4;
+			unsigned char* outRow = outPixels + y * outPitch;
+			for (int x = 0; x < imageW; x++) {
+				float px = (float)(x + pad) / factor;
+				int x0 = std::min((int)px, levelW - 1);
+				int x1 = std::min(x0 + 1, levelW - 1);
+				float fx = px - (int)px;
+				for (int c = 0; c < 3; c++) {
+					float top = row0[x0 * 4 + c] + (row0[x1 * 4 + c] - row0[x0 * 4 + c]) * fx;
+					float bottom = row1[x0 * 4 + c] + (row1[x1 * 4 + c] - row1[x0 * 4 + c]) * fx;
+					float value = top + (bottom - top) * fy;
+					outRow[x * 4 + c] = (unsigned char)(fmaxf(0, fminf(value, 255.0f)));
+				}
+				outRow[x * 4 + 3] = 255;
+			}
+		}
+	});
+	free(level);
+}
+
+// The 1D pyramid (halvings, level kernel, bilinear scale up) applied to a signal, with the same edge clamping.
+static std::vector<double> pyramid1D(const std::vector<double>& signal, int levels, const std::vector<float>& kernel)
+{
+	std::vector<double> level = signal;
+	for (int l = 0; l < levels; l++) {
+		std::vector<double> reduced((level.size() + 1) / 2);
+		for (int x = 0; x < (int)reduced.size(); x++) {
+			double sum = 0.0;
+			for (int t = 0; t < 5; t++)
+				sum += REDUCE_TAPS[t] * level[clampIndex(2 * x + t - 2, (int)level.size())];
+			reduced[x] = sum / 16.0;
+		}
+		level.swap(reduced);
+	}
+	int offset = (int)kernel.size() / 2;
+	std::vector<double> blurred(level.size());
+	for (int x = 0; x < (int)level.size(); x++) {
+		for (int d = -offset; d <= offset; d++)
+			blurred[x] += kernel[d + offset] * level[clampIndex(x + d, (int)level.size())];
+	}
+	double factor = (double)(1 << levels);
+	std::vector<double> result(signal.size());
+	for (int x = 0; x < (int)signal.size(); x++) {
+		double p = x / factor;
+		int x0 = std::min((int)p, (int)blurred.size() - 1);
+		int x1 = std::min(x0 + 1, (int)blurred.size() - 1);
+		result[x] = blurred[x0] + (blurred[x1] - blurred[x0]) * (p - (int)p);
+	}
+	return result;
+}
+
+////
+// Bound on how far (per channel, out of 255) convolveImagePyramid with these levels can be from the exact
+// convolution, for any image.
+// Both blurs are separable, so with h the pyramid's 1D response at an output pixel and g the mask's 1D
+// kernel, the difference of the 2D kernels sums to at most 2 * sum|h - g|, and half of that can line up
+// with the sign of the image. h depends on where the pixel falls between the reduced pixels, so the worst
+// of those positions is taken. Add 1 for the rounding to 8 bits.
+// Returns 0 for levels 0 (exact), and 256 if the levels can't be used with this mask.
+////
+float pyramidErrorBound(const ConvMask* mask, int levels)
+{
+	std::vector<float> kernel;
+	if (levels <= 0)
+		return 0.0f;
+	if (levels > PYRAMID_MAX_LEVELS || !levelKernel(mask, levels, &kernel))
+		return 256.0f;
+
+	// 1D kernel of the mask, its 2D values are the product of two of these
+	std::vector<double> target(mask->size);
+	double sum = 0.0;
+	for (int d = -mask->offset; d <= mask->offset; d++) {
+		target[d + mask->offset] = exp(-(d * d) / (2.0 * mask->stdv * mask->stdv));
+		sum += target[d + mask->offset];
+	}
+	for (int d = 0; d < mask->size; d++)
+		target[d] /= sum;
+
+	// a signal long enough that the output pixels looked at never see its ends
+	int factor = 1 << levels;
+	int reach = mask->offset + ((int)kernel.size() / 2 + 4) * factor;
+	int length = ((2 * reach + 2 * factor) / factor + 1) * factor + 1;
+	int first = (length / 2 / factor) * factor;
+
+	// response[i][x]: output x for a unit impulse at i
+	std::vector<std::vector<double> > response(length);
+	for (int i = 0; i < length; i++) {
+		std::vector<double> impulse(length, 0.0);
+		impulse[i] = 1.0;
+		response[i] = pyramid1D(impulse, levels, kernel);
+	}
+	double worst = 0.0;
+	for (int x = first; x < first + factor; x++) {
+		double difference = 0.0;
+		for (int i = 0; i < length; i++) {
+			int d = i - x;
+			double expected = (d >= -mask->offset && d <= mask->offset) ? target[d + mask->offset] : 0.0;
+			difference += fabs(response[i][x] - expected);
+		}
+		worst = std::max(worst, difference);
+	}
+	return (float)std::min(255.0 * worst + 1.0, 255.0);
+}
+
+////
+// Most levels (up to PYRAMID_MAX_LEVELS) whose error bound is at most maxError, 0 if none is.
+////
+int choosePyramidLevels(const ConvMask* mask, float maxError)
+{
+	for (int levels = PYRAMID_MAX_LEVELS; levels > 0; levels--) {
+		if (pyramidErrorBound(mask, levels) <= maxError)
+			return levels;
+	}
+	return 0;
+}
+
+// Backend: the pyramid with as many levels as the error bound allows, the exact convolution if none.
+void convolvePyramidAuto(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads)
+{
+	int levels = choosePyramidLevels(mask, PYRAMID_MAX_ERROR);
+	convolveImagePyramid(inPixels, outPixels, outPitch, imageW, imageH, mask, levels, threads);
+}
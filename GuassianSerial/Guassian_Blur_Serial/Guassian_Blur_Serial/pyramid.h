@@ -0,0 +1,16 @@
+#pragma once
+
+#include "blur.h"
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Most times the image is halved before blurring
+#define PYRAMID_MAX_LEVELS 4
+// Largest error bound (per channel, out of 255) the pyramid backend accepts when picking the levels
+#define PYRAMID_MAX_ERROR 8.0f
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+float pyramidErrorBound(const ConvMask* mask, int levels);
+int choosePyramidLevels(const ConvMask* mask, float maxError);
+void convolveImagePyramid(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int levels, int threads);
+void convolvePyramidAuto(float* inPixels, unsigned char* outPixels, int outPitch, int imageW, int imageH, const ConvMask* mask, int threads);
@@ -0,0 +1,247 @@
+#include "roi.h"
+#include "bench.h"
+#include "blur.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGE = "synth:noise:4k";
+// Regions used when none are given, spread along the diagonal like a few faces in a frame.
+static const int DEFAULT_REGION_COUNT = 4;
+static const int DEFAULT_REGION_SIZE = 128;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a region blur run, filled in from the command line.
+////
+struct RegionOptions {
+	const char* image;
+	const char* outputPath; // NULL to not save the result
+	std::vector<BlurRect> rects; // empty for the default regions
+	bool ellipses; // blur the ellipse inside each rectangle rather than all of it
+	int maskSize;
+	float stdv;
+	int repeat;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Coverage of the ellipse filling a w x h rectangle, 255 inside and 0 outside.
+static std::vector<unsigned char> ellipseCoverage(int w, int h)
+{
+	std::vector<unsigned char> coverage((size_t)w * h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			double dx = (x + 0.5) / w * 2.0 - 1.0;
+			double dy = (y + 0.5) / h * 2.0 - 1.0;
+			coverage[(size_t)y * w + x] = dx * dx + dy * dy <= 1.0 ? 255 : 0;
+		}
+	}
+	return coverage;
+}
+
+static void printRegionUsage(const char* program)
+{
+	printf("Usage: %s --roi [options]\n", program);
+	printf("  --input <image>      image to redact (default %s)\n", DEFAULT_IMAGE);
+	printf("  --region <x,y,w,h>   rectangle to blur, may be given several times (default %d %dx%d regions\n",
+		DEFAULT_REGION_COUNT, DEFAULT_REGION_SIZE, DEFAULT_REGION_SIZE);
+	printf("                       along the diagonal)\n");
+	printf("  --ellipses           blur the ellipse inside each rectangle instead of all of it\n");
+	printf("  --output <file>      save the redacted image\n");
+	printf("  --mask <n>           mask width (default 13)\n");
+	printf("  --sigma <f>          strength of the blur (default 10)\n");
+	printf("  --repeat <n>         timed runs of the region and whole-image blur, the median is reported (default 3)\n");
+}
+
+////
+// Read the region blur command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseRegionOptions(int argc, char** argv, RegionOptions* options)
+{
+	options->image = DEFAULT_IMAGE;
+	options->outputPath = NULL;
+	options->ellipses = false;
+	options->maskSize = 13;
+	options->stdv = 10.0f;
+	options->repeat = 3;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (strcmp(arg, "--ellipses") == 0) {
+			options->ellipses = true;
+			continue;
+		}
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->image = value;
+		else if (strcmp(arg, "--output") == 0)
+			options->outputPath = value;
+		else if (strcmp(arg, "--region") == 0) {
+			BlurRect rect;
+			if (sscanf(value, "%d,%d,%d,%d", &rect.x, &rect.y, &rect.w, &rect.h) != 4 || rect.w < 1 || rect.h < 1) {
+				fprintf(stderr, "Regions are written x,y,w,h with a positive width and height, not %s\n", value);
+				return false;
+			}
+			options->rects.push_back(rect);
+		}
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--repeat") == 0)
+			options->repeat = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->repeat < 1) {
+		fprintf(stderr, "Repeat must be at least 1\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Region blur entry point, argv[0] is "--roi".
+// Blurs only the given regions of an image with blurRegionsInPlace and compares the time with blurring the
+// whole image, then checks the regions match the whole-image blur and everything else is untouched.
+// Returns 0 if they do, 2 if not, 1 on other errors.
+////
+int runRegionBlur(int argc, char** argv)
+{
+	RegionOptions options;
+	if (!parseRegionOptions(argc, argv, &options)) {
+		printRegionUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	int imageW, imageH;
+	float* inPixels = loadFloatImage(options.image, &imageW, &imageH);
+	if (inPixels == NULL)
+		return 1;
+	printf("Loaded %dx%d image.\n", imageW, imageH);
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+
+	if (options.rects.empty()) {
+		for (int r = 0; r < DEFAULT_REGION_COUNT; r++) {
+			BlurRect rect;
+			rect.w = std::min(DEFAULT_REGION_SIZE, imageW);
+			rect.h = std::min(DEFAULT_REGION_SIZE, imageH);
+			rect.x = (imageW - rect.w) * (2 * r + 1) / (2 * DEFAULT_REGION_COUNT);
+			rect.y = (imageH - rect.h) * (2 * r + 1) / (2 * DEFAULT_REGION_COUNT);
+			options.rects.push_back(rect);
+		}
+	}
+	std::vector<std::vector<unsigned char> > coverages(options.rects.size());
+	std::vector<BlurRegion> regions(options.rects.size());
+	for (size_t r = 0; r < regions.size(); r++) {
+		regions[r].rect = options.rects[r];
+		regions[r].coverage = NULL;
+		if (options.ellipses) {
+			coverages[r] = ellipseCoverage(options.rects[r].w, options.rects[r].h);
+			regions[r].coverage = &coverages[r][0];
+		}
+	}
+
+	int pitch = imageW * 4;
+	size_t bytes = (size_t)pitch * imageH;
+	std::vector<unsigned char> original(bytes);
+	for (size_t p = 0; p < bytes; p++)
+		original[p] = (unsigned char)inPixels[p];
+	std::vector<unsigned char> redacted(bytes);
+	std::vector<unsigned char> full(bytes);
+
+	printf("Blurring %d %s in %s (%dx%d), mask %dx%d sigma %g.\n", (int)regions.size(), options.ellipses ? "ellipses" : "rectangles",
+		options.image, imageW, imageH, mask.size, mask.size, mask.stdv);
+	std::vector<double> regionMs, fullMs;
+	long long blurred = 0;
+	for (int r = 0; r < options.repeat; r++) {
+		// the copy stands in for the caller's frame, it isn't part of the work being timed
+		memcpy(&redacted[0], &original[0], bytes);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		blurred = blurRegionsInPlace(&redacted[0], pitch, imageW, imageH, &mask, &regions[0], (int)regions.size());
+		regionMs.push_back(millisecondsSince(start));
+
+		start = std::chrono::steady_clock::now();
+		convolveImageCPU(inPixels, &full[0], pitch, imageW, imageH, &mask);
+		fullMs.push_back(millisecondsSince(start));
+	}
+	free(inPixels);
+
+	// every pixel must be either untouched or the same as in the whole-image blur, and the pixels the
+	// regions cover must be the blurred ones
+	std::vector<unsigned char> covered((size_t)imageW * imageH, 0);
+	for (size_t r = 0; r < regions.size(); r++) {
+		const BlurRect& rect = regions[r].rect;
+		for (int y = std::max(rect.y, 0); y < std::min(rect.y + rect.h, imageH); y++) {
+			for (int x = std::max(rect.x, 0); x < std::min(rect.x + rect.w, imageW); x++) {
+				if (regions[r].coverage == NULL || regions[r].coverage[(y - rect.y) * rect.w + (x - rect.x)] != 0)
+					covered[(size_t)y * imageW + x] = 1;
+			}
+		}
+	}
+	long long wrong = 0;
+	for (size_t p = 0; p < covered.size(); p++) {
+		const unsigned char* expected = covered[p] ? &full[p * 4] : &original[p * 4];
+		if (memcmp(&redacted[p * 4], expected, 4) != 0)
+			wrong++;
+	}
+
+	if (options.outputPath != NULL) {
+		SDL_Surface* surface = createResultSurface(imageW, imageH);
+		if (surface == NULL) {
+			fprintf(stderr, "Could not create the output surface: %s\n", SDL_GetError());
+			return 1;
+		}
+		for (int y = 0; y < imageH; y++)
+			memcpy((unsigned char*)surface->pixels + y * surface->pitch, &redacted[(size_t)y * pitch], pitch);
+		bool saved = saveImage(surface, options.outputPath);
+		SDL_FreeSurface(surface);
+		if (!saved)
+			return 1;
+		printf("Saved %s.\n", options.outputPath);
+	}
+
+	std::sort(regionMs.begin(), regionMs.end());
+	std::sort(fullMs.begin(), fullMs.end());
+	double regionMedian = percentile(regionMs, 0.5);
+	double fullMedian = percentile(fullMs, 0.5);
+	printf("Blurred %lld pixels, %.3f%% of the image.\n", blurred, 100.0 * blurred / ((double)imageW * imageH));
+	printf("%-8s %9s\n", "", "median");
+	printf("%-8s %7.3fms\n", "regions", regionMedian);
+	printf("%-8s %7.3fms\n", "full", fullMedian);
+	printf("Speedup %.1fx.\n", regionMedian > 0.0 ? fullMedian / regionMedian : 0.0);
+	if (wrong > 0) {
+		printf("FAILED: %lld pixels differ from the whole-image blur or the original.\n", wrong);
+		return 2;
+	}
+	printf("The regions match the whole-image blur and the rest of the image is untouched.\n");
+	return 0;
+}
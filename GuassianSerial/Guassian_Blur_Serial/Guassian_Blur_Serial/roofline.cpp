@@ -0,0 +1,219 @@
+#include "roofline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Elements in each of the three bandwidth probe arrays (64MB of doubles each), well past any last level cache.
+static const size_t STREAM_ELEMENTS = (size_t)1 << 23;
+// Independent FMA chains per thread in the compute probe, enough to hide the FMA latency.
+static const int FMA_CHAINS = 32;
+static const int FMA_ITERATIONS = 1 << 23;
+// Each probe is run this many times and the best run is kept.
+static const int PROBE_RUNS = 5;
+// Bytes moved from memory per last level cache miss.
+static const double CACHE_LINE_BYTES = 64.0;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// STREAM triad on one thread's slice: a = b + scalar * c
+static void triadWorker(double* a, const double* b, const double* c, size_t first, size_t last)
+{
+	const double scalar = 3.0;
+	for (size_t i = first; i < last; i++)
+		a[i] = b[i] + scalar * c[i];
+}
+
+// Touch one thread's slice so its pages are mapped (and placed near that thread) before timing.
+static void initWorker(double* a, double* b, double* c, size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+		a[i] = 0.0;
+		b[i] = 1.0;
+		c[i] = 2.0;
+	}
+}
+
+// Multiply-add chains that don't depend on each other, so they can issue back to back.
+static void fmaWorker(float* result)
+{
+	float acc[FMA_CHAINS];
+	for (int k = 0; k < FMA_CHAINS; k++)
+		acc[k] = 1.0f + k * 0.001f;
+	const float a = 0.9999999f;
+	const float b = 0.0000001f;
+	for (int i = 0; i < FMA_ITERATIONS; i++) {
+		for (int k = 0; k < FMA_CHAINS; k++)
+			acc[k] = acc[k] * a + b;
+	}
+	float sum = 0.0f;
+	for (int k = 0; k < FMA_CHAINS; k++)
+		sum += acc[k];
+	*result = sum; // keeps the loop from being optimized away
+}
+
+////
+// Measure the memory bandwidth (STREAM triad) and floating point throughput (FMA chains)
+// this machine reaches with the given number of threads. Takes around a second.
+// The FMA probe measures what this build's compiler flags can reach, the same code generation the backends get.
+////
+MachinePeaks measureMachinePeaks(int threads)
+{
+	MachinePeaks peaks;
+	peaks.threads = threads < 1 ? 1 : threads;
+	peaks.bandwidthGBs = 0.0;
+	peaks.gflops = 0.0;
+
+	double* a = (double*)malloc(STREAM_ELEMENTS * sizeof(double));
+	double* b = (double*)malloc(STREAM_ELEMENTS * sizeof(double));
+	double* c = (double*)malloc(STREAM_ELEMENTS * sizeof(double));
+	if (a == NULL || b == NULL || c == NULL) {
+		fprintf(stderr, "Not enough memory for the bandwidth probe\n");
+		free(a);
+		free(b);
+		free(c);
+		return peaks;
+	}
+
+	size_t slice = (STREAM_ELEMENTS + peaks.threads - 1) / peaks.threads;
+	std::vector<std::thread> workers;
+	for (int t = 0; t < peaks.threads; t++) {
+		size_t first = t * slice;
+		size_t last = first + slice > STREAM_ELEMENTS ? STREAM_ELEMENTS : first + slice;
+		workers.push_back(std::thread(initWorker, a, b, c, first, last));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	double bestSeconds = 0.0;
+	for (int run = 0; run < PROBE_RUNS; run++) {
+		workers.clear();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int t = 0; t < peaks.threads; t++) {
+			size_t first = t * slice;
+			size_t last = first + slice > STREAM_ELEMENTS ? STREAM_ELEMENTS : first + slice;
+			workers.push_back(std::thread(triadWorker, a, b, c, first, last));
+		}
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (run == 0 || seconds < bestSeconds)
+			bestSeconds = seconds;
+	}
+	// STREAM counts two reads and one write per element
+	peaks.bandwidthGBs = 3.0 * sizeof(double) * STREAM_ELEMENTS / bestSeconds / 1e9;
+	free(a);
+	free(b);
+	free(c);
+
+	std::vector<float> sinks(peaks.threads);
+	for (int run = 0; run < PROBE_RUNS; run++) {
+		workers.clear();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int t = 0; t < peaks.threads; t++)
+			workers.push_back(std::thread(fmaWorker, &sinks[t]));
+		for (size_t t = 0; t < workers.size(); t++)
+			workers[t].join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (run == 0 || seconds < bestSeconds)
+			bestSeconds = seconds;
+	}
+	// a multiply and an add per chain per iteration
+	peaks.gflops = 2.0 * FMA_CHAINS * (double)FMA_ITERATIONS * peaks.threads / bestSeconds / 1e9;
+	return peaks;
+}
+
+////
+// Floating point operations for one blur: a multiply and an add per mask value, per colour channel, per pixel.
+////
+double blurFlops(int imageW, int imageH, int maskSize)
+{
+	return 2.0 * 3.0 * maskSize * maskSize * (double)imageW * imageH;
+}
+
+////
+// Compulsory memory traffic for one blur: the RGBA float input read once and the 8-bit RGBA output written once.
+// Backends that re-read the input from memory move more than this, which shows up as a lower achieved intensity.
+////
+double blurBytes(int imageW, int imageH)
+{
+	return (4.0 * sizeof(float) + 4.0) * (double)imageW * imageH;
+}
+
+////
+// Place a result on the roofline, using its median time.
+// The traffic is what the backend actually read from memory (last level cache misses) when that counter was
+// available, so backends with different access patterns get their own intensity. Otherwise it's the compulsory
+// traffic, which only depends on the image size.
+// peaks may be NULL, then only the intensity and achieved rates are filled in.
+////
+RooflinePoint rooflinePoint(const BenchResult* result, const MachinePeaks* peaks)
+{
+	RooflinePoint point;
+	point.flops = blurFlops(result->imageW, result->imageH, result->maskSize);
+	point.bytes = blurBytes(result->imageW, result->imageH);
+	point.measuredTraffic = result->counters.valid[COUNTER_LLC_MISSES];
+	if (point.measuredTraffic) {
+		// the counter only sees reads, the output is written once; prefetched lines aren't counted as misses,
+		// so never go below the compulsory traffic
+		double measured = result->counters.values[COUNTER_LLC_MISSES] * CACHE_LINE_BYTES + 4.0 * result->imageW * result->imageH;
+		if (measured > point.bytes)
+			point.bytes = measured;
+	}
+	point.intensity = point.flops / point.bytes;
+	double seconds = result->medianMs / 1000.0;
+	point.achievedGflops = seconds > 0.0 ? point.flops / seconds / 1e9 : 0.0;
+	point.achievedGBs = seconds > 0.0 ? point.bytes / seconds / 1e9 : 0.0;
+
+	point.attainableGflops = 0.0;
+	point.memoryBound = false;
+	if (peaks == NULL)
+		return point;
+
+	double bandwidthRoof = point.intensity * peaks->bandwidthGBs;
+	point.memoryBound = bandwidthRoof < peaks->gflops;
+	point.attainableGflops = point.memoryBound ? bandwidthRoof : peaks->gflops;
+	return point;
+}
+
+////
+// Print the machine peaks and, for every backend and mask width, where its best run sits on the roofline.
+// Rows without a measured traffic are placed by the compulsory traffic, the same for every backend, and are
+// labelled "minimum". Approximate backends do less work than blurFlops counts, so they are left out.
+////
+void printRooflineReport(const std::vector<BenchResult>& results, const MachinePeaks* peaks)
+{
+	printf("\nRoofline (%d threads): peak %.1f GFLOP/s, %.1f GB/s, ridge point %.2f FLOP/byte\n",
+		peaks->threads, peaks->gflops, peaks->bandwidthGBs, peaks->gflops / peaks->bandwidthGBs);
+	printf("%-10s %7s %5s %10s %9s %10s %10s %8s  %s\n", "backend", "threads", "mask", "FLOP/byte", "traffic", "GFLOP/s", "GB/s", "of roof", "bound");
+
+	// one line per backend, thread count and mask width, using the fastest (highest GFLOP/s) result
+	std::vector<bool> done(results.size(), false);
+	int approximate = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		if (done[i])
+			continue;
+		if (!results[i].backend->exact) {
+			approximate++;
+			continue;
+		}
+		size_t best = i;
+		for (size_t j = i; j < results.size(); j++) {
+			if (results[j].backend == results[i].backend && results[j].threads == results[i].threads && results[j].maskSize == results[i].maskSize) {
+				done[j] = true;
+				if (rooflinePoint(&results[j], peaks).achievedGflops > rooflinePoint(&results[best], peaks).achievedGflops)
+					best = j;
+			}
+		}
+
+		RooflinePoint point = rooflinePoint(&results[best], peaks);
+		printf("%-10s %7d %5d %10.2f %9s %10.2f %10.2f %7.1f%%  %s\n",
+			results[best].backend->name, results[best].threads, results[best].maskSize, point.intensity,
+			point.measuredTraffic ? "measured" : "minimum", point.achievedGflops, point.achievedGBs, 100.0 * point.achievedGflops / point.attainableGflops,
+			point.memoryBound ? "memory" : "compute");
+	}
+	if (approximate > 0)
+		printf("Left out %d result(s) of approximate backends, they don't do the work of the full convolution.\n", approximate);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "bench.h"
+
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Peaks of this machine as measured by the built in probes.
+////
+struct MachinePeaks {
+	int threads; // threads the probes ran on
+	double bandwidthGBs; // STREAM triad style memory bandwidth
+	double gflops; // single precision FMA throughput
+};
+
+////
+// Where one benchmark result sits on the roofline.
+////
+struct RooflinePoint {
+	double flops; // floating point operations per run
+	double bytes; // memory traffic per run, measured if the LLC miss counter was available, otherwise the compulsory minimum
+	bool measuredTraffic; // false if bytes is only the compulsory traffic, then the verdict is the same for every backend
+	double intensity; // flops per byte
+	double achievedGflops; // using the median time
+	double achievedGBs;
+	double attainableGflops; // roof at this intensity, min(peak flops, intensity * peak bandwidth)
+	bool memoryBound; // intensity is left of the ridge point
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+MachinePeaks measureMachinePeaks(int threads);
+double blurFlops(int imageW, int imageH, int maskSize);
+double blurBytes(int imageW, int imageH);
+RooflinePoint rooflinePoint(const BenchResult* result, const MachinePeaks* peaks);
+void printRooflineReport(const std::vector<BenchResult>& results, const MachinePeaks* peaks);
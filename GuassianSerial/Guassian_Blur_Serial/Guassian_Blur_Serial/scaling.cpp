@@ -0,0 +1,349 @@
+#include "scaling.h"
+#include "bench.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGE = "1080p.jpg";
+static const char* DEFAULT_BACKEND = "threads";
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a scaling study, filled in from the command line.
+////
+struct ScalingOptions {
+	const char* image; // strong scaling image, and the size weak scaling starts from
+	const Backend* backend;
+	int maskSize;
+	float stdv;
+	int maxThreads; // thread counts are 1, 2, 4 ... up to and including this
+	int warmupRuns;
+	int timedRuns;
+	bool weak; // also run weak scaling
+	const char* weakImages; // comma separated image per thread count for weak scaling, NULL to generate them
+	const char* csvPath; // NULL to not write a CSV file
+};
+
+////
+// Median time of one thread count, for strong or weak scaling.
+////
+struct ScalingPoint {
+	int threads;
+	std::string image;
+	int imageW, imageH;
+	double medianMs;
+	double speedup; // strong: T1 / Tp, weak: scaled speedup (work ratio * T1 / Tp)
+	double efficiency; // speedup / threads
+	double serialFraction; // Karp-Flatt experimentally determined serial fraction, 0 for 1 thread
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+static void printScalingUsage(const char* program)
+{
+	printf("Usage: %s --scaling [options]\n", program);
+	printf("  --image <file>       image for strong scaling, weak scaling starts at its size (default %s)\n", DEFAULT_IMAGE);
+	printf("  --backend <name>     multithreaded backend to scale (default %s)\n", DEFAULT_BACKEND);
+	printf("  --mask <n>           mask width (default 5)\n");
+	printf("  --sigma <f>          strength of the blur (default 5)\n");
+	printf("  --max-threads <n>    run at 1, 2, 4 ... n threads (default %d)\n", defaultThreadCount());
+	printf("  --warmup <n>         untimed runs before timing each thread count (default 1)\n");
+	printf("  --repeat <n>         timed runs of each thread count (default 5)\n");
+	printf("  --no-weak            only run strong scaling\n");
+	printf("  --weak-images <list> one image per thread count for weak scaling, e.g. 480p.jpg,720p.jpg,1080p.jpg\n");
+	printf("                       (default: synthetic noise, the image height times the thread count)\n");
+	printf("  --csv <file>         write both studies as CSV\n");
+}
+
+////
+// Read the scaling command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseScalingOptions(int argc, char** argv, ScalingOptions* options)
+{
+	options->image = DEFAULT_IMAGE;
+	options->backend = findBackend(DEFAULT_BACKEND);
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->maxThreads = defaultThreadCount();
+	options->warmupRuns = 1;
+	options->timedRuns = 5;
+	options->weak = true;
+	options->weakImages = NULL;
+	options->csvPath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (strcmp(arg, "--no-weak") == 0) {
+			options->weak = false;
+			continue;
+		}
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--image") == 0)
+			options->image = value;
+		else if (strcmp(arg, "--backend") == 0) {
+			options->backend = findBackend(value);
+			if (options->backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--max-threads") == 0)
+			options->maxThreads = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0)
+			options->warmupRuns = atoi(value);
+		else if (strcmp(arg, "--repeat") == 0)
+			options->timedRuns = atoi(value);
+		else if (strcmp(arg, "--weak-images") == 0)
+			options->weakImages = value;
+		else if (strcmp(arg, "--csv") == 0)
+			options->csvPath = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->maxThreads < 1 || options->warmupRuns < 0 || options->timedRuns < 1) {
+		fprintf(stderr, "Threads and repeat must be at least 1, warmup at least 0\n");
+		return false;
+	}
+	if (!options->backend->multithreaded)
+		printf("Note: backend %s ignores the thread count, expect no speedup.\n", options->backend->name);
+	return true;
+}
+
+////
+// Least squares fit of Amdahl's law, S(p) = 1 / (f + (1 - f) / p), for the serial fraction f.
+// Rearranged to 1/S - 1/p = f (1 - 1/p), a line through the origin, so f = sum(xy) / sum(xx).
+////
+double fitAmdahlSerialFraction(const std::vector<int>& threads, const std::vector<double>& speedups)
+{
+	double sumXY = 0.0;
+	double sumXX = 0.0;
+	for (size_t i = 0; i < threads.size(); i++) {
+		if (threads[i] < 2 || speedups[i] <= 0.0)
+			continue;
+		double x = 1.0 - 1.0 / threads[i];
+		double y = 1.0 / speedups[i] - 1.0 / threads[i];
+		sumXY += x * y;
+		sumXX += x * x;
+	}
+	return sumXX > 0.0 ? sumXY / sumXX : 0.0;
+}
+
+////
+// Least squares fit of Gustafson's law, S(p) = p - s (p - 1), for the serial fraction s.
+// Rearranged to p - S = s (p - 1), again a line through the origin.
+////
+double fitGustafsonSerialFraction(const std::vector<int>& threads, const std::vector<double>& scaledSpeedups)
+{
+	double sumXY = 0.0;
+	double sumXX = 0.0;
+	for (size_t i = 0; i < threads.size(); i++) {
+		if (threads[i] < 2)
+			continue;
+		double x = threads[i] - 1.0;
+		double y = threads[i] - scaledSpeedups[i];
+		sumXY += x * y;
+		sumXX += x * x;
+	}
+	return sumXX > 0.0 ? sumXY / sumXX : 0.0;
+}
+
+////
+// Karp-Flatt metric, the serial fraction implied by one measured speedup.
+// Growing with the thread count points at overhead (thread start, imbalance) rather than serial code.
+////
+double karpFlattSerialFraction(int threads, double speedup)
+{
+	if (threads < 2 || speedup <= 0.0)
+		return 0.0;
+	return (1.0 / speedup - 1.0 / threads) / (1.0 - 1.0 / threads);
+}
+
+////
+// Time the backend on an image at one thread count.
+// Returns false (after printing why) if the image couldn't be loaded or there isn't enough memory to blur it.
+////
+static bool timeThreads(const ScalingOptions* options, const ConvMask* mask, const char* image, int threads, ScalingPoint* point)
+{
+	int imageW, imageH;
+	float* floatPixels = loadFloatImage(image, &imageW, &imageH);
+	if (floatPixels == NULL)
+		return false;
+	unsigned char* outPixels = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+	if (outPixels == NULL) {
+		fprintf(stderr, "Not enough memory to blur %s\n", image);
+		free(floatPixels);
+		return false;
+	}
+
+	BenchResult result;
+	result.image = image;
+	result.imageW = imageW;
+	result.imageH = imageH;
+	result.backend = options->backend;
+	result.threads = threads;
+	result.maskSize = mask->size;
+	result.stdv = mask->stdv;
+	timeBackend(&result, floatPixels, outPixels, mask, options->warmupRuns, options->timedRuns, NULL);
+	free(outPixels);
+	free(floatPixels);
+
+	point->threads = threads;
+	point->image = image;
+	point->imageW = imageW;
+	point->imageH = imageH;
+	point->medianMs = result.medianMs;
+	return true;
+}
+
+static void printPoints(const std::vector<ScalingPoint>& points, const char* speedupName)
+{
+	printf("%7s %11s %12s %9s %10s %13s\n", "threads", "resolution", "median", speedupName, "efficiency", "Karp-Flatt e");
+	for (size_t i = 0; i < points.size(); i++) {
+		const ScalingPoint& point = points[i];
+		char resolution[32];
+		sprintf(resolution, "%dx%d", point.imageW, point.imageH);
+		printf("%7d %11s %10.3fms %8.2fx %9.1f%% %13.4f\n", point.threads, resolution, point.medianMs,
+			point.speedup, point.efficiency * 100.0, point.serialFraction);
+	}
+}
+
+////
+// Write both studies as CSV.
+// Returns false (after printing why) if the file could not be written.
+////
+static bool writeScalingCSV(const std::vector<ScalingPoint>& strong, const std::vector<ScalingPoint>& weak, const ScalingOptions* options, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	fprintf(file, "study,backend,mask,threads,image,width,height,median_ms,speedup,efficiency,karp_flatt\n");
+	for (int study = 0; study < 2; study++) {
+		const std::vector<ScalingPoint>& points = study == 0 ? strong : weak;
+		for (size_t i = 0; i < points.size(); i++) {
+			const ScalingPoint& p = points[i];
+			fprintf(file, "%s,%s,%d,%d,%s,%d,%d,%.4f,%.4f,%.4f,%.4f\n", study == 0 ? "strong" : "weak",
+				options->backend->name, options->maskSize, p.threads, p.image.c_str(), p.imageW, p.imageH,
+				p.medianMs, p.speedup, p.efficiency, p.serialFraction);
+		}
+	}
+	fclose(file);
+	printf("Wrote %s.\n", path);
+	return true;
+}
+
+////
+// Scaling study entry point, argv[0] is "--scaling".
+// Strong scaling: the same image at 1, 2, 4 ... threads. Weak scaling: the image grows with the thread count,
+// so ideally the time stays flat.
+////
+int runScaling(int argc, char** argv)
+{
+	ScalingOptions options;
+	if (!parseScalingOptions(argc, argv, &options)) {
+		printScalingUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < options.maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(options.maxThreads);
+
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+
+	// strong scaling
+	std::vector<ScalingPoint> strong;
+	std::vector<double> speedups;
+	for (size_t i = 0; i < threadCounts.size(); i++) {
+		ScalingPoint point;
+		if (!timeThreads(&options, &mask, options.image, threadCounts[i], &point))
+			return 1;
+		point.speedup = strong.empty() ? 1.0 : strong[0].medianMs / point.medianMs;
+		point.efficiency = point.speedup / point.threads;
+		point.serialFraction = karpFlattSerialFraction(point.threads, point.speedup);
+		strong.push_back(point);
+		speedups.push_back(point.speedup);
+	}
+	printf("\nStrong scaling, %s mask %dx%d on %s:\n", options.backend->name, mask.size, mask.size, options.image);
+	printPoints(strong, "speedup");
+	double amdahl = fitAmdahlSerialFraction(threadCounts, speedups);
+	printf("Amdahl fit: serial fraction %.4f, speedup limit %.1fx\n", amdahl, amdahl > 0.0 ? 1.0 / amdahl : 0.0);
+
+	// weak scaling, the work per thread stays the size of the strong scaling image
+	std::vector<ScalingPoint> weak;
+	if (options.weak) {
+		std::vector<std::string> weakImages;
+		if (options.weakImages != NULL) {
+			weakImages = splitList(options.weakImages);
+			if (weakImages.size() < threadCounts.size()) {
+				fprintf(stderr, "Need a weak scaling image for each of the %d thread counts\n", (int)threadCounts.size());
+				return 1;
+			}
+		}
+		else {
+			for (size_t i = 0; i < threadCounts.size(); i++) {
+				char spec[64];
+				sprintf(spec, "synth:noise:%dx%d", strong[0].imageW, strong[0].imageH * threadCounts[i]);
+				weakImages.push_back(spec);
+			}
+		}
+
+		std::vector<double> scaledSpeedups;
+		for (size_t i = 0; i < threadCounts.size(); i++) {
+			ScalingPoint point;
+			if (!timeThreads(&options, &mask, weakImages[i].c_str(), threadCounts[i], &point))
+				return 1;
+			if (weak.empty()) {
+				point.speedup = 1.0;
+			}
+			else {
+				// how much more work this was than the 1 thread run, times how much faster per unit of work
+				double workRatio = ((double)point.imageW * point.imageH) / ((double)weak[0].imageW * weak[0].imageH);
+				point.speedup = workRatio * weak[0].medianMs / point.medianMs;
+			}
+			point.efficiency = point.speedup / point.threads;
+			point.serialFraction = karpFlattSerialFraction(point.threads, point.speedup);
+			weak.push_back(point);
+			scaledSpeedups.push_back(point.speedup);
+		}
+		printf("\nWeak scaling, %s mask %dx%d:\n", options.backend->name, mask.size, mask.size);
+		printPoints(weak, "scaled");
+		printf("Gustafson fit: serial fraction %.4f\n", fitGustafsonSerialFraction(threadCounts, scaledSpeedups));
+	}
+
+	if (options.csvPath != NULL && !writeScalingCSV(strong, weak, &options, options.csvPath))
+		return 1;
+	return 0;
+}
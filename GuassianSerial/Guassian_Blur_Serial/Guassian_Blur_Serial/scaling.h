@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+int runScaling(int argc, char** argv);
+double fitAmdahlSerialFraction(const std::vector<int>& threads, const std::vector<double>& speedups);
+double fitGustafsonSerialFraction(const std::vector<int>& threads, const std::vector<double>& scaledSpeedups);
+double karpFlattSerialFraction(int threads, double speedup);
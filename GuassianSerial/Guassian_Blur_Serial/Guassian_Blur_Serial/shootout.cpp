@@ -0,0 +1,433 @@
+#include "shootout.h"
+#include "bench.h"
+#include "image.h"
+#include "validate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGES = "720p.jpg,1080p.jpg";
+static const char* DEFAULT_MASKS = "3,7,13";
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a shootout, filled in from the command line.
+////
+struct ShootoutOptions {
+	std::vector<std::string> images;
+	std::vector<int> masks;
+	float stdv;
+	int threads;
+	int warmupRuns;
+	int timedRuns;
+	const char* cudaPath; // GPU timings written by the CUDA programs' --timings, NULL for none
+	const char* csvPath; // NULL to not write a CSV file
+};
+
+////
+// One GPU run read from a --timings file.
+////
+struct CudaTiming {
+	std::string backend;
+	std::string image;
+	int imageW, imageH;
+	int maskSize;
+	float stdv;
+	double ms; // host-side time of the whole GPU call
+	double kernelMs;
+	long long deviceBytes;
+	int maxError; // against the CUDA program's own CPU version, -1 if it wasn't compared
+};
+
+////
+// One line of the shootout table.
+////
+struct ShootoutRow {
+	std::string backend;
+	std::string threads; // thread count, or "gpu"
+	int runs;
+	double medianMs;
+	double p95Ms;
+	double speedup; // naive median / this median
+	long long memoryBytes; // host buffers plus measured extra, device memory for GPU rows, -1 if unknown
+	int maxError; // against the naive backend, -1 if unknown
+	std::string notes;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+#ifdef __linux__
+
+// A "Key:   value kB" line of /proc/self/status in bytes, -1 if it isn't there.
+static long long processStatusBytes(const char* key)
+{
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file == NULL)
+		return -1;
+	char line[256];
+	long long bytes = -1;
+	size_t length = strlen(key);
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (strncmp(line, key, length) == 0 && line[length] == ':') {
+			bytes = atoll(line + length + 1) * 1024;
+			break;
+		}
+	}
+	fclose(file);
+	return bytes;
+}
+
+////
+// How much the resident set grows past its current size during one run of a backend, in bytes.
+// Resets the peak through /proc/self/clear_refs (Linux 4.0+).
+// Returns -1 if the peak can't be reset or read.
+////
+static long long measureExtraMemory(const Backend* backend, float* inPixels, unsigned char* outPixels, int imageW, int imageH, const ConvMask* mask, int threads)
+{
+	FILE* clearRefs = fopen("/proc/self/clear_refs", "w");
+	if (clearRefs == NULL)
+		return -1;
+	bool reset = fputs("5", clearRefs) >= 0;
+	if (fclose(clearRefs) != 0 || !reset)
+		return -1;
+	long long before = processStatusBytes("VmRSS");
+	backend->convolve(inPixels, outPixels, imageW * 4, imageW, imageH, mask, threads);
+	long long peak = processStatusBytes("VmHWM");
+	if (before < 0 || peak < 0)
+		return -1;
+	return peak > before ? peak - before : 0;
+}
+
+#else
+
+// The peak working set can't be reset on other systems, so the extra memory isn't known.
+static long long measureExtraMemory(const Backend* backend, float* inPixels, unsigned char* outPixels, int imageW, int imageH, const ConvMask* mask, int threads)
+{
+	return -1;
+}
+
+#endif
+
+// File name part of a path.
+static std::string baseName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Split one CSV line, keeping empty fields (splitList drops them).
+static std::vector<std::string> splitFields(const char* line)
+{
+	std::vector<std::string> fields(1);
+	for (const char* c = line; *c != '\0' && *c != '\r' && *c != '\n'; c++) {
+		if (*c == ',')
+			fields.push_back(std::string());
+		else
+			fields.back() += *c;
+	}
+	return fields;
+}
+
+////
+// Read the GPU runs appended by the CUDA programs' --timings option.
+// Returns false (after printing why) if the file can't be read.
+////
+static bool loadCudaTimings(const char* path, std::vector<CudaTiming>* timings)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Could not read %s\n", path);
+		return false;
+	}
+	char line[1024];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		std::vector<std::string> fields = splitFields(line);
+		if (fields.size() < 10 || fields[0] == "backend")
+			continue;
+		CudaTiming timing;
+		timing.backend = fields[0];
+		timing.image = fields[1];
+		timing.imageW = atoi(fields[2].c_str());
+		timing.imageH = atoi(fields[3].c_str());
+		timing.maskSize = atoi(fields[4].c_str());
+		timing.stdv = (float)atof(fields[5].c_str());
+		timing.ms = atof(fields[6].c_str());
+		timing.kernelMs = atof(fields[7].c_str());
+		timing.deviceBytes = atoll(fields[8].c_str());
+		timing.maxError = fields[9].empty() ? -1 : atoi(fields[9].c_str());
+		timings->push_back(timing);
+	}
+	fclose(file);
+	printf("Read %d GPU runs from %s.\n", (int)timings->size(), path);
+	return true;
+}
+
+////
+// Rows for the GPU runs of one image, mask and sigma, one per GPU backend (runs of it are summarized).
+// Images are matched on file name and size, so the CUDA programs can be run from another directory.
+////
+static void addCudaRows(const std::vector<CudaTiming>& timings, const std::string& image, int imageW, int imageH,
+	const ConvMask* mask, std::vector<ShootoutRow>* rows)
+{
+	std::vector<std::string> names;
+	for (size_t i = 0; i < timings.size(); i++) {
+		if (std::find(names.begin(), names.end(), timings[i].backend) == names.end())
+			names.push_back(timings[i].backend);
+	}
+	for (size_t n = 0; n < names.size(); n++) {
+		BenchResult times; // just for summarizeSamples
+		std::vector<double> kernelMs;
+		long long deviceBytes = -1;
+		int maxError = -1;
+		for (size_t i = 0; i < timings.size(); i++) {
+			const CudaTiming& t = timings[i];
+			if (t.backend != names[n] || baseName(t.image) != baseName(image) || t.imageW != imageW || t.imageH != imageH ||
+				t.maskSize != mask->size || fabs(t.stdv - mask->stdv) > 1e-4f)
+				continue;
+			times.samples.push_back(t.ms);
+			kernelMs.push_back(t.kernelMs);
+			deviceBytes = t.deviceBytes;
+			maxError = std::max(maxError, t.maxError);
+		}
+		if (times.samples.empty())
+			continue;
+		summarizeSamples(&times);
+		std::sort(kernelMs.begin(), kernelMs.end());
+
+		ShootoutRow row;
+		row.backend = names[n];
+		row.threads = "gpu";
+		row.runs = (int)times.samples.size();
+		row.medianMs = times.medianMs;
+		row.p95Ms = times.p95Ms;
+		row.memoryBytes = deviceBytes;
+		row.maxError = maxError;
+		char notes[128];
+		sprintf(notes, "host-side incl. copies, kernel %.3fms, memory is device", percentile(kernelMs, 0.5));
+		row.notes = notes;
+		rows->push_back(row);
+	}
+}
+
+static void printShootoutUsage(const char* program)
+{
+	printf("Usage: %s --shootout [options]\n", program);
+	printf("  --images <list>  comma separated images (default %s)\n", DEFAULT_IMAGES);
+	printf("  --masks <list>   comma separated mask widths (default %s)\n", DEFAULT_MASKS);
+	printf("  --sigma <f>      strength of the blur (default 5)\n");
+	printf("  --threads <n>    threads for multithreaded backends (default %d)\n", defaultThreadCount());
+	printf("  --warmup <n>     untimed runs before timing each backend (default 1)\n");
+	printf("  --repeat <n>     timed runs of each backend (default 5)\n");
+	printf("  --cuda <file>    add GPU runs written by the CUDA programs' --timings option to the table\n");
+	printf("  --csv <file>     write the ranked tables as CSV\n");
+	printf("Every backend in this build runs on the same inputs:\n");
+	for (int i = 0; i < backendCount; i++)
+		printf("  %-10s %s\n", backends[i].name, backends[i].description);
+}
+
+////
+// Read the shootout command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseShootoutOptions(int argc, char** argv, ShootoutOptions* options)
+{
+	const char* images = DEFAULT_IMAGES;
+	const char* masks = DEFAULT_MASKS;
+	options->stdv = 5.0f;
+	options->threads = defaultThreadCount();
+	options->warmupRuns = 1;
+	options->timedRuns = 5;
+	options->cudaPath = NULL;
+	options->csvPath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--images") == 0)
+			images = value;
+		else if (strcmp(arg, "--masks") == 0)
+			masks = value;
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0)
+			options->warmupRuns = atoi(value);
+		else if (strcmp(arg, "--repeat") == 0)
+			options->timedRuns = atoi(value);
+		else if (strcmp(arg, "--cuda") == 0)
+			options->cudaPath = value;
+		else if (strcmp(arg, "--csv") == 0)
+			options->csvPath = value;
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->threads < 1 || options->warmupRuns < 0 || options->timedRuns < 1) {
+		fprintf(stderr, "Threads and repeat must be at least 1, warmup at least 0\n");
+		return false;
+	}
+	options->images = splitList(images);
+	if (!parseMaskList(masks, &options->masks))
+		return false;
+	if (options->images.empty() || options->masks.empty()) {
+		fprintf(stderr, "Nothing to do\n");
+		return false;
+	}
+	return true;
+}
+
+static bool fasterRow(const ShootoutRow& a, const ShootoutRow& b)
+{
+	return a.medianMs < b.medianMs;
+}
+
+////
+// Shootout mode entry point, argv[0] is "--shootout".
+// Runs every backend on the same images and masks and prints one table per combination, ranked by median
+// latency, with the speedup over the naive backend, memory use and the largest difference from its output.
+// Returns 0 on success, 1 on failure.
+////
+int runShootout(int argc, char** argv)
+{
+	ShootoutOptions options;
+	if (!parseShootoutOptions(argc, argv, &options)) {
+		printShootoutUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	std::vector<CudaTiming> cudaTimings;
+	if (options.cudaPath != NULL && !loadCudaTimings(options.cudaPath, &cudaTimings))
+		return 1;
+
+	FILE* csv = NULL;
+	if (options.csvPath != NULL) {
+		csv = fopen(options.csvPath, "w");
+		if (csv == NULL) {
+			fprintf(stderr, "Could not write %s\n", options.csvPath);
+			return 1;
+		}
+		fprintf(csv, "image,width,height,mask,sigma,rank,backend,threads,runs,median_ms,p95_ms,speedup,memory_bytes,max_error\n");
+	}
+
+	bool extraMemoryKnown = true;
+	int tables = 0;
+	for (size_t i = 0; i < options.images.size(); i++) {
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.images[i].c_str(), &imageW, &imageH);
+		if (floatPixels == NULL)
+			continue;
+		size_t bufferBytes = (size_t)imageW * imageH * (4 * sizeof(float) + 4);
+		unsigned char* reference = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		unsigned char* outPixels = (unsigned char*)malloc((size_t)4 * imageW * imageH);
+		if (reference == NULL || outPixels == NULL) {
+			fprintf(stderr, "Not enough memory to blur %s, skipping it\n", options.images[i].c_str());
+			free(outPixels);
+			free(reference);
+			free(floatPixels);
+			continue;
+		}
+
+		for (size_t m = 0; m < options.masks.size(); m++) {
+			ConvMask mask;
+			generateGuassianKernel(&mask, options.masks[m], options.stdv);
+			// backends[0] is the naive reference every speedup and error is measured against
+			backends[0].convolve(floatPixels, reference, imageW * 4, imageW, imageH, &mask, 1);
+
+			std::vector<ShootoutRow> rows;
+			double naiveMs = 0.0;
+			for (int b = 0; b < backendCount; b++) {
+				BenchResult result;
+				result.image = options.images[i];
+				result.imageW = imageW;
+				result.imageH = imageH;
+				result.backend = &backends[b];
+				result.threads = result.backend->multithreaded ? options.threads : 1;
+				result.maskSize = mask.size;
+				result.stdv = mask.stdv;
+				timeBackend(&result, floatPixels, outPixels, &mask, options.warmupRuns, options.timedRuns, NULL);
+				if (b == 0)
+					naiveMs = result.medianMs;
+
+				ErrorStats stats;
+				compareImages(outPixels, imageW * 4, reference, imageW * 4, imageW, imageH, 0, options.threads, &stats);
+				long long extraBytes = measureExtraMemory(result.backend, floatPixels, outPixels, imageW, imageH, &mask, result.threads);
+				if (extraBytes < 0)
+					extraMemoryKnown = false;
+
+				ShootoutRow row;
+				row.backend = result.backend->name;
+				char threads[16];
+				sprintf(threads, "%d", result.threads);
+				row.threads = threads;
+				row.runs = (int)result.samples.size();
+				row.medianMs = result.medianMs;
+				row.p95Ms = result.p95Ms;
+				row.memoryBytes = (long long)bufferBytes + (extraBytes > 0 ? extraBytes : 0);
+				row.maxError = stats.maxError;
+				rows.push_back(row);
+			}
+			addCudaRows(cudaTimings, options.images[i], imageW, imageH, &mask, &rows);
+
+			std::stable_sort(rows.begin(), rows.end(), fasterRow);
+			printf("\n%s (%dx%d) mask %dx%d sigma %g\n", options.images[i].c_str(), imageW, imageH, mask.size, mask.size, mask.stdv);
+			printf("%4s %-12s %7s %12s %12s %8s %10s %9s  %s\n", "rank", "backend", "threads", "median", "p95", "speedup", "memory", "max error", "notes");
+			for (size_t r = 0; r < rows.size(); r++) {
+				ShootoutRow& row = rows[r];
+				row.speedup = row.medianMs > 0.0 ? naiveMs / row.medianMs : 0.0;
+				char memory[32];
+				char maxError[16];
+				if (row.memoryBytes >= 0)
+					sprintf(memory, "%.1fMB", row.memoryBytes / (1024.0 * 1024.0));
+				else
+					sprintf(memory, "-");
+				if (row.maxError >= 0)
+					sprintf(maxError, "%d", row.maxError);
+				else
+					sprintf(maxError, "-");
+				printf("%4d %-12s %7s %10.3fms %10.3fms %7.2fx %10s %9s  %s\n", (int)r + 1, row.backend.c_str(), row.threads.c_str(),
+					row.medianMs, row.p95Ms, row.speedup, memory, maxError, row.notes.c_str());
+				if (csv != NULL)
+					fprintf(csv, "%s,%d,%d,%d,%g,%d,%s,%s,%d,%.4f,%.4f,%.4f,%lld,%d\n", options.images[i].c_str(), imageW, imageH,
+						mask.size, mask.stdv, (int)r + 1, row.backend.c_str(), row.threads.c_str(), row.runs, row.medianMs,
+						row.p95Ms, row.speedup, row.memoryBytes, row.maxError);
+			}
+			tables++;
+		}
+
+		free(outPixels);
+		free(reference);
+		free(floatPixels);
+	}
+
+	if (!extraMemoryKnown)
+		printf("\nPeak memory growth can't be measured here, CPU memory is the input and output buffers only.\n");
+	if (!cudaTimings.empty())
+		printf("GPU max error is against the CUDA program's own CPU version, which is the naive convolution.\n");
+	if (csv != NULL) {
+		fclose(csv);
+		printf("Wrote %s.\n", options.csvPath);
+	}
+	return tables > 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include "stagetimer.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Time spent in one stage, summed over every time it ran.
+////
+struct StageTotal {
+	const char* name;
+	int calls;
+	double totalMs;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Stages in the order they first ran.
+static std::vector<StageTotal> stageTotals;
+// Guards stageTotals, batch mode loads and saves images on several threads.
+static std::mutex stageMutex;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+StageTimer::StageTimer(const char* name)
+	: name(name), start(std::chrono::steady_clock::now())
+{
+}
+
+StageTimer::~StageTimer()
+{
+	recordStage(name, start, std::chrono::steady_clock::now());
+}
+
+////
+// Add one run of a stage to its total.
+////
+void addStageTime(const char* name, double ms)
+{
+	std::lock_guard<std::mutex> lock(stageMutex);
+	for (size_t i = 0; i < stageTotals.size(); i++) {
+		if (stageTotals[i].name == name || strcmp(stageTotals[i].name, name) == 0) {
+			stageTotals[i].calls++;
+			stageTotals[i].totalMs += ms;
+			return;
+		}
+	}
+	StageTotal total;
+	total.name = name;
+	total.calls = 1;
+	total.totalMs = ms;
+	stageTotals.push_back(total);
+}
+
+////
+// Add one run of a stage that ran from start to end, and trace it if tracing is on.
+////
+void recordStage(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	addStageTime(name, std::chrono::duration<double, std::milli>(end - start).count());
+	if (traceEnabled)
+		addTraceEvent(name, start, end, -1, -1);
+}
+
+void clearStageTimes()
+{
+	std::lock_guard<std::mutex> lock(stageMutex);
+	stageTotals.clear();
+}
+
+////
+// Print every stage with its total and mean time and its share of the time spent in all stages.
+////
+void printStageBreakdown()
+{
+	std::lock_guard<std::mutex> lock(stageMutex);
+	double sumMs = 0.0;
+	for (size_t i = 0; i < stageTotals.size(); i++)
+		sumMs += stageTotals[i].totalMs;
+
+	printf("\n%-16s %6s %12s %12s %7s\n", "stage", "calls", "total", "mean", "share");
+	for (size_t i = 0; i < stageTotals.size(); i++) {
+		const StageTotal& stage = stageTotals[i];
+		printf("%-16s %6d %10.3fms %10.3fms %6.1f%%\n", stage.name, stage.calls, stage.totalMs,
+			stage.totalMs / stage.calls, sumMs > 0.0 ? 100.0 * stage.totalMs / sumMs : 0.0);
+	}
+	printf("%-16s %6s %10.3fms\n", "all stages", "", sumMs);
+}
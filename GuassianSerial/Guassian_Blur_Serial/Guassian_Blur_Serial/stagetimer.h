@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Times the scope it is declared in and adds it to the named pipeline stage when the scope ends
+// (and to the trace, if tracing is on).
+// name should be a string literal, stages are told apart by their name and the pointer is kept.
+// Safe to use from several threads, the totals are locked.
+////
+class StageTimer {
+public:
+	explicit StageTimer(const char* name);
+	~StageTimer();
+
+private:
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void addStageTime(const char* name, double ms);
+void recordStage(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+void clearStageTimes();
+void printStageBreakdown();
@@ -0,0 +1,397 @@
+#include "stream.h"
+#include "bench.h"
+#include "blur.h"
+#include "image.h"
+#include "SDL_image.h"
+
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a streaming run, filled in from the command line.
+////
+struct StreamOptions {
+	const char* inputPath;
+	const char* outputPath; // .ppm or .raw, NULL to drop the rows
+	int maskSize;
+	float stdv;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Read the next number of a PPM header, skipping whitespace and # comments.
+// Returns -1 if there isn't one.
+////
+static int readHeaderNumber(FILE* file)
+{
+	int c = fgetc(file);
+	for (;;) {
+		if (c == '#') {
+			while (c != '\n' && c != EOF)
+				c = fgetc(file);
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			c = fgetc(file);
+		else
+			break;
+	}
+	if (c < '0' || c > '9')
+		return -1;
+	int value = 0;
+	while (c >= '0' && c <= '9') {
+		value = value * 10 + (c - '0');
+		c = fgetc(file);
+	}
+	// c is the single whitespace character that ends the number (and the header, after maxval)
+	return value;
+}
+
+////
+// Open an image for reading row by row. Synthetic specs and binary PPMs are read incrementally,
+// anything else is decoded whole by SDL_image first.
+// Returns false (after printing why) if the image can't be opened.
+////
+bool openRowReader(const char* path, RowReader* reader)
+{
+	reader->nextRow = 0;
+	reader->file = NULL;
+	reader->surface = NULL;
+
+	if (isSyntheticSpec(path)) {
+		if (!parseSyntheticSpec(path, &reader->spec))
+			return false;
+		reader->kind = ROWS_SYNTHETIC;
+		reader->imageW = reader->spec.imageW;
+		reader->imageH = reader->spec.imageH;
+		return true;
+	}
+
+	const char* extension = strrchr(path, '.');
+	if (extension != NULL && SDL_strcasecmp(extension, ".ppm") == 0) {
+		reader->file = fopen(path, "rb");
+		if (reader->file == NULL) {
+			fprintf(stderr, "Could not open %s\n", path);
+			return false;
+		}
+		char magic[2];
+		int imageW = -1, imageH = -1, maxValue = -1;
+		if (fread(magic, 1, 2, reader->file) == 2 && magic[0] == 'P' && magic[1] == '6') {
+			imageW = readHeaderNumber(reader->file);
+			imageH = readHeaderNumber(reader->file);
+			maxValue = readHeaderNumber(reader->file);
+		}
+		if (imageW < 1 || imageH < 1 || maxValue < 1 || maxValue > 255 || (long long)imageW * imageH * 4 > INT_MAX) {
+			fprintf(stderr, "%s is not an 8-bit binary PPM (P6)\n", path);
+			fclose(reader->file);
+			reader->file = NULL;
+			return false;
+		}
+		reader->kind = ROWS_PPM;
+		reader->imageW = imageW;
+		reader->imageH = imageH;
+		reader->fileRow.resize((size_t)imageW * 3);
+		return true;
+	}
+
+	reader->surface = loadImage(path);
+	if (reader->surface == NULL)
+		return false;
+	reader->kind = ROWS_SURFACE;
+	reader->imageW = reader->surface->w;
+	reader->imageH = reader->surface->h;
+	return true;
+}
+
+////
+// Fill row with the next row of the image as RGBA floats (imageW * 4 of them).
+// Returns false (after printing why) if there are no rows left or the file is cut short.
+////
+bool readRow(RowReader* reader, float* row)
+{
+	if (reader->nextRow >= reader->imageH)
+		return false;
+	int y = reader->nextRow++;
+
+	switch (reader->kind) {
+	case ROWS_SYNTHETIC:
+		generateSyntheticRow(&reader->spec, y, row);
+		return true;
+	case ROWS_PPM:
+		if (fread(&reader->fileRow[0], 3, reader->imageW, reader->file) != (size_t)reader->imageW) {
+			fprintf(stderr, "The image ends after %d of %d rows\n", y, reader->imageH);
+			return false;
+		}
+		for (int x = 0; x < reader->imageW; x++) {
+			row[x * 4 + 0] = (float)reader->fileRow[x * 3 + 0];
+			row[x * 4 + 1] = (float)reader->fileRow[x * 3 + 1];
+			row[x * 4 + 2] = (float)reader->fileRow[x * 3 + 2];
+			row[x * 4 + 3] = 255.0f;
+		}
+		return true;
+	case ROWS_SURFACE: {
+		const unsigned char* pixels = (const unsigned char*)reader->surface->pixels + (size_t)y * reader->surface->pitch;
+		for (int x = 0; x < reader->imageW * 4; x++)
+			row[x] = (float)pixels[x];
+		return true;
+	}
+	}
+	return false;
+}
+
+void closeRowReader(RowReader* reader)
+{
+	if (reader->file != NULL)
+		fclose(reader->file);
+	if (reader->surface != NULL)
+		SDL_FreeSurface(reader->surface);
+	reader->file = NULL;
+	reader->surface = NULL;
+}
+
+////
+// Open a file to write rows to, a binary PPM (P6, the alpha is dropped) or raw packed RGBA by extension.
+// path NULL opens a writer that drops every row.
+// Returns false (after printing why) if the file can't be created or the format can't be streamed.
+////
+bool openRowWriter(const char* path, int imageW, int imageH, RowWriter* writer)
+{
+	writer->file = NULL;
+	writer->raw = false;
+	if (path == NULL)
+		return true;
+
+	const char* extension = strrchr(path, '.');
+	if (extension != NULL && SDL_strcasecmp(extension, ".raw") == 0)
+		writer->raw = true;
+	else if (extension == NULL || SDL_strcasecmp(extension, ".ppm") != 0) {
+		fprintf(stderr, "Only .ppm and .raw output can be streamed, not %s\n", path);
+		return false;
+	}
+	writer->file = fopen(path, "wb");
+	if (writer->file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return false;
+	}
+	if (!writer->raw)
+		fprintf(writer->file, "P6\n%d %d\n255\n", imageW, imageH);
+	writer->fileRow.resize((size_t)imageW * 3);
+	return true;
+}
+
+////
+// Append one row of 8-bit RGBA.
+// Returns false (after printing why) if it couldn't be written.
+////
+bool writeRow(RowWriter* writer, const unsigned char* row, int imageW)
+{
+	if (writer->file == NULL)
+		return true;
+	size_t written;
+	if (writer->raw) {
+		written = fwrite(row, 4, imageW, writer->file);
+	}
+	else {
+		for (int x = 0; x < imageW; x++) {
+			writer->fileRow[x * 3 + 0] = row[x * 4 + 0];
+			writer->fileRow[x * 3 + 1] = row[x * 4 + 1];
+			writer->fileRow[x * 3 + 2] = row[x * 4 + 2];
+		}
+		written = fwrite(&writer->fileRow[0], 3, imageW, writer->file);
+	}
+	if (written != (size_t)imageW) {
+		fprintf(stderr, "Could not write the output\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Flush and close the output.
+// Returns false (after printing why) if the last rows couldn't be written.
+////
+bool closeRowWriter(RowWriter* writer)
+{
+	if (writer->file == NULL)
+		return true;
+	bool closed = fclose(writer->file) == 0;
+	writer->file = NULL;
+	if (!closed)
+		fprintf(stderr, "Could not write the output\n");
+	return closed;
+}
+
+////
+// Convolve output row j from a rolling window of input rows.
+// Same maths (and summation order) as convolveImageCPU so the results are identical.
+// Parameters:
+// window: mask->size rows of RGBA floats, input row r is kept in slot r % mask->size.
+// outRow: imageW 8-bit RGBA pixels to fill in.
+////
+static void convolveWindowRow(const float* window, int imageW, int imageH, int j, const ConvMask* mask, unsigned char* outRow)
+{
+	int maskSize = mask->size;
+	int offset = mask->offset;
+	int rowLength = imageW * 4;
+
+	// start of the (clamped) input row each mask row reads, the same for every pixel of the row
+	int rowStarts[MAX_MASK_SIZE];
+	for (int y = 0; y < maskSize; y++) {
+		int r = std::min(std::max(y + (j - offset), 0), imageH - 1);
+		rowStarts[y] = (r % maskSize) * rowLength;
+	}
+
+	for (int i = 0; i < imageW; i++) {
+		float rsum = 0.0f;
+		float gsum = 0.0f;
+		float bsum = 0.0f;
+		for (int x = 0; x < maskSize; x++) {
+			int column = std::min(std::max(x + (i - offset), 0), imageW - 1) * 4;
+			for (int y = 0; y < maskSize; y++) {
+				const float* pixel = window + rowStarts[y] + column;
+				rsum += (mask->values[x][y]) * pixel[0];
+				gsum += (mask->values[x][y]) * pixel[1];
+				bsum += (mask->values[x][y]) * pixel[2];
+			}
+		}
+		outRow[i * 4 + 0] = (unsigned char)(fmaxf(0, fminf(rsum, 255.0f)));
+		outRow[i * 4 + 1] = (unsigned char)(fmaxf(0, fminf(gsum, 255.0f)));
+		outRow[i * 4 + 2] = (unsigned char)(fmaxf(0, fminf(bsum, 255.0f)));
+		outRow[i * 4 + 3] = 255;
+	}
+}
+
+static void printStreamUsage(const char* program)
+{
+	printf("Usage: %s --stream --input <image> [options]\n", program);
+	printf("  --input <image>   image to blur: synth:... specs and binary .ppm files are read row by row,\n");
+	printf("                    other formats are decoded whole first (SDL_image has no incremental decoder)\n");
+	printf("  --output <file>   stream the result to a .ppm or .raw file, without it the rows are dropped\n");
+	printf("  --mask <n>        mask width (default 5)\n");
+	printf("  --sigma <f>       strength of the blur (default 5)\n");
+}
+
+////
+// Read the stream command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseStreamOptions(int argc, char** argv, StreamOptions* options)
+{
+	options->inputPath = NULL;
+	options->outputPath = NULL;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->inputPath = value;
+		else if (strcmp(arg, "--output") == 0)
+			options->outputPath = value;
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->inputPath == NULL) {
+		fprintf(stderr, "An input image is required\n");
+		return false;
+	}
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Streaming mode entry point, argv[0] is "--stream".
+// Reads the input a row at a time into a window of mask->size rows and writes each output row as soon as
+// the offset rows below it have been read, so memory is proportional to the image width rather than its
+// area and the first rows come out after reading only offset + 1 rows.
+// Returns 0 on success, 1 on failure.
+////
+int runStream(int argc, char** argv)
+{
+	StreamOptions options;
+	if (!parseStreamOptions(argc, argv, &options)) {
+		printStreamUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RowReader reader;
+	if (!openRowReader(options.inputPath, &reader))
+		return 1;
+	int imageW = reader.imageW;
+	int imageH = reader.imageH;
+	RowWriter writer;
+	if (!openRowWriter(options.outputPath, imageW, imageH, &writer)) {
+		closeRowReader(&reader);
+		return 1;
+	}
+
+	std::vector<float> window((size_t)mask.size * imageW * 4);
+	std::vector<unsigned char> outRow((size_t)imageW * 4);
+	double firstRowMs = 0.0;
+	bool ok = true;
+	int nextInput = 0;
+	for (int j = 0; j < imageH && ok; j++) {
+		// read until the lowest row the mask reaches for this output row is in the window
+		int lastNeeded = std::min(j + mask.offset, imageH - 1);
+		while (nextInput <= lastNeeded && ok) {
+			ok = readRow(&reader, &window[(size_t)(nextInput % mask.size) * imageW * 4]);
+			nextInput++;
+		}
+		if (!ok)
+			break;
+		convolveWindowRow(&window[0], imageW, imageH, j, &mask, &outRow[0]);
+		ok = writeRow(&writer, &outRow[0], imageW);
+		if (j == 0)
+			firstRowMs = millisecondsSince(start);
+	}
+	closeRowReader(&reader);
+	ok = closeRowWriter(&writer) && ok;
+	double totalMs = millisecondsSince(start);
+	if (!ok)
+		return 1;
+
+	// what was held at once, against the surface, float copy and result surface of the whole-image path
+	double streamedBytes = (double)window.size() * sizeof(float) + outRow.size() + writer.fileRow.size() + reader.fileRow.size();
+	if (reader.kind == ROWS_SURFACE)
+		streamedBytes += 4.0 * imageW * imageH;
+	double wholeBytes = (double)imageW * imageH * (4 + 4 * sizeof(float) + 4);
+	printf("Streamed %dx%d with mask %dx%d in %.3fms, first row out after %.3fms.\n", imageW, imageH, mask.size, mask.size,
+		totalMs, firstRowMs);
+	printf("Held %.2fMB (a %d row window%s), the whole-image pipeline holds %.2fMB.\n", streamedBytes / (1024.0 * 1024.0), mask.size,
+		reader.kind == ROWS_SURFACE ? " plus the decoded image" : "", wholeBytes / (1024.0 * 1024.0));
+	if (options.outputPath != NULL)
+		printf("Saved %s.\n", options.outputPath);
+	return 0;
+}
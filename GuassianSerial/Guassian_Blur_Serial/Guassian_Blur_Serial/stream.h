@@ -0,0 +1,49 @@
+#pragma once
+
+#include "synthetic.h"
+#include "SDL.h"
+
+#include <stdio.h>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Where a RowReader gets its rows from.
+enum RowSourceKind {
+	ROWS_SYNTHETIC, // generated on demand
+	ROWS_PPM, // read from a binary PPM (P6) file one row at a time
+	ROWS_SURFACE // decoded whole by SDL_image (no incremental decoder), converted one row at a time
+};
+
+////
+// Hands out the rows of an image top to bottom as RGBA floats, without holding the whole image where the
+// format allows it.
+////
+struct RowReader {
+	RowSourceKind kind;
+	int imageW, imageH;
+	int nextRow;
+	SyntheticSpec spec;
+	FILE* file;
+	std::vector<unsigned char> fileRow; // one row as stored in the file
+	SDL_Surface* surface;
+};
+
+////
+// Writes rows of 8-bit RGBA as they are finished, to a binary PPM or a raw RGBA file.
+////
+struct RowWriter {
+	FILE* file; // NULL to drop the rows
+	bool raw;
+	std::vector<unsigned char> fileRow;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+bool openRowReader(const char* path, RowReader* reader);
+bool readRow(RowReader* reader, float* row);
+void closeRowReader(RowReader* reader);
+bool openRowWriter(const char* path, int imageW, int imageH, RowWriter* writer);
+bool writeRow(RowWriter* writer, const unsigned char* row, int imageW);
+bool closeRowWriter(RowWriter* writer);
+int runStream(int argc, char** argv);
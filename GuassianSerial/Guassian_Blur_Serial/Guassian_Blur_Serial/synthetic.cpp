@@ -0,0 +1,169 @@
+#include "synthetic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Prefix that marks an image name as a synthetic image instead of a file.
+static const char* SYNTHETIC_PREFIX = "synth:";
+// Size of a block (edges) or square (checkerboard) in pixels.
+static const int BLOCK_SIZE = 64;
+
+////
+// Resolutions that can be given by name, the same names as the bundled images plus 16k and 32k.
+////
+struct NamedSize {
+	const char* name;
+	int imageW, imageH;
+};
+static const NamedSize namedSizes[] = {
+	{ "240p", 426, 240 },
+	{ "480p", 854, 480 },
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4k", 3840, 2160 },
+	{ "8k", 7680, 4320 },
+	{ "16k", 15360, 8640 },
+	{ "32k", 30720, 17280 },
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Hash of a seed and two coordinates (splitmix64 finalizer), so every pixel's
+// random value is fixed by the seed alone and doesn't depend on generation order or platform.
+////
+static unsigned long long hashCoords(unsigned int seed, unsigned int a, unsigned int b)
+{
+	unsigned long long z = ((unsigned long long)seed << 32) ^ ((unsigned long long)a << 16) ^ b;
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+bool isSyntheticSpec(const char* name)
+{
+	return strncmp(name, SYNTHETIC_PREFIX, strlen(SYNTHETIC_PREFIX)) == 0;
+}
+
+////
+// Parse synth:<pattern>:<size>[:<seed>], where pattern is gradient, noise, edges or checker
+// and size is a name (240p ... 32k) or <width>x<height>.
+// Returns false (after printing why) if the name is not a valid synthetic spec.
+////
+bool parseSyntheticSpec(const char* name, SyntheticSpec* spec)
+{
+	if (!isSyntheticSpec(name))
+		return false;
+
+	char pattern[32];
+	char size[32];
+	unsigned int seed = 1;
+	int fields = sscanf(name + strlen(SYNTHETIC_PREFIX), "%31[^:]:%31[^:]:%u", pattern, size, &seed);
+	if (fields < 2) {
+		fprintf(stderr, "Synthetic images are written synth:<pattern>:<size>[:<seed>], not %s\n", name);
+		return false;
+	}
+
+	if (strcmp(pattern, "gradient") == 0)
+		spec->pattern = PATTERN_GRADIENT;
+	else if (strcmp(pattern, "noise") == 0)
+		spec->pattern = PATTERN_NOISE;
+	else if (strcmp(pattern, "edges") == 0)
+		spec->pattern = PATTERN_EDGES;
+	else if (strcmp(pattern, "checker") == 0)
+		spec->pattern = PATTERN_CHECKERBOARD;
+	else {
+		fprintf(stderr, "Unknown synthetic pattern %s (gradient, noise, edges or checker)\n", pattern);
+		return false;
+	}
+
+	spec->imageW = 0;
+	spec->imageH = 0;
+	for (size_t i = 0; i < sizeof(namedSizes) / sizeof(namedSizes[0]); i++) {
+		if (strcmp(size, namedSizes[i].name) == 0) {
+			spec->imageW = namedSizes[i].imageW;
+			spec->imageH = namedSizes[i].imageH;
+		}
+	}
+	if (spec->imageW == 0 && sscanf(size, "%dx%d", &spec->imageW, &spec->imageH) != 2) {
+		fprintf(stderr, "Unknown synthetic image size %s\n", size);
+		return false;
+	}
+	// the backends index RGBA values with an int, so that's the limit
+	if (spec->imageW < 1 || spec->imageH < 1 || (long long)spec->imageW * spec->imageH * 4 > INT_MAX) {
+		fprintf(stderr, "Synthetic image size %s is out of range\n", size);
+		return false;
+	}
+	spec->seed = seed;
+	return true;
+}
+
+////
+// Generate row y of a synthetic image as RGBA floats, rows can be generated in any order.
+// Parameters:
+// row: imageW * 4 floats to fill in.
+////
+void generateSyntheticRow(const SyntheticSpec* spec, int y, float* row)
+{
+	int imageW = spec->imageW;
+	int imageH = spec->imageH;
+
+	// the two checkerboard colours
+	unsigned long long colourA = hashCoords(spec->seed, 0xffff, 0);
+	unsigned long long colourB = hashCoords(spec->seed, 0, 0xffff);
+
+	for (int x = 0; x < imageW; x++) {
+		unsigned long long value;
+		switch (spec->pattern) {
+		case PATTERN_GRADIENT:
+			row[x * 4 + 0] = (float)(255 * x / (imageW > 1 ? imageW - 1 : 1));
+			row[x * 4 + 1] = (float)(255 * y / (imageH > 1 ? imageH - 1 : 1));
+			row[x * 4 + 2] = (float)(255 * (long long)(x + y) / (imageW + imageH > 2 ? imageW + imageH - 2 : 1));
+			break;
+		case PATTERN_NOISE:
+			value = hashCoords(spec->seed, x, y);
+			row[x * 4 + 0] = (float)(value & 0xff);
+			row[x * 4 + 1] = (float)((value >> 8) & 0xff);
+			row[x * 4 + 2] = (float)((value >> 16) & 0xff);
+			break;
+		case PATTERN_EDGES:
+			value = hashCoords(spec->seed, x / BLOCK_SIZE, y / BLOCK_SIZE);
+			row[x * 4 + 0] = (float)(value & 0xff);
+			row[x * 4 + 1] = (float)((value >> 8) & 0xff);
+			row[x * 4 + 2] = (float)((value >> 16) & 0xff);
+			break;
+		case PATTERN_CHECKERBOARD:
+			value = ((x / BLOCK_SIZE + y / BLOCK_SIZE) % 2 == 0) ? colourA : colourB;
+			row[x * 4 + 0] = (float)(value & 0xff);
+			row[x * 4 + 1] = (float)((value >> 8) & 0xff);
+			row[x * 4 + 2] = (float)((value >> 16) & 0xff);
+			break;
+		}
+		row[x * 4 + 3] = 255.0f;
+	}
+}
+
+////
+// Generate a synthetic image as RGBA floats (same layout as surfaceToFloatPixels).
+// The same spec always gives the same pixels. free with free()
+// Returns NULL if there isn't enough memory.
+////
+float* generateSyntheticImage(const SyntheticSpec* spec)
+{
+	int imageW = spec->imageW;
+	int imageH = spec->imageH;
+	float* floatPixels = (float*)malloc((size_t)4 * imageW * imageH * sizeof(float));
+	if (floatPixels == NULL) {
+		fprintf(stderr, "Not enough memory for a %dx%d image\n", imageW, imageH);
+		return NULL;
+	}
+
+	for (int y = 0; y < imageH; y++)
+		generateSyntheticRow(spec, y, floatPixels + (size_t)y * imageW * 4);
+	return floatPixels;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Kinds of procedural test image.
+enum SyntheticPattern {
+	PATTERN_GRADIENT, // smooth ramps, red across, green down, blue diagonally
+	PATTERN_NOISE, // independent random value per channel per pixel
+	PATTERN_EDGES, // flat random coloured blocks, so sharp edges everywhere
+	PATTERN_CHECKERBOARD // two random colours alternating in squares
+};
+
+////
+// A synthetic image request, written as synth:<pattern>:<size>[:<seed>]
+// e.g. "synth:noise:16k", "synth:checker:1920x1080:7".
+////
+struct SyntheticSpec {
+	SyntheticPattern pattern;
+	int imageW, imageH;
+	unsigned int seed;
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+bool isSyntheticSpec(const char* name);
+bool parseSyntheticSpec(const char* name, SyntheticSpec* spec);
+void generateSyntheticRow(const SyntheticSpec* spec, int y, float* row);
+float* generateSyntheticImage(const SyntheticSpec* spec);
@@ -0,0 +1,136 @@
+#include "trace.h"
+#include "json.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// One complete ("X") event, times are microseconds since tracing started.
+////
+struct TraceEvent {
+	const char* name;
+	double startUs;
+	double durationUs;
+	int first, last;
+};
+
+////
+// Events of one thread. Only the owning thread appends to it, so recording needs no lock;
+// the buffers are read after every worker has been joined.
+////
+struct TraceBuffer {
+	int threadId; // small number shown as the tid in the trace
+	bool mainThread;
+	std::vector<TraceEvent> events;
+	TraceBuffer* next; // list of every buffer, pushed onto with a compare and swap
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+bool traceEnabled = false;
+static std::string tracePath;
+static std::chrono::steady_clock::time_point traceStart;
+static std::thread::id traceMainThread;
+static std::atomic<TraceBuffer*> traceBuffers(nullptr);
+static std::atomic<int> nextThreadId(1);
+// Buffer of the calling thread, created on its first event.
+static thread_local TraceBuffer* localBuffer = nullptr;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Start recording events, they are written to path as a Chrome trace (chrome://tracing, ui.perfetto.dev)
+// by finishTracing. Call from the main thread before any workers are started.
+////
+void startTracing(const char* path)
+{
+	tracePath = path;
+	traceStart = std::chrono::steady_clock::now();
+	traceMainThread = std::this_thread::get_id();
+	traceEnabled = true;
+}
+
+// Register a buffer for the calling thread.
+static TraceBuffer* createLocalBuffer()
+{
+	TraceBuffer* buffer = new TraceBuffer();
+	buffer->threadId = nextThreadId++;
+	buffer->mainThread = (std::this_thread::get_id() == traceMainThread);
+	buffer->events.reserve(256);
+	buffer->next = traceBuffers.load();
+	while (!traceBuffers.compare_exchange_weak(buffer->next, buffer)) {
+	}
+	localBuffer = buffer;
+	return buffer;
+}
+
+////
+// Record an event on the calling thread (TraceScope does this for a scope).
+// first, last: optional range the event worked on, -1 for none.
+////
+void addTraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, int first, int last)
+{
+	if (!traceEnabled)
+		return;
+	TraceBuffer* buffer = localBuffer != nullptr ? localBuffer : createLocalBuffer();
+	TraceEvent event;
+	event.name = name;
+	event.startUs = std::chrono::duration<double, std::micro>(start - traceStart).count();
+	event.durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+	event.first = first;
+	event.last = last;
+	buffer->events.push_back(event);
+}
+
+////
+// Stop tracing and write every recorded event as Chrome trace JSON. Every worker thread must have finished.
+// Returns false (after printing why) if the trace could not be written, true if it was or tracing wasn't on.
+////
+bool finishTracing()
+{
+	if (!traceEnabled)
+		return true;
+	traceEnabled = false;
+
+	FILE* file = fopen(tracePath.c_str(), "w");
+	bool written = (file != NULL);
+	if (file == NULL)
+		fprintf(stderr, "Could not write %s\n", tracePath.c_str());
+
+	size_t count = 0;
+	TraceBuffer* buffer = traceBuffers.exchange(nullptr);
+	if (file != NULL)
+		fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	while (buffer != NULL) {
+		if (file != NULL) {
+			fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+				count == 0 ? "" : ",\n", buffer->threadId, buffer->mainThread ? "main" : "worker", buffer->threadId);
+			count++;
+			for (size_t i = 0; i < buffer->events.size(); i++) {
+				const TraceEvent& event = buffer->events[i];
+				fprintf(file, ",\n{\"name\": ");
+				writeJSONString(file, event.name);
+				fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+					buffer->threadId, event.startUs, event.durationUs);
+				if (event.first >= 0)
+					fprintf(file, ", \"args\": {\"first\": %d, \"last\": %d}", event.first, event.last);
+				fprintf(file, "}");
+				count++;
+			}
+		}
+		TraceBuffer* next = buffer->next;
+		delete buffer;
+		buffer = next;
+	}
+	localBuffer = nullptr;
+	if (file != NULL) {
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		printf("Wrote %s.\n", tracePath.c_str());
+	}
+	return written;
+}
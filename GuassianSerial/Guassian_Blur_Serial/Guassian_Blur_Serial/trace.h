@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// True between startTracing and finishTracing. When false a TraceScope costs one load and a branch.
+extern bool traceEnabled;
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void startTracing(const char* path);
+bool finishTracing();
+void addTraceEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, int first, int last);
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Records the scope it is declared in as one trace event on the calling thread, if tracing is on.
+// name should be a string literal, it is kept as a pointer until the trace is written.
+// first, last: optional range the scope worked on (e.g. the rows of a band), -1 for none.
+////
+class TraceScope {
+public:
+	explicit TraceScope(const char* name, int first = -1, int last = -1)
+		: name(name), first(first), last(last), active(traceEnabled)
+	{
+		if (active)
+			start = std::chrono::steady_clock::now();
+	}
+
+	~TraceScope()
+	{
+		if (active)
+			addTraceEvent(name, start, std::chrono::steady_clock::now(), first, last);
+	}
+
+private:
+	const char* name;
+	int first, last;
+	bool active;
+	std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,321 @@
+#include "validate.h"
+#include "bench.h"
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>  Global Variables <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+static const char* DEFAULT_IMAGES = "synth:noise:720p,synth:edges:720p,synth:gradient:720p";
+static const char* DEFAULT_MASKS = "3,7,13";
+static const char* DEFAULT_SIGMAS = "1,5,20";
+// Upper end of each histogram bin (inclusive).
+static const int binLimits[ERROR_BINS] = { 0, 1, 2, 3, 7, 15, 31, 63, 127, 255 };
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a validation run, filled in from the command line.
+////
+struct ValidationOptions {
+	std::vector<std::string> images;
+	std::vector<int> masks;
+	std::vector<float> sigmas;
+	const Backend* reference;
+	std::vector<const Backend*> backends;
+	int threads;
+	int tolerance; // largest absolute difference per channel that still counts as matching
+	double maxBadPercent; // fail if more than this percentage of pixels is beyond the tolerance
+	double minPsnr; // fail if the PSNR is lower than this (dB), 0 to not check
+};
+
+////
+// Error totals of one band of rows, merged once every band is done.
+////
+struct ErrorTotals {
+	int maxError;
+	double squaredError;
+	long long badPixels;
+	long long histogram[ERROR_BINS];
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+// Histogram bin for an absolute error.
+static int errorBin(int error)
+{
+	int bin = 0;
+	while (error > binLimits[bin])
+		bin++;
+	return bin;
+}
+
+// Compare the rows firstRow to lastRow (exclusive) into totals.
+static void compareRows(const unsigned char* pixels, int pitch, const unsigned char* reference, int referencePitch,
+	int imageW, int tolerance, int firstRow, int lastRow, ErrorTotals* totals)
+{
+	memset(totals, 0, sizeof(*totals));
+	for (int y = firstRow; y < lastRow; y++) {
+		const unsigned char* row = pixels + (size_t)y * pitch;
+		const unsigned char* referenceRow = reference + (size_t)y * referencePitch;
+		for (int x = 0; x < imageW; x++) {
+			bool bad = false;
+			for (int c = 0; c < 4; c++) {
+				int error = abs((int)row[x * 4 + c] - (int)referenceRow[x * 4 + c]);
+				if (error > totals->maxError)
+					totals->maxError = error;
+				totals->squaredError += (double)error * error;
+				totals->histogram[errorBin(error)]++;
+				if (error > tolerance)
+					bad = true;
+			}
+			if (bad)
+				totals->badPixels++;
+		}
+	}
+}
+
+////
+// Compare an 8-bit RGBA result against a reference, split across threads by bands of rows.
+// Parameters:
+// pixels, pitch: the result to check.
+// reference, referencePitch: what it should be.
+// tolerance: largest absolute difference per channel that still counts as matching.
+// stats: filled in with the differences.
+////
+void compareImages(const unsigned char* pixels, int pitch, const unsigned char* reference, int referencePitch,
+	int imageW, int imageH, int tolerance, int threads, ErrorStats* stats)
+{
+	if (threads < 1)
+		threads = 1;
+	if (threads > imageH)
+		threads = imageH;
+
+	std::vector<ErrorTotals> totals(threads);
+	std::vector<std::thread> workers;
+	int rowsPerThread = imageH / threads;
+	int extraRows = imageH % threads;
+	int firstRow = 0;
+	for (int t = 0; t < threads; t++) {
+		int lastRow = firstRow + rowsPerThread + (t < extraRows ? 1 : 0);
+		if (t == threads - 1)
+			compareRows(pixels, pitch, reference, referencePitch, imageW, tolerance, firstRow, lastRow, &totals[t]);
+		else
+			workers.push_back(std::thread(compareRows, pixels, pitch, reference, referencePitch, imageW, tolerance, firstRow, lastRow, &totals[t]));
+		firstRow = lastRow;
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	memset(stats, 0, sizeof(*stats));
+	stats->pixels = (long long)imageW * imageH;
+	double squaredError = 0.0;
+	for (int t = 0; t < threads; t++) {
+		if (totals[t].maxError > stats->maxError)
+			stats->maxError = totals[t].maxError;
+		squaredError += totals[t].squaredError;
+		stats->badPixels += totals[t].badPixels;
+		for (int b = 0; b < ERROR_BINS; b++)
+			stats->histogram[b] += totals[t].histogram[b];
+	}
+	stats->mse = stats->pixels > 0 ? squaredError / (stats->pixels * 4.0) : 0.0;
+	stats->psnr = stats->mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / stats->mse) : INFINITY;
+}
+
+////
+// Print the error statistics on one line and the non-empty histogram bins on the next.
+////
+void printErrorStats(const ErrorStats* stats, int tolerance)
+{
+	printf("  max error %d, PSNR ", stats->maxError);
+	if (isinf(stats->psnr))
+		printf("inf");
+	else
+		printf("%.2fdB", stats->psnr);
+	printf(", %lld of %lld pixels (%.4f%%) beyond tolerance %d\n", stats->badPixels, stats->pixels,
+		stats->pixels > 0 ? 100.0 * stats->badPixels / stats->pixels : 0.0, tolerance);
+
+	printf("  error histogram (channel values):");
+	for (int b = 0; b < ERROR_BINS; b++) {
+		if (stats->histogram[b] == 0)
+			continue;
+		int low = b == 0 ? 0 : binLimits[b - 1] + 1;
+		if (low == binLimits[b])
+			printf(" %d: %lld", low, stats->histogram[b]);
+		else
+			printf(" %d-%d: %lld", low, binLimits[b], stats->histogram[b]);
+	}
+	printf("\n");
+}
+
+static void printValidationUsage(const char* program)
+{
+	printf("Usage: %s --validate [options]\n", program);
+	printf("  --images <list>     comma separated images to blur (default %s)\n", DEFAULT_IMAGES);
+	printf("  --masks <list>      comma separated mask widths (default %s)\n", DEFAULT_MASKS);
+	printf("  --sigmas <list>     comma separated blur strengths (default %s)\n", DEFAULT_SIGMAS);
+	printf("  --reference <name>  backend every other one is checked against (default %s)\n", backends[0].name);
+	printf("  --backends <list>   comma separated backends to check (default all exact ones but the reference)\n");
+	printf("  --threads <n>       threads for multithreaded backends and the comparison (default %d)\n", defaultThreadCount());
+	printf("  --tolerance <n>     largest difference per channel (0-255) that still matches (default 0)\n");
+	printf("  --max-bad <pct>     fail if more than this percentage of pixels is beyond the tolerance (default 0)\n");
+	printf("  --min-psnr <dB>     fail if the PSNR is below this (default no limit)\n");
+	printf("Exits with code 2 if any backend is outside the limits.\n");
+}
+
+////
+// Read the validation command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseValidationOptions(int argc, char** argv, ValidationOptions* options)
+{
+	const char* images = DEFAULT_IMAGES;
+	const char* masks = DEFAULT_MASKS;
+	const char* sigmas = DEFAULT_SIGMAS;
+	const char* backendList = NULL;
+	options->reference = &backends[0];
+	options->threads = defaultThreadCount();
+	options->tolerance = 0;
+	options->maxBadPercent = 0.0;
+	options->minPsnr = 0.0;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--images") == 0)
+			images = value;
+		else if (strcmp(arg, "--masks") == 0)
+			masks = value;
+		else if (strcmp(arg, "--sigmas") == 0)
+			sigmas = value;
+		else if (strcmp(arg, "--backends") == 0)
+			backendList = value;
+		else if (strcmp(arg, "--reference") == 0) {
+			options->reference = findBackend(value);
+			if (options->reference == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--tolerance") == 0)
+			options->tolerance = atoi(value);
+		else if (strcmp(arg, "--max-bad") == 0)
+			options->maxBadPercent = atof(value);
+		else if (strcmp(arg, "--min-psnr") == 0)
+			options->minPsnr = atof(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->threads < 1 || options->tolerance < 0 || options->maxBadPercent < 0.0) {
+		fprintf(stderr, "Threads must be at least 1, tolerance and max-bad at least 0\n");
+		return false;
+	}
+
+	options->images = splitList(images);
+	if (!parseMaskList(masks, &options->masks) || !parseSigmaList(sigmas, &options->sigmas))
+		return false;
+	if (backendList == NULL) {
+		for (int i = 0; i < backendCount; i++) {
+			if (&backends[i] != options->reference && backends[i].exact)
+				options->backends.push_back(&backends[i]);
+		}
+	}
+	else if (!parseBackendList(backendList, &options->backends)) {
+		return false;
+	}
+
+	if (options->images.empty() || options->masks.empty() || options->sigmas.empty() || options->backends.empty()) {
+		fprintf(stderr, "Nothing to validate\n");
+		return false;
+	}
+	return true;
+}
+
+////
+// Validation mode entry point, argv[0] is "--validate".
+// Blurs every image, mask and sigma with the reference backend once, then checks every other backend against it.
+// Returns 0 if every backend is within the limits, 2 if any isn't, 1 for any other failure.
+////
+int runValidation(int argc, char** argv)
+{
+	ValidationOptions options;
+	if (!parseValidationOptions(argc, argv, &options)) {
+		printValidationUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	int failures = 0;
+	int checks = 0;
+	int skipped = 0; // images there wasn't enough memory to check
+	for (size_t i = 0; i < options.images.size(); i++) {
+		int imageW, imageH;
+		float* floatPixels = loadFloatImage(options.images[i].c_str(), &imageW, &imageH);
+		if (floatPixels == NULL)
+			return 1;
+		int pitch = imageW * 4;
+		unsigned char* referencePixels = (unsigned char*)malloc((size_t)pitch * imageH);
+		unsigned char* outPixels = (unsigned char*)malloc((size_t)pitch * imageH);
+		if (referencePixels == NULL || outPixels == NULL) {
+			fprintf(stderr, "Not enough memory to check %s, skipping it\n", options.images[i].c_str());
+			free(outPixels);
+			free(referencePixels);
+			free(floatPixels);
+			skipped++;
+			continue;
+		}
+
+		for (size_t m = 0; m < options.masks.size(); m++) {
+			for (size_t s = 0; s < options.sigmas.size(); s++) {
+				ConvMask mask;
+				generateGuassianKernel(&mask, options.masks[m], options.sigmas[s]);
+				options.reference->convolve(floatPixels, referencePixels, pitch, imageW, imageH, &mask, options.threads);
+
+				for (size_t b = 0; b < options.backends.size(); b++) {
+					const Backend* backend = options.backends[b];
+					memset(outPixels, 0, (size_t)pitch * imageH); // nothing left over from the last backend
+					backend->convolve(floatPixels, outPixels, pitch, imageW, imageH, &mask, options.threads);
+
+					ErrorStats stats;
+					compareImages(outPixels, pitch, referencePixels, pitch, imageW, imageH, options.tolerance, options.threads, &stats);
+					double badPercent = 100.0 * stats.badPixels / stats.pixels;
+					bool passed = badPercent <= options.maxBadPercent && (options.minPsnr <= 0.0 || stats.psnr >= options.minPsnr);
+					checks++;
+					if (!passed)
+						failures++;
+
+					printf("%s mask %dx%d sigma %g: %s vs %s %s\n", options.images[i].c_str(), mask.size, mask.size, mask.stdv,
+						backend->name, options.reference->name, passed ? "ok" : "FAILED");
+					printErrorStats(&stats, options.tolerance);
+				}
+			}
+		}
+
+		free(outPixels);
+		free(referencePixels);
+		free(floatPixels);
+	}
+
+	printf("\n%d of %d checks passed.\n", checks - failures, checks);
+	if (skipped > 0)
+		printf("%d image%s skipped.\n", skipped, skipped == 1 ? "" : "s");
+	if (failures > 0)
+		return 2;
+	return skipped > 0 ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Defines  <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Bins of the error histogram: 0, 1, 2, 3, 4-7, 8-15, 16-31, 32-63, 64-127, 128-255
+#define ERROR_BINS 10
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Difference between an 8-bit RGBA result and a reference, over every channel of every pixel.
+////
+struct ErrorStats {
+	long long pixels;
+	int maxError; // largest absolute difference of any channel
+	double mse; // mean squared error per channel
+	double psnr; // peak signal to noise ratio in dB, infinite if the images are identical
+	long long badPixels; // pixels with any channel differing by more than the tolerance
+	long long histogram[ERROR_BINS]; // channel values per absolute error bin
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+void compareImages(const unsigned char* pixels, int pitch, const unsigned char* reference, int referencePitch,
+	int imageW, int imageH, int tolerance, int threads, ErrorStats* stats);
+void printErrorStats(const ErrorStats* stats, int tolerance);
+int runValidation(int argc, char** argv);
@@ -0,0 +1,604 @@
+#include "video.h"
+#include "blur.h"
+#include "bench.h"
+#include "boundedqueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Settings for a video run, filled in from the command line.
+////
+struct VideoOptions {
+	const char* inputPath; // "-" for stdin
+	const char* outputPath; // "-" for stdout, NULL to drop the frames
+	int rawW, rawH; // size of raw RGBA frames, 0 if the input is Y4M
+	int maskSize;
+	float stdv;
+	const Backend* backend;
+	int threads; // threads per blur, for multithreaded backends
+	int buffers; // frames in flight: 2 double buffers, 3 triple buffers
+	double fps; // rate frames arrive at, as from a live source, 0 to read as fast as the pipeline takes them
+	int maxFrames; // stop after this many frames, 0 for all
+};
+
+////
+// Layout of the frames of a stream.
+////
+struct VideoFormat {
+	bool y4m; // planar YUV with a FRAME line before each frame, otherwise packed RGBA
+	int imageW, imageH;
+	int chromaW, chromaH; // size of the U and V planes, 0 for monochrome Y4M and raw RGBA
+	std::string header; // Y4M stream header, repeated on the output
+	size_t frameBytes; // bytes of one frame, without the FRAME line
+};
+
+////
+// One frame buffer, owned by whichever stage holds it and returned to the free list once written.
+////
+struct VideoFrame {
+	int index;
+	std::vector<unsigned char> data; // the frame as stored in the stream
+	std::vector<float> pixels; // RGBA floats for the backend
+	std::vector<unsigned char> result; // 8-bit RGBA from the backend
+	std::chrono::steady_clock::time_point arrived; // when the frame was due (or read, without --fps)
+	double blurMs;
+};
+
+////
+// Everything the stages share.
+////
+struct VideoPipeline {
+	const VideoOptions* options;
+	const VideoFormat* format;
+	const ConvMask* mask;
+	FILE* input;
+	FILE* output;
+	BoundedQueue<VideoFrame*>* freeFrames;
+	BoundedQueue<VideoFrame*>* readFrames;
+	BoundedQueue<VideoFrame*>* blurredFrames;
+	int read; // written by the reader only
+	int dropped; // written by the reader only
+	bool readFailed; // written by the reader only
+	bool writeFailed; // written by the writer only
+	double readBusyMs, blurBusyMs, writeBusyMs;
+	std::vector<double> latencies; // arrival to written, per frame, written by the writer only
+	std::vector<double> blurTimes; // written by the writer only
+};
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+static unsigned char clampByte(float value)
+{
+	return (unsigned char)(fmaxf(0.0f, fminf(value + 0.5f, 255.0f)));
+}
+
+////
+// Read a line of up to size - 1 characters, without the newline.
+// Returns false if the stream ends first or the line is too long.
+////
+static bool readLine(FILE* file, char* line, int size)
+{
+	int length = 0;
+	for (;;) {
+		int c = fgetc(file);
+		if (c == EOF)
+			return false;
+		if (c == '\n')
+			break;
+		if (length == size - 1)
+			return false;
+		line[length++] = (char)c;
+	}
+	line[length] = '\0';
+	return true;
+}
+
+////
+// Read a Y4M stream header (8-bit 4:2:0, 4:2:2, 4:4:4 or monochrome) into format.
+// Returns false (after printing why) if it isn't one.
+////
+static bool readY4MHeader(FILE* file, VideoFormat* format)
+{
+	char line[1024];
+	if (!readLine(file, line, sizeof(line)) || strncmp(line, "YUV4MPEG2 ", 10) != 0) {
+		fprintf(stderr, "The input is not a Y4M stream (use --size for raw RGBA frames)\n");
+		return false;
+	}
+	format->y4m = true;
+	format->header = line;
+	format->imageW = 0;
+	format->imageH = 0;
+	const char* chroma = "420";
+	std::string chromaTag;
+	for (char* token = strtok(line + 10, " "); token != NULL; token = strtok(NULL, " ")) {
+		if (token[0] == 'W')
+			format->imageW = atoi(token + 1);
+		else if (token[0] == 'H')
+			format->imageH = atoi(token + 1);
+		else if (token[0] == 'C') {
+			chromaTag = token + 1;
+			chroma = chromaTag.c_str();
+		}
+	}
+	if (format->imageW < 1 || format->imageH < 1) {
+		fprintf(stderr, "The Y4M header has no frame size\n");
+		return false;
+	}
+
+	if (strcmp(chroma, "420") == 0 || strcmp(chroma, "420jpeg") == 0 || strcmp(chroma, "420paldv") == 0 ||
+		strcmp(chroma, "420mpeg2") == 0) {
+		format->chromaW = (format->imageW + 1) / 2;
+		format->chromaH = (format->imageH + 1) / 2;
+	}
+	else if (strcmp(chroma, "422") == 0) {
+		format->chromaW = (format->imageW + 1) / 2;
+		format->chromaH = format->imageH;
+	}
+	else if (strcmp(chroma, "444") == 0) {
+		format->chromaW = format->imageW;
+		format->chromaH = format->imageH;
+	}
+	else if (strcmp(chroma, "mono") == 0) {
+		format->chromaW = 0;
+		format->chromaH = 0;
+	}
+	else {
+		fprintf(stderr, "Unsupported Y4M colour space C%s (8-bit 420, 422, 444 and mono only)\n", chroma);
+		return false;
+	}
+	format->frameBytes = (size_t)format->imageW * format->imageH + 2 * (size_t)format->chromaW * format->chromaH;
+	return true;
+}
+
+////
+// Read the next frame into data. Returns 1 for a frame, 0 at the end of the stream, -1 (after printing why)
+// if the stream is cut short or malformed.
+////
+static int readFrame(FILE* file, const VideoFormat* format, std::vector<unsigned char>* data)
+{
+	if (format->y4m) {
+		char line[1024];
+		if (!readLine(file, line, sizeof(line))) {
+			if (feof(file))
+				return 0;
+			fprintf(stderr, "Expected a FRAME line in the Y4M stream\n");
+			return -1;
+		}
+		if (strncmp(line, "FRAME", 5) != 0) {
+			fprintf(stderr, "Expected a FRAME line in the Y4M stream\n");
+			return -1;
+		}
+	}
+	size_t got = fread(&(*data)[0], 1, format->frameBytes, file);
+	if (got == 0 && !format->y4m)
+		return 0;
+	if (got != format->frameBytes) {
+		fprintf(stderr, "The last frame is cut short\n");
+		return -1;
+	}
+	return 1;
+}
+
+////
+// Convert a frame as stored in the stream to RGBA floats (BT.601 limited range for Y4M).
+////
+static void decodeFrame(const VideoFormat* format, const unsigned char* data, float* pixels)
+{
+	int imageW = format->imageW;
+	int imageH = format->imageH;
+	if (!format->y4m) {
+		for (size_t p = 0; p < (size_t)imageW * imageH * 4; p++)
+			pixels[p] = (float)data[p];
+		return;
+	}
+
+	const unsigned char* planeU = data + (size_t)imageW * imageH;
+	const unsigned char* planeV = planeU + (size_t)format->chromaW * format->chromaH;
+	int stepX = format->chromaW == imageW ? 1 : 2;
+	int stepY = format->chromaH == imageH ? 1 : 2;
+	for (int y = 0; y < imageH; y++) {
+		for (int x = 0; x < imageW; x++) {
+			float luma = 1.164383f * (data[y * imageW + x] - 16.0f);
+			float d = 0.0f;
+			float e = 0.0f;
+			if (format->chromaW > 0) {
+				int c = (y / stepY) * format->chromaW + x / stepX;
+				d = planeU[c] - 128.0f;
+				e = planeV[c] - 128.0f;
+			}
+			float* pixel = pixels + ((size_t)y * imageW + x) * 4;
+			pixel[0] = fmaxf(0.0f, fminf(luma + 1.596027f * e, 255.0f));
+			pixel[1] = fmaxf(0.0f, fminf(luma - 0.391762f * d - 0.812968f * e, 255.0f));
+			pixel[2] = fmaxf(0.0f, fminf(luma + 2.017232f * d, 255.0f));
+			pixel[3] = 255.0f;
+		}
+	}
+}
+
+////
+// Convert 8-bit RGBA back to the layout of the stream, averaging the chroma of each subsampled block.
+////
+static void encodeFrame(const VideoFormat* format, const unsigned char* rgba, unsigned char* data)
+{
+	int imageW = format->imageW;
+	int imageH = format->imageH;
+	if (!format->y4m) {
+		memcpy(data, rgba, format->frameBytes);
+		return;
+	}
+
+	for (size_t p = 0; p < (size_t)imageW * imageH; p++) {
+		const unsigned char* pixel = rgba + p * 4;
+		data[p] = clampByte(16.0f + 0.256788f * pixel[0] + 0.504129f * pixel[1] + 0.097906f * pixel[2]);
+	}
+	if (format->chromaW == 0)
+		return;
+
+	unsigned char* planeU = data + (size_t)imageW * imageH;
+	unsigned char* planeV = planeU + (size_t)format->chromaW * format->chromaH;
+	int stepX = format->chromaW == imageW ? 1 : 2;
+	int stepY = format->chromaH == imageH ? 1 : 2;
+	for (int cy = 0; cy < format->chromaH; cy++) {
+		for (int cx = 0; cx < format->chromaW; cx++) {
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			int count = 0;
+			for (int y = cy * stepY; y < std::min(cy * stepY + stepY, imageH); y++) {
+				for (int x = cx * stepX; x < std::min(cx * stepX + stepX, imageW); x++) {
+					const unsigned char* pixel = rgba + ((size_t)y * imageW + x) * 4;
+					r += pixel[0];
+					g += pixel[1];
+					b += pixel[2];
+					count++;
+				}
+			}
+			r /= count;
+			g /= count;
+			b /= count;
+			planeU[cy * format->chromaW + cx] = clampByte(128.0f - 0.148223f * r - 0.290993f * g + 0.439216f * b);
+			planeV[cy * format->chromaW + cx] = clampByte(128.0f + 0.439216f * r - 0.367788f * g - 0.071427f * b);
+		}
+	}
+}
+
+////
+// Read stage: take a free buffer, read the next frame into it and convert it, until the stream ends.
+// With --fps the frames arrive on a schedule, and one that arrives while every buffer is still in use is
+// dropped, as a capture device would.
+////
+static void readWorker(VideoPipeline* pipeline)
+{
+	const VideoOptions* options = pipeline->options;
+	std::vector<unsigned char> discard(pipeline->format->frameBytes);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int index = 0; options->maxFrames == 0 || index < options->maxFrames; index++) {
+		std::chrono::steady_clock::time_point arrived;
+		VideoFrame* frame = NULL;
+		if (options->fps > 0.0) {
+			arrived = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(index / options->fps));
+			std::this_thread::sleep_until(arrived);
+			if (!pipeline->freeFrames->tryPop(&frame)) {
+				int status = readFrame(pipeline->input, pipeline->format, &discard);
+				if (status <= 0) {
+					pipeline->readFailed = status < 0;
+					break;
+				}
+				pipeline->dropped++;
+				continue;
+			}
+		}
+		else {
+			if (!pipeline->freeFrames->pop(&frame))
+				break;
+			arrived = std::chrono::steady_clock::now();
+		}
+
+		std::chrono::steady_clock::time_point busy = std::chrono::steady_clock::now();
+		int status = readFrame(pipeline->input, pipeline->format, &frame->data);
+		if (status <= 0) {
+			pipeline->readFailed = status < 0;
+			pipeline->freeFrames->push(frame);
+			break;
+		}
+		decodeFrame(pipeline->format, &frame->data[0], &frame->pixels[0]);
+		pipeline->readBusyMs += millisecondsSince(busy);
+		frame->index = index;
+		frame->arrived = arrived;
+		pipeline->read++;
+		pipeline->readFrames->push(frame);
+	}
+	pipeline->readFrames->close();
+}
+
+////
+// Write stage: convert blurred frames back to the stream's layout, write them and return the buffers.
+////
+static void writeWorker(VideoPipeline* pipeline)
+{
+	const VideoFormat* format = pipeline->format;
+	if (pipeline->output != NULL && format->y4m)
+		pipeline->writeFailed = fprintf(pipeline->output, "%s\n", format->header.c_str()) < 0;
+	for (;;) {
+		VideoFrame* frame;
+		if (!pipeline->blurredFrames->pop(&frame))
+			break;
+		std::chrono::steady_clock::time_point busy = std::chrono::steady_clock::now();
+		if (pipeline->output != NULL && !pipeline->writeFailed) {
+			encodeFrame(format, &frame->result[0], &frame->data[0]);
+			if (format->y4m)
+				fputs("FRAME\n", pipeline->output);
+			if (fwrite(&frame->data[0], 1, format->frameBytes, pipeline->output) != format->frameBytes) {
+				fprintf(stderr, "Could not write frame %d\n", frame->index);
+				pipeline->writeFailed = true;
+			}
+		}
+		pipeline->writeBusyMs += millisecondsSince(busy);
+		pipeline->latencies.push_back(millisecondsSince(frame->arrived));
+		pipeline->blurTimes.push_back(frame->blurMs);
+		pipeline->freeFrames->push(frame);
+	}
+	if (pipeline->output != NULL && fflush(pipeline->output) != 0)
+		pipeline->writeFailed = true;
+}
+
+static void printVideoUsage(const char* program)
+{
+	printf("Usage: %s --video --input <file> [options]\n", program);
+	printf("  --input <file>     Y4M stream (8-bit 420, 422, 444 or mono) or raw RGBA frames, - for stdin\n");
+	printf("  --size <w>x<h>     frame size of raw RGBA input, without it the input must be Y4M\n");
+	printf("  --output <file>    write the blurred frames in the input's format, - for stdout (default none)\n");
+	printf("  --mask <n>         mask width (default 5)\n");
+	printf("  --sigma <f>        strength of the blur (default 5)\n");
+	printf("  --backend <name>   backend to blur with (default threads)\n");
+	printf("  --threads <n>      threads per blur, for multithreaded backends (default %d)\n", defaultThreadCount());
+	printf("  --buffers <n>      frame buffers in flight, 2 for double and 3 for triple buffering (default 3)\n");
+	printf("  --fps <f>          frames arrive at this rate as from a live source and are dropped when no buffer\n");
+	printf("                     is free (default 0: read as fast as the pipeline takes them, nothing is dropped)\n");
+	printf("  --frames <n>       stop after this many frames (default 0: all)\n");
+}
+
+////
+// Read the video command line into options.
+// Returns false (after printing why) if the command line is not valid.
+////
+static bool parseVideoOptions(int argc, char** argv, VideoOptions* options)
+{
+	options->inputPath = NULL;
+	options->outputPath = NULL;
+	options->rawW = 0;
+	options->rawH = 0;
+	options->maskSize = 5;
+	options->stdv = 5.0f;
+	options->backend = findBackend("threads");
+	options->threads = defaultThreadCount();
+	options->buffers = 3;
+	options->fps = 0.0;
+	options->maxFrames = 0;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+		if (value == NULL) {
+			fprintf(stderr, "Unknown option or missing value for %s\n", arg);
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--input") == 0)
+			options->inputPath = value;
+		else if (strcmp(arg, "--output") == 0)
+			options->outputPath = value;
+		else if (strcmp(arg, "--size") == 0) {
+			if (sscanf(value, "%dx%d", &options->rawW, &options->rawH) != 2 || options->rawW < 1 || options->rawH < 1) {
+				fprintf(stderr, "Frame size must be <width>x<height>, not %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--mask") == 0)
+			options->maskSize = atoi(value);
+		else if (strcmp(arg, "--sigma") == 0)
+			options->stdv = (float)atof(value);
+		else if (strcmp(arg, "--backend") == 0) {
+			options->backend = findBackend(value);
+			if (options->backend == NULL) {
+				fprintf(stderr, "Unknown backend %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "--threads") == 0)
+			options->threads = atoi(value);
+		else if (strcmp(arg, "--buffers") == 0)
+			options->buffers = atoi(value);
+		else if (strcmp(arg, "--fps") == 0)
+			options->fps = atof(value);
+		else if (strcmp(arg, "--frames") == 0)
+			options->maxFrames = atoi(value);
+		else {
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->inputPath == NULL) {
+		fprintf(stderr, "An input stream is required\n");
+		return false;
+	}
+	if (options->maskSize < 1 || options->maskSize > MAX_MASK_SIZE || options->maskSize % 2 == 0) {
+		fprintf(stderr, "Mask width must be an odd value from 1 to %d\n", MAX_MASK_SIZE);
+		return false;
+	}
+	if (options->stdv <= 0.0f) {
+		fprintf(stderr, "Sigma must be greater than 0\n");
+		return false;
+	}
+	if (options->threads < 1 || options->buffers < 2) {
+		fprintf(stderr, "Threads must be at least 1 and buffers at least 2\n");
+		return false;
+	}
+	if (options->fps < 0.0 || options->maxFrames < 0) {
+		fprintf(stderr, "Frame rate and frame count can't be negative\n");
+		return false;
+	}
+	return true;
+}
+
+// Open path for binary reading or writing, "-" being stdin or stdout.
+static FILE* openStream(const char* path, bool write)
+{
+	if (strcmp(path, "-") == 0) {
+		FILE* file = write ? stdout : stdin;
+#ifdef _WIN32
+		_setmode(_fileno(file), _O_BINARY);
+#endif
+		return file;
+	}
+	FILE* file = fopen(path, write ? "wb" : "rb");
+	if (file == NULL)
+		fprintf(stderr, "Could not open %s\n", path);
+	return file;
+}
+
+////
+// Video mode entry point, argv[0] is "--video".
+// Runs a stream of frames through the blur with read, blur and write overlapping on their own threads over a
+// small pool of frame buffers, so while frame N is blurred frame N+1 is being read and frame N-1 written.
+// Reports the sustained frame rate, dropped frames and per-frame latency percentiles.
+// Returns 0 on success, 1 if the stream couldn't be read or written.
+////
+int runVideo(int argc, char** argv)
+{
+	VideoOptions options;
+	if (!parseVideoOptions(argc, argv, &options)) {
+		printVideoUsage("Guassian_Blur_Serial");
+		return 1;
+	}
+
+	VideoPipeline pipeline;
+	pipeline.options = &options;
+	pipeline.input = openStream(options.inputPath, false);
+	if (pipeline.input == NULL)
+		return 1;
+	VideoFormat format;
+	if (options.rawW > 0) {
+		format.y4m = false;
+		format.imageW = options.rawW;
+		format.imageH = options.rawH;
+		format.chromaW = 0;
+		format.chromaH = 0;
+		format.frameBytes = (size_t)options.rawW * options.rawH * 4;
+	}
+	else if (!readY4MHeader(pipeline.input, &format)) {
+		if (pipeline.input != stdin)
+			fclose(pipeline.input);
+		return 1;
+	}
+	pipeline.format = &format;
+	pipeline.output = NULL;
+	if (options.outputPath != NULL) {
+		pipeline.output = openStream(options.outputPath, true);
+		if (pipeline.output == NULL) {
+			if (pipeline.input != stdin)
+				fclose(pipeline.input);
+			return 1;
+		}
+	}
+	// the frames may be going to stdout
+	FILE* report = pipeline.output == stdout ? stderr : stdout;
+
+	ConvMask mask;
+	generateGuassianKernel(&mask, options.maskSize, options.stdv);
+	pipeline.mask = &mask;
+
+	std::vector<VideoFrame> frames(options.buffers);
+	BoundedQueue<VideoFrame*> freeFrames(options.buffers);
+	BoundedQueue<VideoFrame*> readFrames(options.buffers);
+	BoundedQueue<VideoFrame*> blurredFrames(options.buffers);
+	for (int f = 0; f < options.buffers; f++) {
+		size_t pixelCount = (size_t)format.imageW * format.imageH;
+		frames[f].data.resize(format.frameBytes);
+		frames[f].pixels.resize(pixelCount * 4);
+		frames[f].result.resize(pixelCount * 4);
+		freeFrames.push(&frames[f]);
+	}
+	pipeline.freeFrames = &freeFrames;
+	pipeline.readFrames = &readFrames;
+	pipeline.blurredFrames = &blurredFrames;
+	pipeline.read = 0;
+	pipeline.dropped = 0;
+	pipeline.readFailed = false;
+	pipeline.writeFailed = false;
+	pipeline.readBusyMs = 0.0;
+	pipeline.blurBusyMs = 0.0;
+	pipeline.writeBusyMs = 0.0;
+
+	fprintf(report, "Blurring %dx%d %s frames, mask %dx%d sigma %g, %s backend with %d threads, %d buffers", format.imageW,
+		format.imageH, format.y4m ? "Y4M" : "RGBA", mask.size, mask.size, mask.stdv, options.backend->name, options.threads,
+		options.buffers);
+	if (options.fps > 0.0)
+		fprintf(report, ", frames arriving at %g fps", options.fps);
+	fprintf(report, ".\n");
+
+	// the blur stage runs on this thread
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::thread reader(readWorker, &pipeline);
+	std::thread writer(writeWorker, &pipeline);
+	for (;;) {
+		VideoFrame* frame;
+		if (!readFrames.pop(&frame))
+			break;
+		std::chrono::steady_clock::time_point busy = std::chrono::steady_clock::now();
+		options.backend->convolve(&frame->pixels[0], &frame->result[0], format.imageW * 4, format.imageW, format.imageH,
+			&mask, options.threads);
+		frame->blurMs = millisecondsSince(busy);
+		pipeline.blurBusyMs += frame->blurMs;
+		blurredFrames.push(frame);
+	}
+	blurredFrames.close();
+	reader.join();
+	writer.join();
+	double wallMs = millisecondsSince(start);
+	freeFrames.close();
+	if (pipeline.input != stdin)
+		fclose(pipeline.input);
+	if (pipeline.output != NULL && pipeline.output != stdout && fclose(pipeline.output) != 0)
+		pipeline.writeFailed = true;
+
+	int done = (int)pipeline.latencies.size();
+	double seconds = wallMs / 1000.0;
+	fprintf(report, "\n%d frames in %.2fs: %.2f fps, %.1f megapixels/s", done, seconds, done / seconds,
+		(double)done * format.imageW * format.imageH / 1e6 / seconds);
+	if (options.fps > 0.0)
+		fprintf(report, ", %d of %d dropped (%.1f%%)", pipeline.dropped, pipeline.read + pipeline.dropped,
+			100.0 * pipeline.dropped / std::max(1, pipeline.read + pipeline.dropped));
+	fprintf(report, "\n");
+	if (done > 0) {
+		std::sort(pipeline.latencies.begin(), pipeline.latencies.end());
+		std::sort(pipeline.blurTimes.begin(), pipeline.blurTimes.end());
+		fprintf(report, "%-8s %9s %9s %9s %9s\n", "", "p50", "p95", "p99", "max");
+		fprintf(report, "%-8s %7.2fms %7.2fms %7.2fms %7.2fms\n", "latency", percentile(pipeline.latencies, 0.5),
+			percentile(pipeline.latencies, 0.95), percentile(pipeline.latencies, 0.99), pipeline.latencies.back());
+		fprintf(report, "%-8s %7.2fms %7.2fms %7.2fms %7.2fms\n", "blur", percentile(pipeline.blurTimes, 0.5),
+			percentile(pipeline.blurTimes, 0.95), percentile(pipeline.blurTimes, 0.99), pipeline.blurTimes.back());
+		// the stage with the highest utilization is the one holding the frame rate down
+		fprintf(report, "Stage utilization: read %.1f%%, blur %.1f%%, write %.1f%%.\n", 100.0 * pipeline.readBusyMs / wallMs,
+			100.0 * pipeline.blurBusyMs / wallMs, 100.0 * pipeline.writeBusyMs / wallMs);
+	}
+	return (pipeline.readFailed || pipeline.writeFailed) ? 1 : 0;
+}
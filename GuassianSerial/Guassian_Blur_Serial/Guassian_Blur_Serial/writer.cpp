@@ -0,0 +1,90 @@
+#include "writer.h"
+#include "bench.h"
+#include "image.h"
+
+#include <chrono>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Functions <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Start the writer threads.
+// Parameters:
+// threads: images written at the same time, values below 1 are treated as 1.
+// maxQueued: images that may wait to be written before submit blocks, values below 1 are treated as 1.
+////
+AsyncWriter::AsyncWriter(int threads, int maxQueued)
+	: jobs(maxQueued), finished(false)
+{
+	if (threads < 1)
+		threads = 1;
+	WriterStats empty = { 0, 0, 0.0, 0.0 };
+	// sized before any thread starts, the threads keep pointers into it
+	threadStats.assign(threads, empty);
+	for (int t = 0; t < threads; t++)
+		this->threads.push_back(std::thread(&AsyncWriter::writeLoop, this, &threadStats[t]));
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	finish();
+}
+
+////
+// Queue an image to be saved to path, waiting if maxQueued images are already waiting.
+// The writer takes the surface and frees it once it's written (or if it can't be queued).
+// Returns false if the writer was already finished.
+////
+bool AsyncWriter::submit(SDL_Surface* surface, const std::string& path)
+{
+	WriteJob job;
+	job.surface = surface;
+	job.path = path;
+	if (!jobs.push(job)) {
+		SDL_FreeSurface(surface);
+		return false;
+	}
+	return true;
+}
+
+////
+// Write everything still queued and stop the threads, no more images can be submitted after this.
+// Returns the totals of all threads.
+////
+WriterStats AsyncWriter::finish()
+{
+	if (!finished) {
+		jobs.close();
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		finished = true;
+	}
+	WriterStats total = { 0, 0, 0.0, 0.0 };
+	for (size_t t = 0; t < threadStats.size(); t++) {
+		total.written += threadStats[t].written;
+		total.failures += threadStats[t].failures;
+		total.busyMs += threadStats[t].busyMs;
+		total.starvedMs += threadStats[t].starvedMs;
+	}
+	return total;
+}
+
+// Body of every writer thread, runs until the queue is closed and drained.
+void AsyncWriter::writeLoop(WriterStats* stats)
+{
+	for (;;) {
+		WriteJob job;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool popped = jobs.pop(&job);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		stats->starvedMs += std::chrono::duration<double, std::milli>(end - start).count();
+		if (!popped)
+			break;
+
+		if (saveImage(job.surface, job.path.c_str()))
+			stats->written++;
+		else
+			stats->failures++;
+		SDL_FreeSurface(job.surface);
+		stats->busyMs += millisecondsSince(end);
+	}
+}
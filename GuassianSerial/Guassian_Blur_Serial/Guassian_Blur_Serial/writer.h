@@ -0,0 +1,51 @@
+#pragma once
+
+#include "boundedqueue.h"
+#include "SDL.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+/// >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Types <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+
+////
+// Totals of an AsyncWriter, summed over its threads.
+////
+struct WriterStats {
+	int written;
+	int failures;
+	double busyMs; // encoding and writing
+	double starvedMs; // waiting for something to write
+};
+
+////
+// Saves images on background threads so encoding overlaps with blurring the next image.
+// At most maxQueued images wait to be written (plus one being written per thread); submit blocks
+// beyond that, so memory stays flat however far compute runs ahead.
+// Files are saved with saveImage, so the format follows the extension (.png, .jpg, .bmp, .ppm or .raw).
+////
+class AsyncWriter {
+public:
+	AsyncWriter(int threads, int maxQueued);
+	~AsyncWriter();
+
+	bool submit(SDL_Surface* surface, const std::string& path);
+	WriterStats finish();
+
+private:
+	////
+	// An image waiting to be written, the writer owns (and frees) the surface.
+	////
+	struct WriteJob {
+		SDL_Surface* surface;
+		std::string path;
+	};
+
+	void writeLoop(WriterStats* stats);
+
+	BoundedQueue<WriteJob> jobs;
+	std::vector<std::thread> threads;
+	std::vector<WriterStats> threadStats;
+	bool finished;
+};